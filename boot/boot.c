@@ -0,0 +1,336 @@
+/**
+ * OTA bootloader for LoggerSoft
+ *
+ * Sits in the first OTA_BOOT_SIZE bytes of internal flash and acts on the
+ * latest boot record in W25Q (see inc/ota_boot.h):
+ *   PENDING  verify new image, back up running image, write BACKED_UP,
+ *            program new image, write TRIAL
+ *   BACKED_UP  reset during programming, program new image again
+ *   TRIAL    count the boot, after OTA_BOOT_ATTEMPTS boots without
+ *            confirmation restore the backup and write ROLLED_BACK
+ * then starts the application at OTA_APP_BASE.
+ *
+ * Uses the standard peripheral library only, W25Q is driven by polled
+ * SPI1 (PB13 SCK, PB14 MISO, PB15 MOSI, CS PA12), SX1278 NSS (PB12) is
+ * held high. Pages above OTA_APP_END are not touched.
+ *
+ * Build with startup_gd32e23x.S, system_gd32e23x.c, src/crc32.c and the
+ * fmc, gpio, rcu and spi drivers, link with ldscripts/gd32e23x_boot.ld.
+ */
+
+#include "gd32e23x.h"
+#include "ota_boot.h"
+#include "crc32.h"
+
+#define BOOT_CS_PORT		GPIOA
+#define BOOT_CS_PIN			GPIO_PIN_12
+#define BOOT_SX_NSS_PORT	GPIOB
+#define BOOT_SX_NSS_PIN		GPIO_PIN_12
+
+#define W25_PAGE_SIZE		256
+#define W25_READ			0x03
+#define W25_PAGE_PROGRAM	0x02
+#define W25_SECTOR_ERASE	0x20
+#define W25_WRITE_ENABLE	0x06
+#define W25_READ_SR1		0x05
+#define W25_POWER_DOWN		0xB9
+#define W25_RELEASE			0xAB
+
+static uint8_t buffer[W25_PAGE_SIZE];
+
+/*
+ * W25Q
+ */
+
+static uint8_t spi_transfer(uint8_t data) {
+	while (spi_i2s_flag_get(SPI1, SPI_FLAG_TBE) == RESET);
+	spi_i2s_data_transmit(SPI1, data);
+	while (spi_i2s_flag_get(SPI1, SPI_FLAG_RBNE) == RESET);
+	return (uint8_t) spi_i2s_data_receive(SPI1);
+}
+
+static void w25_command(uint8_t command, uint32_t address, uint8_t with_address) {
+	gpio_bit_reset(BOOT_CS_PORT, BOOT_CS_PIN);
+	spi_transfer(command);
+	if (with_address) {
+		spi_transfer(address >> 16);
+		spi_transfer(address >> 8);
+		spi_transfer(address);
+	}
+}
+
+static void w25_end(void) {
+	while (spi_i2s_flag_get(SPI1, SPI_FLAG_TRANS) == SET);
+	gpio_bit_set(BOOT_CS_PORT, BOOT_CS_PIN);
+}
+
+static void w25_wait(void) {
+	w25_command(W25_READ_SR1, 0, 0);
+	while (spi_transfer(0xFF) & 0x01);
+	w25_end();
+}
+
+static void w25_simple(uint8_t command) {
+	w25_command(command, 0, 0);
+	w25_end();
+}
+
+static void w25_read(uint32_t address, uint8_t * data, uint32_t length) {
+	w25_command(W25_READ, address, 1);
+	while (length--) {
+		*data++ = spi_transfer(0xFF);
+	}
+	w25_end();
+}
+
+// data must not cross a W25Q page
+static void w25_program(uint32_t address, const uint8_t * data, uint32_t length) {
+	w25_simple(W25_WRITE_ENABLE);
+	w25_command(W25_PAGE_PROGRAM, address, 1);
+	while (length--) {
+		spi_transfer(*data++);
+	}
+	w25_end();
+	w25_wait();
+}
+
+static void w25_erase(uint32_t address) {
+	w25_simple(W25_WRITE_ENABLE);
+	w25_command(W25_SECTOR_ERASE, address, 1);
+	w25_end();
+	w25_wait();
+}
+
+static uint32_t w25_crc(uint32_t address) {
+	uint32_t crc = 0;
+	uint32_t offset;
+	uint32_t length;
+
+	for (offset = 0; offset < OTA_APP_SIZE; offset += length) {
+		length = (OTA_APP_SIZE - offset < sizeof(buffer)) ? OTA_APP_SIZE - offset : sizeof(buffer);
+		w25_read(address + offset, buffer, length);
+		crc = crc32_update(crc, buffer, length);
+	}
+	return crc;
+}
+
+static void w25_init(void) {
+	spi_parameter_struct spi;
+
+	rcu_periph_clock_enable(RCU_GPIOA);
+	rcu_periph_clock_enable(RCU_GPIOB);
+	rcu_periph_clock_enable(RCU_SPI1);
+
+	gpio_bit_set(BOOT_CS_PORT, BOOT_CS_PIN);
+	gpio_mode_set(BOOT_CS_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, BOOT_CS_PIN);
+	gpio_output_options_set(BOOT_CS_PORT, GPIO_OTYPE_PP, GPIO_OSPEED_50MHZ, BOOT_CS_PIN);
+	gpio_bit_set(BOOT_SX_NSS_PORT, BOOT_SX_NSS_PIN);
+	gpio_mode_set(BOOT_SX_NSS_PORT, GPIO_MODE_OUTPUT, GPIO_PUPD_NONE, BOOT_SX_NSS_PIN);
+	gpio_output_options_set(BOOT_SX_NSS_PORT, GPIO_OTYPE_PP, GPIO_OSPEED_50MHZ, BOOT_SX_NSS_PIN);
+
+	gpio_af_set(GPIOB, GPIO_AF_0, GPIO_PIN_13 | GPIO_PIN_14 | GPIO_PIN_15);
+	gpio_mode_set(GPIOB, GPIO_MODE_AF, GPIO_PUPD_NONE, GPIO_PIN_13 | GPIO_PIN_14 | GPIO_PIN_15);
+	gpio_output_options_set(GPIOB, GPIO_OTYPE_PP, GPIO_OSPEED_50MHZ, GPIO_PIN_13 | GPIO_PIN_15);
+
+	spi_struct_para_init(&spi);
+	spi.trans_mode = SPI_TRANSMODE_FULLDUPLEX;
+	spi.device_mode = SPI_MASTER;
+	spi.frame_size = SPI_FRAMESIZE_8BIT;
+	spi.clock_polarity_phase = SPI_CK_PL_LOW_PH_1EDGE;
+	spi.nss = SPI_NSS_SOFT;
+	spi.prescale = SPI_PSC_8;
+	spi.endian = SPI_ENDIAN_MSB;
+	spi_init(SPI1, &spi);
+	spi_fifo_access_size_config(SPI1, SPI_BYTE_ACCESS);
+	spi_enable(SPI1);
+
+	// application leaves the W25Q powered down, tRES1 is 3 us
+	w25_simple(W25_RELEASE);
+	for (volatile uint32_t i = 0; i < 100; i++);
+}
+
+static void w25_deinit(void) {
+	w25_simple(W25_POWER_DOWN);
+	spi_disable(SPI1);
+	rcu_periph_reset_enable(RCU_SPI1RST);
+	rcu_periph_reset_disable(RCU_SPI1RST);
+}
+
+/*
+ * Boot record
+ */
+
+static uint32_t record_crc(const ota_boot_record_t * record) {
+	return crc32_update(0, (const uint8_t*) record, sizeof(ota_boot_record_t) - sizeof(uint32_t));
+}
+
+static uint8_t record_read(ota_boot_record_t * record, uint32_t * next_slot) {
+	ota_boot_record_t candidate;
+	uint8_t found = 0;
+	uint32_t slot;
+
+	*next_slot = OTA_BOOT_RECORDS;
+	for (slot = 0; slot < OTA_BOOT_RECORDS; slot++) {
+		w25_read(OTA_W25Q_STATE + slot * sizeof(candidate), (uint8_t*) &candidate, sizeof(candidate));
+		if (candidate.magic == 0xFFFFFFFFUL) {
+			*next_slot = slot;
+			break;
+		}
+		if ((candidate.magic == OTA_BOOT_MAGIC) && (candidate.crc == record_crc(&candidate))) {
+			*record = candidate;
+			found = 1;
+		}
+	}
+	return found;
+}
+
+static void record_write(ota_boot_record_t * record, uint32_t state) {
+	ota_boot_record_t last;
+	uint32_t slot;
+
+	record->sequence = record_read(&last, &slot) ? last.sequence + 1 : 0;
+	record->magic = OTA_BOOT_MAGIC;
+	record->state = state;
+	record->crc = record_crc(record);
+	if (slot == OTA_BOOT_RECORDS) {
+		w25_erase(OTA_W25Q_STATE);
+		slot = 0;
+	}
+	w25_program(OTA_W25Q_STATE + slot * sizeof(ota_boot_record_t), (const uint8_t*) record,
+			sizeof(ota_boot_record_t));
+}
+
+/*
+ * Internal flash
+ */
+
+// copy OTA_APP_SIZE bytes from W25Q into the application area
+static void flash_install(uint32_t source) {
+	uint32_t address;
+	uint32_t offset;
+	uint32_t word;
+
+	fmc_unlock();
+	for (address = OTA_APP_BASE; address < OTA_APP_END; address += OTA_FLASH_PAGE_SIZE) {
+		fmc_page_erase(address);
+	}
+	for (offset = 0; offset < OTA_APP_SIZE; offset += sizeof(buffer)) {
+		w25_read(source + offset, buffer, sizeof(buffer));
+		for (address = 0; (address < sizeof(buffer)) && (offset + address < OTA_APP_SIZE); address += 4) {
+			word = buffer[address] | (buffer[address + 1] << 8)
+					| (buffer[address + 2] << 16) | ((uint32_t) buffer[address + 3] << 24);
+			if (word != 0xFFFFFFFFUL) {
+				fmc_word_program(OTA_APP_BASE + offset + address, word);
+			}
+		}
+	}
+	fmc_lock();
+}
+
+// copy application area into W25Q
+static void flash_backup(uint32_t destination) {
+	uint32_t offset;
+	uint32_t length;
+
+	for (offset = 0; offset < OTA_APP_SIZE; offset += OTA_W25Q_SECTOR_SIZE) {
+		w25_erase(destination + offset);
+	}
+	for (offset = 0; offset < OTA_APP_SIZE; offset += length) {
+		length = (OTA_APP_SIZE - offset < W25_PAGE_SIZE) ? OTA_APP_SIZE - offset : W25_PAGE_SIZE;
+		w25_program(destination + offset, (const uint8_t*) (OTA_APP_BASE + offset), length);
+	}
+}
+
+static uint32_t flash_crc(void) {
+	return crc32_update(0, (const uint8_t*) OTA_APP_BASE, OTA_APP_SIZE);
+}
+
+static void rollback(ota_boot_record_t * record) {
+	// a broken backup is not better than what is there
+	if (w25_crc(OTA_W25Q_BACKUP) == record->backup_crc) {
+		flash_install(OTA_W25Q_BACKUP);
+	}
+	record_write(record, OTA_BOOT_ROLLED_BACK);
+}
+
+// program the new image, the backup is known good
+static void install(ota_boot_record_t * record) {
+	flash_install(OTA_W25Q_IMAGE);
+	if (flash_crc() != record->image_crc) {
+		rollback(record);
+		return;
+	}
+	record->attempts = 0;
+	record_write(record, OTA_BOOT_TRIAL);
+}
+
+static void update(void) {
+	ota_boot_record_t record;
+	uint32_t slot;
+
+	if (!record_read(&record, &slot)) {
+		return;
+	}
+
+	switch (record.state) {
+	case OTA_BOOT_PENDING:
+		if (w25_crc(OTA_W25Q_IMAGE) != record.image_crc) {
+			record_write(&record, OTA_BOOT_ROLLED_BACK);
+			break;
+		}
+		record.backup_crc = flash_crc();
+		flash_backup(OTA_W25Q_BACKUP);
+		if (w25_crc(OTA_W25Q_BACKUP) != record.backup_crc) {
+			// no way back, keep running image
+			record_write(&record, OTA_BOOT_ROLLED_BACK);
+			break;
+		}
+		// from here the running image is only in W25Q, a reset must not back up again
+		record_write(&record, OTA_BOOT_BACKED_UP);
+		install(&record);
+		break;
+	case OTA_BOOT_BACKED_UP:
+		install(&record);
+		break;
+	case OTA_BOOT_TRIAL:
+		// every reset before ota_confirm() counts as a failed boot
+		if (++record.attempts >= OTA_BOOT_ATTEMPTS) {
+			rollback(&record);
+		} else {
+			record_write(&record, OTA_BOOT_TRIAL);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Start
+ */
+
+static void jump(void) {
+	uint32_t stack = *(volatile uint32_t*) OTA_APP_BASE;
+	uint32_t entry = *(volatile uint32_t*) (OTA_APP_BASE + 4);
+
+	// erased or broken application
+	if ((stack & 0xFFFF0000UL) != 0x20000000UL) {
+		while (1);
+	}
+
+	__disable_irq();
+	SCB->VTOR = OTA_APP_BASE;
+	__set_MSP(stack);
+	__enable_irq();
+	((void (*)(void)) entry)();
+}
+
+int main(void) {
+	w25_init();
+	update();
+	w25_deinit();
+
+	jump();
+
+	while (1);
+}
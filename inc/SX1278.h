@@ -209,6 +209,14 @@ static const uint8_t SX1278_CodingRate[4] = { 0x01, 0x02, 0x03, 0x04 };
 
 static const uint8_t SX1278_CRC_Sum[2] = { 0x01, 0x00 };
 
+// Preamble length and single RX timeout [symbols]
+#define SX1278_PREAMBLE_MIN				6
+#define SX1278_RX_SETTLE_US				250		// receiver start-up, symbols in it are not seen
+#define SX1278_PREAMBLE_DEFAULT			8
+#define SX1278_SYMBOL_TIMEOUT_MIN		4
+#define SX1278_SYMBOL_TIMEOUT_MAX		1023
+#define SX1278_SYMBOL_TIMEOUT_DEFAULT	8
+
 // RegSyncWord LoRa Sync Word
 #define SX127X_SYNC_WORD_FACTORY        0x12  // default SyncWord for LoRa module
 #define SX127X_SYNC_WORD_LORAWAN        0x34  // reserved for LoRaWAN networks
@@ -219,10 +227,28 @@ typedef enum _SX1278_STATUS {
 	SLEEP, STANDBY, TX, RX
 } SX1278_Status_t;
 
+// settings written by SX1278_config(), the channel excluded
+typedef struct {
+	uint8_t power;
+	uint8_t LoRa_SF;
+	uint8_t LoRa_BW;
+	uint8_t LoRa_CR;
+	uint8_t LoRa_CRC_sum;
+	uint8_t sync_word;
+	uint8_t implicit_header;
+	uint16_t preamble;
+	uint16_t symbol_timeout;
+} SX1278_settings_t;
+
 typedef struct {
 	SX1278_hw_t * hw;
 
 	uint64_t frequency;
+	uint8_t frf[3];			// RegFrMsb..RegFrLsb of the current channel
+	const uint8_t (*hop_table)[3];	// FHSS channels, frf of each
+	uint8_t hop_count;
+	uint8_t hop_period;		// symbols per hop, 0 disables FHSS
+	uint8_t hop_min_sf;		// FHSS only from this SX1278_LORA_SF_* up
 	uint8_t power;
 	uint8_t LoRa_SF;
 	uint8_t LoRa_BW;
@@ -230,6 +256,11 @@ typedef struct {
 	uint8_t LoRa_CRC_sum;
 	uint8_t packetLength;
 	uint8_t sync_word;
+	uint8_t implicit_header;	// frames of packetLength without header, always at SF6
+	uint16_t preamble;			// preamble symbols without the 4.25 sync symbols
+	uint16_t symbol_timeout;	// single RX gives up after that many symbols
+	SX1278_settings_t applied;	// in the registers, valid if configured
+	uint8_t configured;
 
 	SX1278_Status_t status;
 
@@ -296,6 +327,107 @@ void SX1278_SPIBurstWrite(SX1278_t * module, uint8_t addr, uint8_t * txBuf,
  */
 void SX1278_config(SX1278_t * module);
 
+/**
+ * \brief Write settings that changed since the last SX1278_config()
+ *
+ * Done by every TX and RX entry. A change of the channel only, the usual
+ * case between frames with a channel plan, costs one burst to RegFrMsb
+ * and a standby; anything else takes the full SX1278_config() with its
+ * 15 ms in sleep.
+ *
+ * \param[in]  module	Pointer to LoRa structure
+ */
+void SX1278_update_config(SX1278_t * module);
+
+/**
+ * \brief Compute frequency registers
+ *
+ * \param[in]  frequency    Frequency in [Hz]
+ * \param[out] frf          RegFrMsb, RegFrMid and RegFrLsb values
+ */
+void SX1278_frf(uint64_t frequency, uint8_t * frf);
+
+/**
+ * \brief Change channel
+ *
+ * Writes precomputed frequency registers in one burst, module has to be
+ * in sleep or standby mode. Kept by later SX1278_config() calls.
+ *
+ * \param[in]  module	Pointer to LoRa structure
+ * \param[in]  frf      Values from SX1278_frf()
+ */
+void SX1278_set_frf(SX1278_t * module, const uint8_t * frf);
+
+/**
+ * \brief Symbol duration
+ *
+ * \param[in]  module	Pointer to LoRa structure
+ *
+ * \return     Symbol time at current LoRa_SF and LoRa_BW [us]
+ */
+uint32_t SX1278_symbol_us(SX1278_t * module);
+
+/**
+ * \brief Set preamble length and single RX timeout
+ *
+ * Takes effect with the next TX or RX entry. A receiver needs a
+ * preamble at least as long as the one sent, a shorter one saves time
+ * on air where the receiver is known to listen already.
+ *
+ * Limits follow the symbol time of the current LoRa_SF and LoRa_BW: the
+ * symbols of SX1278_RX_SETTLE_US come on top of SX1278_PREAMBLE_MIN and
+ * SX1278_SYMBOL_TIMEOUT_MIN, one at the usual rates, more at SF6 and
+ * 500 kHz. A single RX must wait out a whole preamble, so the timeout is
+ * no shorter than the preamble unless it is SX1278_SYMBOL_TIMEOUT_MAX.
+ *
+ * \param[in]  module	Pointer to LoRa structure
+ * \param[in]  preamble       Preamble symbols, see above..65535
+ * \param[in]  symbol_timeout Symbols, preamble..SX1278_SYMBOL_TIMEOUT_MAX
+ *
+ * \return     1 if set, 0 if out of range and nothing was changed
+ */
+int SX1278_set_preamble(SX1278_t * module, uint16_t preamble, uint16_t symbol_timeout);
+
+/**
+ * \brief Time on air of a frame
+ *
+ * Follows the current settings, the preamble length and the header
+ * mode. Low data rate optimization is never enabled by SX1278_config.
+ *
+ * \param[in]  module	Pointer to LoRa structure
+ * \param[in]  length   Payload length in bytes
+ * \param[in]  implicit 1 for a frame without header
+ *
+ * \return     Time on air [us]
+ */
+uint32_t SX1278_time_on_air_us(SX1278_t * module, uint8_t length, uint8_t implicit);
+
+/**
+ * \brief Set up intra-packet frequency hopping
+ *
+ * Frames sent or received with LoRa_SF >= min_sf hop every period
+ * symbols. The module raises FhssChangeChannel on DIO1 at every hop,
+ * SX1278_hop() has to be called from that interrupt. The header goes
+ * out on the current channel, hop n on table[n % count].
+ *
+ * \param[in]  module	Pointer to LoRa structure
+ * \param[in]  table    Channel registers from SX1278_frf()
+ * \param[in]  count    Number of channels, 0 disables FHSS
+ * \param[in]  period   Hop period in symbols, 1..255
+ * \param[in]  min_sf   Slowest SX1278_LORA_SF_* without hopping + 1
+ */
+void SX1278_set_fhss(SX1278_t * module, const uint8_t (*table)[3], uint8_t count,
+		uint8_t period, uint8_t min_sf);
+
+/**
+ * \brief Move to the next hop channel
+ *
+ * Call from the DIO1 interrupt while FHSS is set up.
+ *
+ * \param[in]  module	Pointer to LoRa structure
+ */
+void SX1278_hop(SX1278_t * module);
+
 /**
  * \brief Entry LoRa mode
  *
@@ -372,6 +504,32 @@ int SX1278_LoRaEntryTx(SX1278_t * module, uint8_t length, uint32_t timeout);
 int SX1278_LoRaTxPacket(SX1278_t * module, uint8_t * txBuf, uint8_t length,
 		uint32_t timeout);
 
+/**
+ * \brief Start sending data
+ *
+ * Loads data into FIFO and switches module into TX mode.
+ * Returns immediately, use SX1278_LoRaTxWait() to wait for TxDone.
+ *
+ * \param[in]  module	Pointer to LoRa structure
+ * \param[in]  txBuf    Data buffer with data to be sent
+ * \param[in]  length   Length of message to be sent
+ */
+void SX1278_LoRaTxStart(SX1278_t * module, uint8_t * txBuf, uint8_t length);
+
+/**
+ * \brief Wait for end of transmission
+ *
+ * Waits for TxDone started by SX1278_LoRaTxStart() and
+ * enters standby mode.
+ *
+ * \param[in]  module	Pointer to LoRa structure
+ * \param[in]  timeout  Timeout in [ms]
+ *
+ * \return     1 if data was sent
+ *             0 if timeout was exceeded
+ */
+int SX1278_LoRaTxWait(SX1278_t * module, uint32_t timeout);
+
 /**
  * \brief Initialize LoRa module
  *
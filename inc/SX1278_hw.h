@@ -15,16 +15,14 @@
 extern "C" {
 #endif
 
+/*
+ * NSS, RESET and DIO0 are the SX_* pins of main.h, bound at compile time
+ * so that every access is a single register write or read.
+ */
 typedef struct {
-	long unsigned int pin;
-	long unsigned int port;
-} SX1278_hw_dio_t;
-
-typedef struct {
-	SX1278_hw_dio_t reset;
-	SX1278_hw_dio_t dio0;
-	SX1278_hw_dio_t nss;
 	hal_spi_dev_struct * spi;
+	uint8_t dio1_irq_used;	// DIO1 interrupt talks to the module, masked while NSS is low
+	IRQn_Type dio1_irq;
 } SX1278_hw_t;
 
 /**
@@ -39,13 +37,45 @@ void SX1278_hw_init(SX1278_hw_t * hw);
 /**
  * \brief Control NSS
  *
- * Clears and sets NSS according to passed value.
+ * Clears and sets NSS according to passed value. An SPI transfer runs
+ * with NSS low, the DIO1 interrupt waits for its end.
  *
  * \param[in]   hw 		Pointer to hardware structure.
  * \param[in]   value   1 sets NSS high, other value sets NSS low.
  */
 void SX1278_hw_SetNSS(SX1278_hw_t * hw, int value);
 
+/**
+ * \brief Hold back the DIO1 interrupt
+ *
+ * For transactions of other devices on the SPI bus of the module, the
+ * interrupt would start a radio transfer in the middle of them.
+ *
+ * \param[in]   hw 		Pointer to hardware structure.
+ */
+void SX1278_hw_irq_hold(SX1278_hw_t * hw);
+
+/**
+ * \brief Let the DIO1 interrupt in again, a pending one runs now
+ *
+ * \param[in]   hw 		Pointer to hardware structure.
+ */
+void SX1278_hw_irq_release(SX1278_hw_t * hw);
+
+/**
+ * \brief Start SPI transaction, NSS low
+ *
+ * \param[in]   hw 		Pointer to hardware structure.
+ */
+void SX1278_hw_Select(SX1278_hw_t * hw);
+
+/**
+ * \brief End SPI transaction, NSS high
+ *
+ * \param[in]   hw 		Pointer to hardware structure.
+ */
+void SX1278_hw_Unselect(SX1278_hw_t * hw);
+
 /**
  * \brief Resets LoRa module
  *
@@ -58,7 +88,7 @@ void SX1278_hw_Reset(SX1278_hw_t * hw);
 /**
  * \brief Send command via SPI.
  *
- * Send single byte via SPI interface.
+ * Send single byte via SPI interface, NSS has to be low already.
  *
  * \param[in]   hw 		Pointer to hardware structure
  * \param[in]   cmd		Command
@@ -68,7 +98,7 @@ void SX1278_hw_SPICommand(SX1278_hw_t * hw, uint8_t cmd);
 /**
  * \brief Reads data via SPI
  *
- * Reads data via SPI interface.
+ * Reads data via SPI interface, NSS has to be low already.
  *
  * \param[in]   hw 		Pointer to hardware structure
  *
@@ -76,6 +106,19 @@ void SX1278_hw_SPICommand(SX1278_hw_t * hw, uint8_t cmd);
  */
 uint8_t SX1278_hw_SPIReadByte(SX1278_hw_t * hw);
 
+/**
+ * \brief Exchange bytes via SPI
+ *
+ * Runs within a transaction, NSS has to be low already.
+ *
+ * \param[in]   hw 		Pointer to hardware structure
+ * \param[in]   tx 		Bytes to send, NULL sends zeros
+ * \param[out]  rx 		Received bytes, NULL drops them
+ * \param[in]   length 	Number of bytes
+ */
+void SX1278_hw_SPITransfer(SX1278_hw_t * hw, const uint8_t * tx, uint8_t * rx,
+		uint8_t length);
+
 /**
  * \brief ms delay
  *
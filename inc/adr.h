@@ -0,0 +1,81 @@
+/**
+ * Adaptive data rate for LoggerSoft
+ *
+ * The gateway acknowledges every uplink with downlink_ack_t carrying the
+ * SNR and RSSI it measured and an SF and TX power recommendation. The
+ * gateway keeps the recommendation conservative, e.g. the LoRaWAN rule:
+ * margin = best SNR of the last frames - demodulation floor of the SF -
+ * 10 dB installation margin, then one SF step down per 2.5 dB of margin,
+ * then one power step down per 3 dB left.
+ *
+ * The node takes the recommendation within [ADR_MIN_SF, SF12] and feeds
+ * the measured margin to the battery policy. Without an ACK for
+ * ADR_ACK_LIMIT uplinks in a row it first goes back to full power, then
+ * steps the SF up by one every further ADR_ACK_LIMIT misses, so a node
+ * that lost its gateway ends up at SF12 and 20 dBm.
+ */
+
+#ifndef __ADR_H__
+#define __ADR_H__
+
+#include <stdint.h>
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ADR_MARGIN_UNKNOWN	(-128)
+
+typedef struct {
+	uint8_t sf;				// SX1278_LORA_SF_* for next uplinks
+	uint8_t power;			// SX1278_POWER_* for next uplinks
+	uint32_t expected;		// msg_id of the uplink waiting for ACK
+	uint8_t sent_sf;		// SF of that uplink
+	uint8_t acked;			// ACK arrived in current window
+	uint8_t missed;			// ACKs missed in a row
+	int8_t snr;				// last reported SNR [0.25 dB]
+	int16_t rssi;			// last reported RSSI [dBm]
+	int8_t margin_db;		// last link margin, ADR_MARGIN_UNKNOWN if none
+	uint32_t acks;			// ACKs received since power-up
+	uint32_t misses;		// ACKs missed since power-up
+} adr_t;
+
+extern adr_t adr;
+
+/**
+ * \brief Start from given settings
+ *
+ * \param[in]  sf		SX1278_LORA_SF_*
+ * \param[in]  power	SX1278_POWER_*
+ */
+void adr_init(uint8_t sf, uint8_t power);
+
+/**
+ * \brief Uplink went out, its ACK is expected in the following window
+ *
+ * \param[in]  msg_id	Message counter of the uplink
+ * \param[in]  sf		SF it was sent with
+ */
+void adr_sent(uint32_t msg_id, uint8_t sf);
+
+/**
+ * \brief Handle DOWNLINK_TYPE_ACK
+ *
+ * \param[in]  payload	Frame without downlink_header_t
+ * \param[in]  length	Payload length
+ */
+void adr_downlink(const uint8_t * payload, uint8_t length);
+
+/**
+ * \brief Evaluate the window after adr_sent()
+ *
+ * \return     1 if adr.sf or adr.power changed, 0 otherwise
+ */
+uint8_t adr_window_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+/**
+ * Windowed statistics for LoggerSoft
+ *
+ * Keeps running min, max, sum and last value of every sample channel
+ * over one uplink window in constant memory, so the node can sample
+ * often and send one packet_stats_t per window.
+ */
+
+#ifndef __AGGREGATE_H__
+#define __AGGREGATE_H__
+
+#include <stdint.h>
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define AGGREGATE_CHANNELS		4	// temperature, humidity, pressure, voltage
+
+typedef struct {
+	int32_t min[AGGREGATE_CHANNELS];
+	int32_t max[AGGREGATE_CHANNELS];
+	int32_t sum[AGGREGATE_CHANNELS];
+	int32_t last[AGGREGATE_CHANNELS];
+	uint8_t first_seq;
+	uint8_t count;
+} aggregate_t;
+
+/**
+ * \brief Start new window
+ *
+ * \param[out] agg		Aggregator
+ */
+void aggregate_reset(aggregate_t * agg);
+
+/**
+ * \brief Add sample to window
+ *
+ * \param[in]  agg		Aggregator
+ * \param[in]  sample	Sample, window is full at 255 samples
+ */
+void aggregate_add(aggregate_t * agg, const packet_sample_t * sample);
+
+/**
+ * \brief Get window statistics
+ *
+ * Mean is rounded to nearest record unit.
+ *
+ * \param[in]  agg		Aggregator with at least one sample
+ * \param[out] stats	Window record
+ */
+void aggregate_get(const aggregate_t * agg, packet_stats_t * stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,115 @@
+/**
+ * Store-and-forward backfill from the flash log for LoggerSoft
+ *
+ * Every sample is in the flash log, so an uplink the gateway did not
+ * acknowledge loses nothing but the live view. The log records it
+ * covered are kept as a backlog, a range of log indices, and sent again
+ * as PACKET_TYPE_BACKFILL frames of up to BACKFILL_MAX_RECORDS records
+ * once the link is back, i.e. after a live uplink was acknowledged.
+ * Samples dropped from a full RAM queue while uplinks were off are
+ * treated the same way.
+ *
+ * Live data keeps priority: backfill frames go out only after the live
+ * uplink and its receive window, no more than BACKFILL_MAX_FRAMES per
+ * wake-up and, with USE_TDMA, only while frame and window fit into the
+ * rest of the own slot. Each frame has its receive window like the live
+ * uplink, downlinks in it are handled before the next frame. Their
+ * measured time on air is paid from a budget that refills at
+ * BACKFILL_DUTY_PERMILLE of the elapsed time. The backlog drains oldest
+ * first, or newest first with BACKFILL_NEWEST_FIRST.
+ *
+ * The backlog lives in RAM, records of a previous boot are not sent
+ * again. Overlapping outages are merged into one range, so the gateway
+ * may get a record twice and drops duplicates by device and time.
+ */
+
+#ifndef __BACKFILL_H__
+#define __BACKFILL_H__
+
+#include <stdint.h>
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint32_t start;			// backlog, log indices [start, end)
+	uint32_t end;
+	uint32_t live_start;	// log records covered by the last live uplink,
+	uint32_t live_end;		// [live_start, live_end)
+	uint32_t expected;		// msg_id of the uplink waiting for ACK
+	uint32_t first;			// records of that uplink if a backfill frame
+	uint8_t count;			// 0 for a live uplink
+	uint8_t acked;			// ACK arrived in current window
+	uint8_t link;			// last uplink was acknowledged
+	uint8_t dropped;		// queued records lost since the last live uplink
+	int32_t credit_ms;		// time on air left in the budget
+	uint32_t credit_s;		// uptime of the last refill
+	uint32_t airtime_ms;	// last backfill frame
+	uint32_t frames;		// backfill frames acknowledged since power-up
+	uint32_t records;		// records in them
+} backfill_t;
+
+extern backfill_t backfill;
+
+/**
+ * \brief Start with an empty backlog at the log head
+ *
+ * Call after flashlog_init().
+ */
+void backfill_init(void);
+
+/**
+ * \brief A queued record was dropped before it went out
+ */
+void backfill_dropped(void);
+
+/**
+ * \brief Live uplink went out, its ACK is expected in the following window
+ *
+ * \param[in]  msg_id	Message counter of the uplink
+ */
+void backfill_live_sent(uint32_t msg_id);
+
+/**
+ * \brief Build the next backfill frame if the link and the budget allow it
+ *
+ * Flash SPI bus has to be started, buffered log records of the backlog
+ * are flushed first.
+ *
+ * \param[out] buf		Destination, at least PACKET_MAX_SIZE bytes
+ * \param[in]  msg_id	Message counter
+ * \param[in]  uptime	sched_uptime() value
+ *
+ * \return     Frame length in bytes, 0 if nothing is to be sent
+ */
+uint8_t backfill_build(uint8_t * buf, uint32_t msg_id, uint32_t uptime);
+
+/**
+ * \brief Backfill frame went out
+ *
+ * \param[in]  airtime_ms	Measured TX time, charged to the budget
+ */
+void backfill_sent(uint32_t airtime_ms);
+
+/**
+ * \brief Handle DOWNLINK_TYPE_ACK
+ *
+ * \param[in]  payload	Frame without downlink_header_t
+ * \param[in]  length	Payload length
+ */
+void backfill_ack(const uint8_t * payload, uint8_t length);
+
+/**
+ * \brief Update the backlog after the window of an uplink
+ *
+ * \return     1 if the uplink was acknowledged, 0 otherwise
+ */
+uint8_t backfill_window_end(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+/**
+ * Battery monitor for LoggerSoft
+ *
+ * Measures the battery (ADC_IN9, PB1, behind 1/1 R-div) against the
+ * internal VREFINT channel using the ADC hardware oversampler, so the
+ * result does not depend on the actual VDDA level.
+ */
+
+#ifndef __BATTERY_H__
+#define __BATTERY_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * BATTERY_VREFINT_MV - typical VREFINT voltage from GD32E230 datasheet
+ * BATTERY_DIVIDER - battery input divider ratio (2 for 1/1 R-div)
+ * BATTERY_TREND_SHIFT - EMA weight of the trend filter, 1/(2^shift)
+ */
+#define BATTERY_VREFINT_MV		1200
+#define BATTERY_DIVIDER			2
+#define BATTERY_TREND_SHIFT		5
+#define BATTERY_ADC_TIMEOUT		10
+
+typedef struct {
+	uint16_t vdda_mv;		// last measured supply of the MCU
+	uint16_t idle_mv;		// last battery voltage without load
+	uint16_t load_mv;		// last battery voltage under LoRa TX load
+	int32_t trend;			// filtered change of idle_mv per sample [1/256 mV]
+	uint8_t valid;			// idle_mv was measured at least once
+} battery_t;
+
+extern battery_t battery;
+
+/**
+ * \brief Measure battery at rest
+ *
+ * Converts VREFINT and battery channels (x16 oversampled each),
+ * updates battery.vdda_mv, battery.idle_mv and battery.trend.
+ * ADC must be initialized (msd_adc_init), it is left stopped.
+ *
+ * \return     Battery voltage in [mV], 0 on ADC error
+ */
+uint16_t battery_sample_idle(void);
+
+/**
+ * \brief Measure battery under load
+ *
+ * Same as battery_sample_idle() but stores the result into
+ * battery.load_mv and leaves the trend untouched. Call it while
+ * the radio is transmitting to catch the voltage sag.
+ *
+ * \return     Battery voltage in [mV], 0 on ADC error
+ */
+uint16_t battery_sample_load(void);
+
+/**
+ * \brief Voltage sag of the last TX
+ *
+ * \return     idle_mv - load_mv in [mV], 0 if unknown
+ */
+uint16_t battery_sag_mv(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
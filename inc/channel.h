@@ -0,0 +1,55 @@
+/**
+ * Per-frame channel hopping for LoggerSoft
+ *
+ * Every uplink goes out on a channel of CHANNEL_PLAN picked by a hash of
+ * the device ID and msg_id, so nodes spread evenly over the plan and two
+ * nodes that collided once are unlikely to collide again. With N channels
+ * each one carries 1/N of the traffic, and ALOHA collisions drop by the
+ * same factor.
+ *
+ * Frequency registers are computed once, a hop is a single 3 byte burst
+ * to RegFrMsb. The receive window after an uplink stays on its channel,
+ * the gateway answers there. Beacons use channel 0, the home channel.
+ * A relay listens on one channel only, so USE_RELAY excludes the plan.
+ *
+ * The gateway has to listen on all channels at once: a multi-channel
+ * concentrator, or one receiver per channel.
+ */
+
+#ifndef __CHANNEL_H__
+#define __CHANNEL_H__
+
+#include <stdint.h>
+#include "SX1278.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Compute frequency registers of the plan
+ */
+void channel_init(void);
+
+/**
+ * \brief Move to the channel of a frame
+ *
+ * \param[in]  module	Radio in sleep or standby mode
+ * \param[in]  msg_id	Message counter
+ *
+ * \return     Channel index
+ */
+uint8_t channel_hop(SX1278_t * module, uint32_t msg_id);
+
+/**
+ * \brief Move to the home channel
+ *
+ * \param[in]  module	Radio in sleep or standby mode
+ */
+void channel_home(SX1278_t * module);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
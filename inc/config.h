@@ -0,0 +1,105 @@
+/**
+ * Remote configuration for LoggerSoft
+ *
+ * Radio settings and the base period can be changed by a
+ * DOWNLINK_TYPE_CONFIG frame. Values are checked, stored in the internal
+ * flash page at CONFIG_FLASH_BASE and picked up by the main loop on its
+ * next cycle through config.changed, without a reset.
+ *
+ * New settings are on trial until the gateway answers an uplink sent
+ * with them, only then they are written to flash. A node that is not
+ * heard any more on the new settings goes back to the previous ones
+ * after CONFIG_TRIAL_UPLINKS uplinks, a reset on trial loads the stored
+ * record, so settings that lose the link never outlive the trial.
+ *
+ * Records are
+ * appended to the page and it is erased only when full, so one page
+ * takes CONFIG_FLASH_RECORDS changes per erase cycle.
+ *
+ * Internal flash above the application:
+ *   0x0800F800  configuration page, CONFIG_FLASH_BASE
+ *   0x0800FC00  page with logger_id and magic_signature
+ */
+
+#ifndef __CONFIG_H__
+#define __CONFIG_H__
+
+#include <stdint.h>
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONFIG_FLASH_BASE		0x0800F800UL
+#define CONFIG_FLASH_PAGE_SIZE	0x400UL
+#define CONFIG_MAGIC			0x31474643UL	// "CFG1"
+#define CONFIG_TRIAL_UPLINKS	3				// uplinks without answer before reverting
+
+typedef struct __attribute__((packed)) {
+	uint32_t magic;				// CONFIG_MAGIC
+	config_values_t values;
+	uint8_t sequence;			// incremented by every record
+	uint16_t reserved;			// 0xFFFF
+	uint32_t crc;				// crc32 of the fields above
+} config_record_t;
+
+#define CONFIG_FLASH_RECORDS	(CONFIG_FLASH_PAGE_SIZE / sizeof(config_record_t))
+
+typedef struct {
+	config_values_t values;		// settings of the next cycle
+	uint8_t sequence;			// of the stored record
+	uint8_t changed;			// values changed, main loop has to apply them
+	uint8_t report;				// send config_report_t
+	uint8_t result;				// CONFIG_RESULT_* of the last downlink
+	config_values_t previous;	// settings to return to while on trial
+	uint8_t trial;				// uplinks left to hear an answer, 0 if confirmed
+} config_t;
+
+extern config_t config;
+
+/**
+ * \brief Load stored settings
+ *
+ * Falls back to LORA_* and SLEEP_MINUTES from main.h if nothing valid
+ * is stored. Sets config.changed.
+ */
+void config_init(void);
+
+/**
+ * \brief Handle DOWNLINK_TYPE_CONFIG
+ *
+ * \param[in]  payload	Frame without downlink_header_t
+ * \param[in]  length	Payload length
+ * \param[in]  broadcast	Frame was sent to DOWNLINK_BROADCAST
+ */
+void config_downlink(const uint8_t * payload, uint8_t length, uint8_t broadcast);
+
+/**
+ * \brief Gateway answered, settings on trial are confirmed and stored
+ *
+ * Call for every downlink addressed to the node.
+ */
+void config_heard(void);
+
+/**
+ * \brief Count an uplink, revert settings on trial after the last one
+ *
+ * Call once per uplink cycle, before the main loop checks config.changed.
+ */
+void config_uplink(void);
+
+/**
+ * \brief Get pending report
+ *
+ * \param[out] report	Report to send
+ *
+ * \return     1 if a report is pending, 0 otherwise
+ */
+uint8_t config_report(config_report_t * report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
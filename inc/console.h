@@ -0,0 +1,121 @@
+/**
+ * USART1 command console for LoggerSoft
+ *
+ * RX runs on DMA channel 4 in circular mode into console.rx, the USART
+ * idle-line interrupt marks that input arrived. Output is queued into a
+ * ring buffer drained by DMA channel 3, a full ring drops output instead
+ * of waiting. Nothing here blocks, lines are parsed by console_poll()
+ * during normal wake-ups, so a connected terminal does not keep the node
+ * awake any longer.
+ *
+ * Commands (one per line):
+ *   help
+ *   status
+ *   log <index> [count]			needs USE_FLASH_LOG
+ *   sched <task> <seconds>		task: battery, sensor, flush, uplink, diag, beacon
+ *   radio power <0..3>			SX1278_POWER_*
+ *   radio sf <7..12>
+ *   bench
+ */
+
+#ifndef __CONSOLE_H__
+#define __CONSOLE_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CONSOLE_RX_SIZE		64
+#define CONSOLE_TX_SIZE		512
+#define CONSOLE_LINE_SIZE	48
+#define CONSOLE_MAX_ARGS	4
+
+typedef struct {
+	uint8_t rx[CONSOLE_RX_SIZE];		// DMA circular buffer
+	uint16_t rx_tail;					// next byte to parse
+	volatile uint8_t rx_pending;		// idle line seen since last poll
+	char line[CONSOLE_LINE_SIZE];
+	uint8_t line_length;
+	uint8_t tx[CONSOLE_TX_SIZE];
+	volatile uint16_t tx_head;			// next byte to queue
+	volatile uint16_t tx_tail;			// next byte to send
+	volatile uint16_t tx_busy;			// length of running DMA transfer, 0 if idle
+	uint32_t tx_dropped;				// bytes lost on full ring
+} console_t;
+
+extern console_t console;
+
+/**
+ * \brief Start console
+ *
+ * Has to be called after msd_usart1_init(), also after every re-init.
+ * Queued output is kept and sent on.
+ */
+void console_resume(void);
+
+/**
+ * \brief Stop DMA before USART1 and DMA are de-initialized
+ *
+ * Does not wait for output, unsent bytes stay queued for console_resume().
+ */
+void console_suspend(void);
+
+/**
+ * \brief Parse and run received lines
+ *
+ * Call from main loop, returns at once if nothing arrived.
+ */
+void console_poll(void);
+
+/**
+ * \brief Queue output
+ *
+ * \param[in]  data		Bytes to send
+ * \param[in]  length	Number of bytes
+ */
+void console_write(const char * data, uint16_t length);
+
+/**
+ * \brief Queue zero-terminated string
+ *
+ * \param[in]  str		String to send
+ */
+void console_print(const char * str);
+
+/**
+ * \brief Queue unsigned decimal, see fmt_uint()
+ */
+void console_put_uint(uint32_t value);
+
+/**
+ * \brief Queue signed decimal, see fmt_int()
+ */
+void console_put_int(int32_t value);
+
+/**
+ * \brief Queue hexadecimal, see fmt_hex()
+ */
+void console_put_hex(uint32_t value, uint8_t digits);
+
+/**
+ * \brief Queue fixed-point decimal, see fmt_fixed()
+ */
+void console_put_fixed(int32_t value, uint8_t decimals);
+
+/**
+ * \brief USART1 interrupt, call from USART1_IRQHandler
+ */
+void console_irq(void);
+
+/**
+ * \brief DMA TX interrupt, call from DMA_Channel3_4_IRQHandler
+ */
+void console_dma_irq(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * Post-mortem log and watchdog for LoggerSoft
+ *
+ * A node that stops reporting may sit in one of the spin loops (clock
+ * setup, flash busy, radio mode change), have faulted or have browned
+ * out during TX. crashlog keeps a small record in the RTC backup
+ * registers, which survive every reset and deep sleep:
+ *
+ *   RTC_BKP0  CRASHLOG_MAGIC, phase, last battery voltage [mV]
+ *   RTC_BKP1  faulting PC
+ *   RTC_BKP2  its LR
+ *   RTC_BKP3  fault flag, resets since the RTC domain powered up
+ *
+ * The main loop marks the phase it enters with crashlog_phase(), one
+ * register write. FWDGT, started by crashlog_init() and fed by
+ * crashlog_feed(), resets a hung node after CRASHLOG_WDT_S at most; the
+ * HardFault handler stores PC and LR of the fault and resets at once.
+ * After the reset crashlog_init() combines the record with the reset
+ * cause into crash_report_t for the first uplink.
+ *
+ * FWDGT runs on IRC40K and keeps counting in deep sleep, so sleep is cut
+ * into slices of CRASHLOG_SLEEP_MAX_S with a feed in between.
+ */
+
+#ifndef __CRASHLOG_H__
+#define __CRASHLOG_H__
+
+#include <stdint.h>
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CRASHLOG_MAGIC			0xC5
+
+typedef struct {
+	crash_report_t report;	// previous run
+	uint8_t pending;		// report not sent yet
+} crashlog_t;
+
+extern crashlog_t crashlog;
+
+/**
+ * \brief Read the record of the previous run and start the watchdog
+ *
+ * Call at the start of main(), before anything that may hang.
+ */
+void crashlog_init(void);
+
+/**
+ * \brief Mark what the node is doing
+ *
+ * \param[in]  phase	CRASH_PHASE_*
+ *
+ * \return     Phase before, to restore
+ */
+uint8_t crashlog_phase(uint8_t phase);
+
+/**
+ * \brief Keep the battery voltage for the record
+ *
+ * \param[in]  voltage	Battery at rest [mV]
+ */
+void crashlog_voltage(uint16_t voltage);
+
+/**
+ * \brief Reload the watchdog
+ */
+void crashlog_feed(void);
+
+/**
+ * \brief Store the fault and reset, called by HardFault_Handler
+ *
+ * \param[in]  frame	Exception stack frame, r0-r3, r12, lr, pc, xpsr
+ */
+void crashlog_fault(const uint32_t * frame);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
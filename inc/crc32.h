@@ -0,0 +1,32 @@
+/**
+ * CRC-32 (IEEE 802.3, reflected, poly 0xEDB88320) for LoggerSoft
+ *
+ * Bitwise implementation without table, shared by firmware, bootloader
+ * and host tools. Same result as zlib crc32().
+ */
+
+#ifndef __CRC32_H__
+#define __CRC32_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Update CRC
+ *
+ * \param[in]  crc		CRC of previous data, 0 to start
+ * \param[in]  data		Data
+ * \param[in]  length	Number of bytes
+ *
+ * \return     CRC of previous data followed by data
+ */
+uint32_t crc32_update(uint32_t crc, const uint8_t * data, uint32_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,51 @@
+/**
+ * Send-on-delta reporting for LoggerSoft
+ *
+ * A sample is sent only if one of its channels moved by more than its
+ * dead-band (DELTA_* defines in main.h) from the last sent sample, or
+ * DELTA_HEARTBEAT samples were suppressed in a row. The gateway holds the
+ * last received value over the gap shown by packet_sample_t.seq, so the
+ * reconstructed series never deviates by more than the dead-band.
+ */
+
+#ifndef __DELTA_H__
+#define __DELTA_H__
+
+#include <stdint.h>
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	packet_sample_t last;	// last sample passed to uplink
+	uint8_t has_last;		// last is valid
+	uint8_t suppressed;		// samples suppressed since last
+	uint32_t sampled;		// samples checked since power-up
+	uint32_t sent;			// samples passed since power-up
+} delta_t;
+
+extern delta_t delta;
+
+/**
+ * \brief Check sample against dead-band
+ *
+ * \param[in]  sample	New sample
+ *
+ * \return     1 if sample has to be sent, 0 if it is suppressed
+ */
+uint8_t delta_check(const packet_sample_t * sample);
+
+/**
+ * \brief Suppression ratio
+ *
+ * \return     Suppressed samples per 1000 samples since power-up
+ */
+uint16_t delta_suppression_permille(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,74 @@
+/**
+ * Uplink erasure coding for LoggerSoft
+ *
+ * Instead of sending every frame twice, the node sends FEC_PARITY parity
+ * frames after every FEC_GROUP data frames, see fec_parity_t. The gateway
+ * rebuilds up to FEC_PARITY lost frames of a group from the others, for
+ * FEC_PARITY / FEC_GROUP extra airtime where duplication costs 100 %.
+ *
+ * Parity is accumulated as the data frames go out, no frame is kept. A
+ * group is lost on reset, and a frame that failed to go out at all is
+ * not part of one.
+ */
+
+#ifndef __FEC_H__
+#define __FEC_H__
+
+#include <stdint.h>
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// data frames are sample or statistics frames, never larger than this
+#define FEC_SIZE	PACKET_SAMPLES_SIZE
+
+typedef struct {
+	uint8_t parity[FEC_PARITY][FEC_SIZE];
+	uint32_t msg_id[FEC_GROUP];
+	uint8_t length[FEC_GROUP];
+	uint8_t count;			// data frames in the group so far
+	uint8_t size;			// longest of them
+	uint32_t groups;		// groups completed since power-up
+} fec_t;
+
+extern fec_t fec;
+
+/**
+ * \brief Add a data frame that went out
+ *
+ * \param[in]  frame	Frame bytes
+ * \param[in]  length	Frame length, no more than FEC_SIZE
+ * \param[in]  msg_id	Its message counter
+ */
+void fec_add(const uint8_t * frame, uint8_t length, uint32_t msg_id);
+
+/**
+ * \brief Check whether the group is complete
+ *
+ * \return     1 if the parity frames are due
+ */
+uint8_t fec_ready(void);
+
+/**
+ * \brief Build parity frame
+ *
+ * \param[out] buf		Destination, at least PACKET_MAX_SIZE bytes
+ * \param[in]  msg_id	Message counter
+ * \param[in]  index	FEC_INDEX_*, less than FEC_PARITY
+ *
+ * \return     Frame length in bytes
+ */
+uint8_t fec_build(uint8_t * buf, uint32_t msg_id, uint8_t index);
+
+/**
+ * \brief Start the next group
+ */
+void fec_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,86 @@
+/**
+ * Sample log in external W25Q flash for LoggerSoft
+ *
+ * Records are buffered in RAM and written back by flashlog_flush() on the
+ * scheduler's log flush cadence, so the flash is woken once per batch
+ * instead of once per sample. The log is a ring over FLASHLOG_SECTORS
+ * sectors starting at FLASHLOG_BASE: when the head enters a sector, the
+ * sector is erased and its oldest records are lost. Every record carries
+ * a monotonic index, erased flash (index 0xFFFFFFFF) marks free space.
+ */
+
+#ifndef __FLASHLOG_H__
+#define __FLASHLOG_H__
+
+#include <stdint.h>
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FLASHLOG_INDEX_EMPTY	0xFFFFFFFFUL
+
+typedef struct __attribute__((packed)) {
+	uint32_t index;			// record number since log creation
+	uint32_t time;			// sample time, Unix time once time sync ran, uptime before
+	packet_values_t values;
+} flashlog_record_t;
+
+#define FLASHLOG_RECORDS_PER_SECTOR	(EXT_FLASH_SECTOR_SIZE / sizeof(flashlog_record_t))
+#define FLASHLOG_CAPACITY			(FLASHLOG_SECTORS * FLASHLOG_RECORDS_PER_SECTOR)
+
+typedef struct {
+	uint32_t head;			// index of next record to write
+	uint32_t tail;			// index of oldest record still in flash
+	flashlog_record_t buffer[FLASHLOG_BUFFER];
+	uint8_t pending;		// records in buffer
+	uint8_t ready;			// flash found and log recovered
+} flashlog_t;
+
+extern flashlog_t flashlog;
+
+/**
+ * \brief Recover log state from flash
+ *
+ * Flash SPI bus has to be started.
+ *
+ * \return     1 if flash is available, 0 otherwise
+ */
+uint8_t flashlog_init(void);
+
+/**
+ * \brief Buffer sample record
+ *
+ * When the buffer is full the oldest buffered record is dropped, call
+ * flashlog_flush() once flashlog.pending reaches FLASHLOG_BUFFER.
+ *
+ * \param[in]  time		Sample time
+ * \param[in]  sample	Sample record
+ */
+void flashlog_append(uint32_t time, const packet_sample_t * sample);
+
+/**
+ * \brief Write buffered records to flash
+ *
+ * Flash SPI bus has to be started. Flash is powered down on return.
+ */
+void flashlog_flush(void);
+
+/**
+ * \brief Read record from flash
+ *
+ * Flash SPI bus has to be started.
+ *
+ * \param[in]  index	Record index in [flashlog.tail, flashlog.head)
+ * \param[out] record	Record
+ *
+ * \return     1 if record was read, 0 if index is not in flash
+ */
+uint8_t flashlog_read(uint32_t index, flashlog_record_t * record);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
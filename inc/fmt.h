@@ -0,0 +1,86 @@
+/**
+ * Integer formatter for LoggerSoft
+ *
+ * Replaces sprintf for status and console lines. Every function writes
+ * at dst, terminates the string and returns a pointer to the terminator,
+ * so calls chain:
+ *
+ *   p = fmt_str(buf, "T: ");
+ *   p = fmt_fixed(p, 2137, 2);	// "T: 21.37"
+ *
+ * dst must have room for the longest result, FMT_*_SIZE bytes.
+ */
+
+#ifndef __FMT_H__
+#define __FMT_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define FMT_UINT_SIZE		11	// "4294967295"
+#define FMT_INT_SIZE		12	// "-2147483648"
+#define FMT_HEX_SIZE		9	// "FFFFFFFF"
+#define FMT_FIXED_SIZE		13	// "-21474836.48"
+
+/**
+ * \brief Copy string
+ *
+ * \param[out] dst		Destination
+ * \param[in]  src		Zero-terminated string
+ *
+ * \return     Pointer to terminator in dst
+ */
+char * fmt_str(char * dst, const char * src);
+
+/**
+ * \brief Unsigned decimal
+ *
+ * \param[out] dst		Destination
+ * \param[in]  value	Value
+ *
+ * \return     Pointer to terminator in dst
+ */
+char * fmt_uint(char * dst, uint32_t value);
+
+/**
+ * \brief Signed decimal
+ *
+ * \param[out] dst		Destination
+ * \param[in]  value	Value
+ *
+ * \return     Pointer to terminator in dst
+ */
+char * fmt_int(char * dst, int32_t value);
+
+/**
+ * \brief Upper case hexadecimal
+ *
+ * \param[out] dst		Destination
+ * \param[in]  value	Value
+ * \param[in]  digits	Minimal number of digits, zero padded, up to 8
+ *
+ * \return     Pointer to terminator in dst
+ */
+char * fmt_hex(char * dst, uint32_t value, uint8_t digits);
+
+/**
+ * \brief Signed fixed-point decimal
+ *
+ * fmt_fixed(dst, -5, 2) gives "-0.05".
+ *
+ * \param[out] dst		Destination
+ * \param[in]  value	Value in units of 10^-decimals
+ * \param[in]  decimals	Digits after decimal point, up to 9
+ *
+ * \return     Pointer to terminator in dst
+ */
+char * fmt_fixed(char * dst, int32_t value, uint8_t decimals);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
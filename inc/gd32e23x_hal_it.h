@@ -52,6 +52,9 @@ void USART1_IRQHandler(void);
 
 /* user code [global 1] begin */
 void RTC_IRQHandler(void);
+void EXTI4_15_IRQHandler(void);
+void DMA_Channel1_2_IRQHandler(void);
+void DMA_Channel3_4_IRQHandler(void);
 /* user code [global 1] end */
 
 #endif/*GD32E23X_HAL_IT_H*/
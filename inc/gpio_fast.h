@@ -0,0 +1,68 @@
+/**
+ * Register-level GPIO access for LoggerSoft
+ *
+ * Chip selects, resets and DIO lines of the drivers. With the port and
+ * pin given as the SX_* / FLASH_* / BME_* constants of main.h every call
+ * compiles to a single store to BOP or BC, or a load of ISTAT, without
+ * the HAL call and its SET / RESET branch.
+ */
+
+#ifndef __GPIO_FAST_H__
+#define __GPIO_FAST_H__
+
+#include <stdint.h>
+#include "gd32e23x_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief Drive pins high
+ *
+ * \param[in]  port	GPIOx
+ * \param[in]  pin	GPIO_PIN_x, may be several
+ */
+static inline void gpio_fast_high(uint32_t port, uint32_t pin) {
+	GPIO_BOP(port) = pin;
+}
+
+/**
+ * \brief Drive pins low
+ *
+ * \param[in]  port	GPIOx
+ * \param[in]  pin	GPIO_PIN_x, may be several
+ */
+static inline void gpio_fast_low(uint32_t port, uint32_t pin) {
+	GPIO_BC(port) = pin;
+}
+
+/**
+ * \brief Read input pin
+ *
+ * \param[in]  port	GPIOx
+ * \param[in]  pin	GPIO_PIN_x
+ *
+ * \return     1 if high, 0 if low
+ */
+static inline uint8_t gpio_fast_read(uint32_t port, uint32_t pin) {
+	return (GPIO_ISTAT(port) & pin) != 0;
+}
+
+/**
+ * \brief Read back the driven level of an output pin
+ *
+ * \param[in]  port	GPIOx
+ * \param[in]  pin	GPIO_PIN_x
+ *
+ * \return     1 if driven high, 0 if low
+ */
+static inline uint8_t gpio_fast_driven(uint32_t port, uint32_t pin) {
+	return (GPIO_OCTL(port) & pin) != 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,25 +4,143 @@
 /*
  * MAGIC_SIGNATURE - used for validation in auto firmware flasher (stored in 0x800FFFC, last 32bit of internal flash)
  * LOGGER_ID - value stored in 0x800FFF8
- * SLEEP_MINUTES - integer value in [1...60] including both bounds
+ * SLEEP_MINUTES - base sample period, integer value in [1...60] including both bounds
  */
 #define MAGIC_SIGNATURE 0xDEADBEEF
 #define LOGGER_ID 0xFFFFFFFF
 #define SLEEP_MINUTES 15
 #define PACKET_DUPLICATION_COUNT 1
 
+/*
+ * Scheduler task periods in seconds, less than one day, 0 disables the task
+ * SCHED_COALESCE_S - tasks due this close to a wake-up are run in it
+ * SCHED_MIN_SLEEP_S - shorter waits are not worth an RTC alarm
+ */
+#define SCHED_BATTERY_PERIOD_S (SLEEP_MINUTES * 60UL)
+#define SCHED_SENSOR_PERIOD_S (SLEEP_MINUTES * 60UL)
+#define SCHED_LOG_FLUSH_PERIOD_S (60UL * 60UL)
+#define SCHED_UPLINK_PERIOD_S (SLEEP_MINUTES * 60UL)
+#define SCHED_DIAG_PERIOD_S (6UL * 60UL * 60UL)
+#define SCHED_BEACON_PERIOD_S 0		// tdma_init() enables it
+#define SCHED_COALESCE_S 30
+#define SCHED_MIN_SLEEP_S 2
+
+// read logger id from flash, value is patched by firmware flasher after build
+#define DEVICE_ID (*((volatile const uint32_t*)0x0800FFF8))
+
+/*
+ * LoRa radio parameters, see SX1278.h for accepted values
+ */
+#define LORA_FREQUENCY 433000000
+#define LORA_POWER SX1278_POWER_20DBM
+#define LORA_SF SX1278_LORA_SF_12
+#define LORA_BW SX1278_LORA_BW_125KHZ
+#define LORA_CR SX1278_LORA_CR_4_8
+// TxDone wait, a full backfill frame (175 bytes) at SF12 takes 8.5 s on air, LDRO is off
+#define LORA_TX_TIMEOUT_MS 12000
+/*
+ * LORA_PREAMBLE - preamble symbols, 7..65535, the gateway expects at least
+ *                 as many; a node on a TDMA slot is heard with 7, see
+ *                 SX1278_set_preamble() for the limits at SF6 and 500 kHz
+ * LORA_SYMBOL_TIMEOUT - single RX timeout, LORA_PREAMBLE..1023 symbols
+ * LORA_PREAMBLE_MIN_MS - optional, shortest preamble in time for a receiver
+ *                        that wakes up that often to sniff the channel; the
+ *                        preamble grows at faster SF and BW to last so long
+ */
+#define LORA_PREAMBLE 8
+#define LORA_SYMBOL_TIMEOUT 8
+//#define LORA_PREAMBLE_MIN_MS 1000
+#if (LORA_PREAMBLE < 7) || (LORA_PREAMBLE > 65535)
+#error "LORA_PREAMBLE must be 7..65535"
+#endif
+#if (LORA_SYMBOL_TIMEOUT < 5) || (LORA_SYMBOL_TIMEOUT > 1023)
+#error "LORA_SYMBOL_TIMEOUT must be 5..1023"
+#endif
+#if (LORA_SYMBOL_TIMEOUT < LORA_PREAMBLE) && (LORA_SYMBOL_TIMEOUT != 1023)
+#error "LORA_SYMBOL_TIMEOUT must cover LORA_PREAMBLE"
+#endif
+
 //#define USE_EXTERNAL_LXTAL
+#define USE_RTC_CALIBRATION
 
 //#define USE_BME280_SPI
 #define USE_BME280_I2C
 //#define USE_W25Q_EXT_FLASH
+//#define USE_FLASH_LOG
 #define USE_RA_01_SENDER
+#define USE_BATTERY_MONITOR
+#define USE_BATTERY_POLICY
+#define USE_SEND_ON_DELTA
+//#define USE_AGGREGATION
+//#define USE_OTA
+//#define USE_REMOTE_CONFIG
+//#define USE_ADR
+//#define USE_TDMA
+#define USE_TIMESTAMPS
+//#define USE_TIME_SYNC
+//#define USE_BACKFILL
+//#define USE_RELAY
+//#define USE_CHANNEL_PLAN
+//#define USE_UPLINK_FEC
+//#define USE_FHSS
+//#define USE_IMPLICIT_HEADER
+//#define USE_SPI_BUS
+#define USE_CONSOLE
+#define USE_MEM_STATS
+//#define USE_CRASH_LOG
 #define USE_MCU_DEEPSLEEP_MODE
 #define DEINIT_ALL_PERIPH_DURING_MCU_SLEEP
 #define USE_TEST_PACKET_SPAMMING
 
 #include <stdint.h>
-#include <stdio.h>
+
+#include "fmt.h"
+#include "sched.h"
+
+extern uint8_t sleep_minutes;	// base period, SLEEP_MINUTES at power-up
+
+#ifdef USE_CONSOLE
+#include "console.h"
+#endif // USE_CONSOLE
+
+#ifdef USE_MEM_STATS
+#include "memstat.h"
+#endif // USE_MEM_STATS
+
+#ifdef USE_CRASH_LOG
+#include "crashlog.h"
+/*
+ * CRASHLOG_WDT_PSC, CRASHLOG_WDT_RELOAD - FWDGT timeout, 256 * 4096 IRC40K
+ *     clocks are 26 s at 40 kHz and 17 s at 60 kHz, the IRC40K limit
+ * CRASHLOG_SLEEP_MAX_S - deep sleep slice between feeds, below the timeout
+ */
+#define CRASHLOG_WDT_PSC FWDGT_PSC_DIV256
+#define CRASHLOG_WDT_RELOAD 0x0FFF
+#define CRASHLOG_SLEEP_MAX_S 12
+#if LORA_TX_TIMEOUT_MS >= 17000
+#error "a frame fed at its start has to end within the shortest FWDGT timeout"
+#endif
+#endif // USE_CRASH_LOG
+
+#ifdef USE_RTC_CALIBRATION
+#ifdef USE_EXTERNAL_LXTAL
+#error "USE_RTC_CALIBRATION is for the IRC40K RTC clock"
+#endif
+#include "rtccal.h"
+/*
+ * RTCCAL_REF_HZ - system clock TIMER13 counts with, IRC8M
+ * RTCCAL_CAPTURES - captures of 8 RTCCLK edges per measurement, 256 take 50 ms
+ * RTCCAL_MIN_HZ/RTCCAL_MAX_HZ - plausible IRC40K range
+ * RTCCAL_TEMP_STEP - temperature change [degC] that triggers recalibration
+ * RTCCAL_PERIOD_S - recalibration period at steady temperature
+ */
+#define RTCCAL_REF_HZ 8000000UL
+#define RTCCAL_CAPTURES 256
+#define RTCCAL_MIN_HZ 20000UL
+#define RTCCAL_MAX_HZ 60000UL
+#define RTCCAL_TEMP_STEP 2.0f
+#define RTCCAL_PERIOD_S (6UL * 60UL * 60UL)
+#endif // USE_RTC_CALIBRATION
 
 #ifdef USE_BME280_SPI
 #include "bme280.h"
@@ -31,6 +149,37 @@
 #include "bmp280.h"
 #endif // USE_BME280_I2C
 
+#ifdef USE_BATTERY_MONITOR
+#include "battery.h"
+
+// delay after TX start before battery_sample_load(), lets PA current settle
+#define BATTERY_LOAD_SAMPLE_DELAY_MS 20
+#endif // USE_BATTERY_MONITOR
+
+#if defined(USE_BATTERY_POLICY) && !defined(USE_BATTERY_MONITOR)
+#error "USE_BATTERY_POLICY needs USE_BATTERY_MONITOR"
+#endif
+
+#ifdef USE_BATTERY_POLICY
+#include "policy.h"
+
+/*
+ * Policy profiles, from full service to store-only:
+ * { enter_mv, interval_mul, batch, power, LoRa_SF, min_margin_db, store_only }
+ * enter_mv - profile is used when projected battery voltage is below it
+ * power/LoRa_SF - used instead of LORA_POWER/LORA_SF only if link margin >= min_margin_db
+ */
+#define POLICY_PROFILE_NORMAL		{ 0xFFFF, 1, 1, SX1278_POWER_20DBM, SX1278_LORA_SF_12, 0, 0 }
+#define POLICY_PROFILE_SAVER		{ 3600, 2, 2, SX1278_POWER_17DBM, SX1278_LORA_SF_11, 6, 0 }
+#define POLICY_PROFILE_LOW			{ 3450, 4, 4, SX1278_POWER_14DBM, SX1278_LORA_SF_10, 10, 0 }
+#define POLICY_PROFILE_STORE_ONLY	{ 3300, 4, 8, SX1278_POWER_14DBM, SX1278_LORA_SF_10, 10, 1 }
+
+// headroom over threshold needed to return to a better profile [mV]
+#define POLICY_HYSTERESIS_MV 50
+// how many samples ahead the trend is projected
+#define POLICY_TREND_LOOKAHEAD 96
+#endif // USE_BATTERY_POLICY
+
 #ifdef USE_W25Q_EXT_FLASH
 
 #include "z_flash_W25QXXX.h"
@@ -40,9 +189,278 @@
 
 #endif // USE_W25Q_EXT_FLASH
 
+#ifdef USE_SPI_BUS
+/*
+ * BME280 and W25Q transfers go through the bus manager of their SPI.
+ * SPIBUS0_DMA - SPI0 on DMA channels 1 and 2
+ * SPIBUS1_DMA - SPI1 on DMA channels 3 and 4, these belong to the console
+ *               and the FHSS interrupt needs the bus idle, see spibus.h
+ */
+#include "spibus.h"
+#define SPIBUS0_DMA 1
+#if defined(USE_CONSOLE) || defined(USE_FHSS)
+#define SPIBUS1_DMA 0
+#else
+#define SPIBUS1_DMA 1
+#endif
+#endif // USE_SPI_BUS
+
+#if defined(USE_FLASH_LOG) && !(defined(USE_W25Q_EXT_FLASH) && defined(USE_RA_01_SENDER))
+#error "USE_FLASH_LOG needs USE_W25Q_EXT_FLASH and USE_RA_01_SENDER"
+#endif
+
+#ifdef USE_FLASH_LOG
+/*
+ * FLASHLOG_BASE - start of log area in W25Q, sector aligned
+ * FLASHLOG_SECTORS - log area size in 4 kB sectors, 256 records each
+ * FLASHLOG_BUFFER - records buffered in RAM between flushes
+ */
+#define FLASHLOG_BASE 0x000000
+#define FLASHLOG_SECTORS 128
+#define FLASHLOG_BUFFER 16
+
+#include "flashlog.h"
+#endif // USE_FLASH_LOG
+
 #ifdef USE_RA_01_SENDER
 
 #include "SX1278.h"
+#include "packet.h"
+
+#ifdef USE_SEND_ON_DELTA
+#include "delta.h"
+
+/*
+ * Dead-bands in packet_sample_t units, a sample is sent when any channel
+ * moved more than this from the last sent sample
+ * DELTA_HEARTBEAT - max number of suppressed samples in a row
+ */
+#define DELTA_TEMPERATURE 20	// 0.2 C
+#define DELTA_HUMIDITY 100		// 1 %RH
+#define DELTA_PRESSURE 5		// 0.5 hPa
+#define DELTA_VOLTAGE 20		// 20 mV
+#define DELTA_HEARTBEAT 8
+#endif // USE_SEND_ON_DELTA
+
+#ifdef USE_AGGREGATION
+#ifdef USE_SEND_ON_DELTA
+#error "USE_AGGREGATION and USE_SEND_ON_DELTA are alternative reporting modes"
+#endif
+#include "aggregate.h"
+
+/*
+ * A packet_stats_t record covers one uplink window, e.g. SCHED_SENSOR_PERIOD_S 60
+ * and SCHED_UPLINK_PERIOD_S 3600 give one record of 60 samples per hour
+ * AGGREGATE_WINDOW - max samples per record, integer value in [1...255]
+ */
+#define AGGREGATE_WINDOW 60
+#endif // USE_AGGREGATION
+
+#ifdef USE_OTA
+#ifndef USE_W25Q_EXT_FLASH
+#error "USE_OTA needs USE_W25Q_EXT_FLASH"
+#endif
+/*
+ * Application has to be linked with ldscripts/gd32e23x_flash_ota.ld, its
+ * __ota_app symbol is missing from any other script and fails the link,
+ * and the bootloader from boot/ flashed at 0x08000000.
+ */
+#include "ota.h"
+#if defined(USE_FLASH_LOG) && (FLASHLOG_BASE + FLASHLOG_SECTORS * 0x1000UL > OTA_W25Q_DELTA)
+#error "Flash log overlaps OTA area"
+#endif
+#define USE_DOWNLINK
+#endif // USE_OTA
+
+#ifdef USE_REMOTE_CONFIG
+#include "config.h"
+#define USE_DOWNLINK
+#endif // USE_REMOTE_CONFIG
+
+#ifdef USE_ADR
+#include "adr.h"
+/*
+ * ADR_ACK_LIMIT - missed ACKs in a row before stepping up power, then SF
+ * ADR_MIN_SF - fastest spreading factor taken from the gateway
+ */
+#define ADR_ACK_LIMIT 3
+#define ADR_MIN_SF SX1278_LORA_SF_7
+#define USE_DOWNLINK
+#endif // USE_ADR
+
+#ifdef USE_TDMA
+#include "tdma.h"
+/*
+ * TDMA_PERIOD_S - beacon period of the gateway, divides one day and the uplink period
+ * TDMA_BEACON_SF - spreading factor of the beacons
+ * TDMA_BEACON_AIR_MS - beacon time on air, the window stays open this long past the beacon time
+ * TDMA_GUARD_MIN_MS - beacon window margin on top of the clock uncertainty
+ * TDMA_DRIFT_INIT_PPM - clock uncertainty before the drift is learned
+ * TDMA_MAX_MISSED - beacons missed in a row before the sync is dropped
+ * TDMA_RESCAN_S - wait after a scan without beacon
+ */
+#define TDMA_PERIOD_S 900
+#define TDMA_BEACON_SF SX1278_LORA_SF_12
+#define TDMA_BEACON_AIR_MS 2500
+#define TDMA_GUARD_MIN_MS 20
+#if defined(USE_EXTERNAL_LXTAL)
+#define TDMA_DRIFT_INIT_PPM 200
+#elif defined(USE_RTC_CALIBRATION)
+// calibrated against IRC8M, good to its accuracy
+#define TDMA_DRIFT_INIT_PPM 30000
+#else
+// RTC prescaler is set for 32768 Hz, IRC40K runs it up to about 25 % off
+#define TDMA_DRIFT_INIT_PPM 250000
+#endif // USE_EXTERNAL_LXTAL
+#define TDMA_MAX_MISSED 4
+#define TDMA_RESCAN_S (6UL * 60UL * 60UL)
+#if (SCHED_SECONDS_PER_DAY % TDMA_PERIOD_S) || (SCHED_UPLINK_PERIOD_S % TDMA_PERIOD_S)
+#error "TDMA_PERIOD_S must divide one day and SCHED_UPLINK_PERIOD_S"
+#endif
+#define USE_DOWNLINK
+#endif // USE_TDMA
+
+#ifdef USE_TIME_SYNC
+#include "timesync.h"
+// RTC error tolerated before it is stepped to the gateway time
+#define TIME_SYNC_MAX_ERROR_MS 500
+#define USE_DOWNLINK
+#endif // USE_TIME_SYNC
+
+#ifdef USE_BACKFILL
+#ifndef USE_FLASH_LOG
+#error "USE_BACKFILL needs USE_FLASH_LOG"
+#endif
+#include "backfill.h"
+/*
+ * BACKFILL_MAX_RECORDS - log records per frame, no more than PACKET_MAX_BACKFILL
+ * BACKFILL_MAX_FRAMES - frames per wake-up, with USE_TDMA fewer once the own slot ends
+ * BACKFILL_DUTY_PERMILLE - time on air budget of backfill frames
+ * BACKFILL_CREDIT_MAX_MS - budget saved up while there is nothing to send
+ * BACKFILL_NEWEST_FIRST - drain the backlog from its newest end
+ */
+#define BACKFILL_MAX_RECORDS 16
+#define BACKFILL_MAX_FRAMES 4
+#define BACKFILL_DUTY_PERMILLE 5
+#define BACKFILL_CREDIT_MAX_MS 60000
+//#define BACKFILL_NEWEST_FIRST
+#define USE_DOWNLINK
+#endif // USE_BACKFILL
+
+#ifdef USE_RELAY
+/*
+ * RELAY_NODES - device IDs of the downstream nodes
+ * RELAY_RX_SF - spreading factor they send with
+ * RELAY_QUEUE_SIZE - bytes of queued frames, the oldest are dropped when full
+ * RELAY_FRAME_MAX - forwarding frame size, a full one takes about 11 s at SF12
+ * RELAY_BATCH_BYTES - queued bytes that start forwarding
+ * RELAY_MAX_DELAY_S - longest wait of a frame for the batch to fill
+ * RELAY_MAX_FRAMES - forwarding frames per wake-up
+ * RELAY_ACK - acknowledge downstream frames
+ * RELAY_RX_MA, RELAY_TX_MA - radio supply current for the charge estimate
+ */
+#define RELAY_NODES { 0x00000001UL }
+#define RELAY_RX_SF SX1278_LORA_SF_12
+#define RELAY_QUEUE_SIZE 1024
+#define RELAY_FRAME_MAX 200
+#define RELAY_BATCH_BYTES 150
+#define RELAY_MAX_DELAY_S (SLEEP_MINUTES * 60UL)
+#define RELAY_MAX_FRAMES 4
+#define RELAY_ACK
+#define RELAY_RX_MA 12
+#define RELAY_TX_MA 120
+#include "relay.h"
+#define USE_DOWNLINK
+#endif // USE_RELAY
+
+#ifdef USE_CHANNEL_PLAN
+#include "channel.h"
+/*
+ * CHANNEL_PLAN - centre frequencies [Hz], the first one is the home channel
+ * 200 kHz apart, 125 kHz bandwidth leaves a guard between neighbours
+ */
+#define CHANNEL_PLAN { LORA_FREQUENCY, 433200000UL, 433400000UL, 433600000UL, \
+		433800000UL, 434000000UL, 434200000UL, 434400000UL }
+#ifdef USE_RELAY
+#error "relay listens on one channel, downstream nodes with USE_CHANNEL_PLAN would send on all"
+#endif
+#endif // USE_CHANNEL_PLAN
+
+#ifdef USE_UPLINK_FEC
+/*
+ * FEC_GROUP - data frames per parity group, up to 10
+ * FEC_PARITY - parity frames per group, 1 (XOR) or 2 (XOR and Reed-Solomon),
+ *              as many lost frames of a group can be rebuilt
+ */
+#define FEC_GROUP 4
+#define FEC_PARITY 1
+#if (FEC_PARITY < 1) || (FEC_PARITY > 2)
+#error "FEC_PARITY must be 1 or 2"
+#endif
+#include "fec.h"
+#endif // USE_UPLINK_FEC
+
+#ifdef USE_FHSS
+/*
+ * FHSS_CHANNELS - hop channels [Hz], frames start on the current channel
+ *                 and move to channel n % count at hop n
+ * FHSS_HOP_SYMBOLS - symbols between hops, 20 is about 650 ms at SF12 125 kHz
+ * FHSS_MIN_SF - slowest data rate that does not hop, faster frames are short
+ *               enough for the dwell time limit
+ * The gateway has to use the same channels and hop period.
+ * DIO1 of the module goes to SX_DIO1_Pin, FhssChangeChannel comes on it.
+ */
+#define FHSS_CHANNELS { 433100000UL, 433300000UL, 433500000UL, 433700000UL, \
+		433900000UL, 434100000UL, 434300000UL, 434500000UL }
+#define FHSS_HOP_SYMBOLS 20
+#define FHSS_MIN_SF SX1278_LORA_SF_11
+#define SX_DIO1_GPIO_Port GPIOA
+#define SX_DIO1_Pin GPIO_PIN_11
+#define SX_DIO1_EXTI EXTI_11
+#define SX_DIO1_EXTI_SOURCE EXTI_SOURCE_PIN11
+#define SX_DIO1_IRQn EXTI4_15_IRQn
+#endif // USE_FHSS
+
+#ifdef USE_IMPLICIT_HEADER
+/*
+ * Uplinks go out without the LoRa header as frames of IMPLICIT_HEADER_LENGTH
+ * bytes, shorter ones zero padded, the header count tells where records
+ * end. Longer frames keep the explicit header. The header is 20 bits,
+ * whole blocks of 4 * SF bits are saved or not, padding may cost more
+ * than that. See SX1278_time_on_air_us().
+ *
+ * A receiver decodes either header mode, not both, so implicit frames
+ * carry IMPLICIT_SYNC_WORD and explicit ones the usual sync word. The
+ * gateway needs two receivers on the uplink channel and data rate:
+ *   explicit header, SX127X_SYNC_WORD_DEFAULT or the remote configured one
+ *   implicit header, IMPLICIT_SYNC_WORD, IMPLICIT_HEADER_LENGTH bytes,
+ *                    LORA_CR, CRC on
+ * each one ignores the frames of the other. Downlinks stay explicit on
+ * the usual sync word.
+ *
+ * IMPLICIT_HEADER_LENGTH - 26 is one timed sample, 11 header + 9 sample
+ *                          + 4 time + 2 delta, frames with status are longer
+ * IMPLICIT_SYNC_WORD - sync word of implicit frames, not the usual one
+ */
+#define IMPLICIT_HEADER_LENGTH 26
+#define IMPLICIT_SYNC_WORD 0x24
+#if (IMPLICIT_SYNC_WORD == SX127X_SYNC_WORD_DEFAULT) || (IMPLICIT_SYNC_WORD == SX127X_SYNC_WORD_LORAWAN)
+#error "IMPLICIT_SYNC_WORD must differ from the sync word of explicit frames"
+#endif
+#if defined(USE_RELAY) || defined(USE_UPLINK_FEC)
+#error "relayed and parity frames need their exact length, use the explicit header"
+#endif
+#endif // USE_IMPLICIT_HEADER
+
+#ifdef USE_DOWNLINK
+/*
+ * DOWNLINK_WINDOW_MS - RX window after an uplink, extended while the
+ *                      modem sees a preamble, up to LORA_TX_TIMEOUT_MS more
+ * DOWNLINK_MAX_FRAMES - frames accepted in one window
+ */
+#define DOWNLINK_WINDOW_MS 500
+#define DOWNLINK_MAX_FRAMES 16
+#endif // USE_DOWNLINK
 
 #define SX_DIO0_GPIO_Port GPIOA
 #define SX_DIO0_Pin GPIO_PIN_10
@@ -56,6 +474,15 @@
 extern SX1278_t SX1278;
 extern SX1278_hw_t SX1278_hw;
 
+extern uint32_t msg_id;
+extern uint8_t samples_count;
+extern uint8_t lora_power;		// base TX power, LORA_POWER at power-up
+extern uint8_t lora_sf;			// base spreading factor, LORA_SF at power-up
+#ifdef USE_IMPLICIT_HEADER
+extern uint32_t implicit_frames;	// uplinks sent without header
+extern int32_t implicit_saved_us;	// time on air saved by them, padding included
+#endif // USE_IMPLICIT_HEADER
+
 #endif // USE_RA_01_SENDER
 
 #ifdef USE_BME280_SPI
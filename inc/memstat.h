@@ -0,0 +1,66 @@
+/**
+ * RAM and flash usage for LoggerSoft
+ *
+ * The 8 kB of RAM hold .data and .bss from address 0 up, the stack of
+ * __stack_size (see ldscripts) at the top and unused RAM in between.
+ * Nothing checks the stack bound on the Cortex-M23, a stack that grows
+ * past it silently runs into the gap and then into .bss.
+ *
+ * memstat_paint() fills everything from the end of .bss up to the stack
+ * pointer with MEMSTAT_PAINT at the start of main(), before any interrupt
+ * is enabled. The deepest stack use since then, interrupts included, is
+ * where the pattern ends, so stack_peak is a high watermark that holds
+ * over sleep cycles. A peak above stack means the stack left its region.
+ *
+ * Section sizes come from the linker symbols, per module sizes from the
+ * map file, see tools/memmap.c.
+ */
+
+#ifndef __MEMSTAT_H__
+#define __MEMSTAT_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MEMSTAT_PAINT			0xA5A5A5A5UL
+#define MEMSTAT_PAINT_MARGIN	16		// bytes below the stack pointer left alone while painting
+
+typedef struct {
+	uint16_t data;			// initialised variables [bytes]
+	uint16_t bss;			// zeroed variables
+	uint16_t gap;			// unused RAM between .bss and the stack region
+	uint16_t stack;			// stack region, __stack_size
+	uint16_t stack_peak;	// deepest stack use since memstat_paint()
+	uint32_t flash;			// image, vectors, code, constants and .data initialisers
+	uint32_t flash_size;	// FLASH region of the linker script
+} memstat_t;
+
+/**
+ * \brief Paint unused RAM below the stack pointer
+ *
+ * Call first in main(), with interrupts not yet enabled.
+ */
+void memstat_paint(void);
+
+/**
+ * \brief Deepest stack use since memstat_paint()
+ *
+ * \return     Bytes below the initial stack pointer
+ */
+uint16_t memstat_stack_peak(void);
+
+/**
+ * \brief Fill usage report
+ *
+ * \param[out] stat	Report to fill
+ */
+void memstat_get(memstat_t * stat);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,95 @@
+/**
+ * Delta firmware update over LoRa for LoggerSoft
+ *
+ * The gateway sends DOWNLINK_TYPE_OTA_START, then delta fragments and
+ * parity fragments in the receive windows after uplinks. Fragments are
+ * staged in W25Q (see ota_boot.h), so reception survives deep sleep but
+ * not a reset. Once every group of OTA_FEC_GROUP fragments has at most
+ * one fragment missing and its parity, the missing ones are restored,
+ * the delta is applied against the running image into OTA_W25Q_IMAGE and
+ * the result is checked against ota_start_t.image_crc. A PENDING boot
+ * record then hands the image to the bootloader.
+ *
+ * All functions use the W25Q, its SPI bus has to be started.
+ */
+
+#ifndef __OTA_H__
+#define __OTA_H__
+
+#include <stdint.h>
+#include "packet.h"
+#include "ota_boot.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTA_MAX_FRAGMENTS	512		// 32 kB of delta
+#define OTA_MAX_GROUPS		((OTA_MAX_FRAGMENTS + OTA_FEC_GROUP - 1) / OTA_FEC_GROUP)
+
+#define OTA_STATE_IDLE			0
+#define OTA_STATE_RECEIVING		1
+#define OTA_STATE_COMPLETE		2	// every fragment received or restorable
+#define OTA_STATE_INSTALLING	3	// image verified, reboot into bootloader
+#define OTA_STATE_CONFIRMED		4	// running image was installed by OTA and works
+#define OTA_STATE_ROLLED_BACK	5	// bootloader restored previous image
+#define OTA_STATE_BAD_BASE		6	// delta was made for another image
+#define OTA_STATE_BAD_DELTA		7	// delta does not decode
+#define OTA_STATE_BAD_IMAGE		8	// image crc mismatch
+
+typedef struct {
+	ota_start_t start;						// current session
+	uint16_t received;						// data fragments received or restored
+	uint8_t state;							// OTA_STATE_*
+	uint8_t trial;							// running image waits for ota_confirm()
+	uint8_t report;							// state changed, send ota_report_t
+	uint8_t fragments[OTA_MAX_FRAGMENTS / 8];	// received data fragments
+	uint8_t parity[(OTA_MAX_GROUPS + 7) / 8];	// received parity fragments
+} ota_t;
+
+extern ota_t ota;
+
+/**
+ * \brief Read boot record
+ *
+ * Finds out whether the running image is on trial or was rolled back.
+ */
+void ota_init(void);
+
+/**
+ * \brief Handle OTA downlink
+ *
+ * \param[in]  type		DOWNLINK_TYPE_OTA_*
+ * \param[in]  payload	Frame without downlink_header_t
+ * \param[in]  length	Payload length
+ */
+void ota_downlink(uint8_t type, const uint8_t * payload, uint8_t length);
+
+/**
+ * \brief Build and verify image once all fragments are there
+ *
+ * Call after the receive window, takes up to a few seconds.
+ *
+ * \return     1 if the node has to reset into the bootloader, 0 otherwise
+ */
+uint8_t ota_process(void);
+
+/**
+ * \brief Confirm running image after a good uplink
+ */
+void ota_confirm(void);
+
+/**
+ * \brief Get pending report
+ *
+ * \param[out] report	Report to send
+ *
+ * \return     1 if a report is pending, 0 otherwise
+ */
+uint8_t ota_report(ota_report_t * report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * OTA memory layout and boot record for LoggerSoft
+ *
+ * Shared by the application (USE_OTA), the bootloader in boot/ and the
+ * host tool tools/ota_delta.c, so it does not depend on main.h.
+ *
+ * Internal flash:
+ *   0x08000000  bootloader, OTA_BOOT_SIZE
+ *   0x08002000  application, OTA_APP_SIZE, built with gd32e23x_flash_ota.ld
+ *   0x0800F800  configuration page and logger_id page, never touched
+ *
+ * External W25Q flash (above the sample log):
+ *   OTA_W25Q_DELTA   received delta
+ *   OTA_W25Q_PARITY  received parity fragments
+ *   OTA_W25Q_IMAGE   new image built from delta, slot B
+ *   OTA_W25Q_BACKUP  copy of previous image for rollback
+ *   OTA_W25Q_STATE   boot records, appended until the sector is full
+ *
+ * Boot record states:
+ *   PENDING    image in OTA_W25Q_IMAGE is verified, bootloader installs it
+ *   BACKED_UP  running image is saved in OTA_W25Q_BACKUP, written before
+ *              the application area is erased; a reset during the
+ *              install resumes it instead of backing up the broken area
+ *   TRIAL      image is installed, application has not confirmed it yet;
+ *              every boot counts an attempt, after OTA_BOOT_ATTEMPTS the
+ *              bootloader restores OTA_W25Q_BACKUP
+ *   CONFIRMED  application reported a good uplink with the new image
+ *   ROLLED_BACK
+ */
+
+#ifndef __OTA_BOOT_H__
+#define __OTA_BOOT_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OTA_BOOT_BASE			0x08000000UL
+#define OTA_BOOT_SIZE			0x2000UL
+#define OTA_APP_BASE			(OTA_BOOT_BASE + OTA_BOOT_SIZE)
+#define OTA_APP_END				0x0800F800UL	// configuration page
+#define OTA_APP_SIZE			(OTA_APP_END - OTA_APP_BASE)
+#define OTA_FLASH_PAGE_SIZE		0x400UL
+
+#define OTA_W25Q_DELTA			0x080000UL
+#define OTA_W25Q_PARITY			0x090000UL
+#define OTA_W25Q_IMAGE			0x0A0000UL
+#define OTA_W25Q_BACKUP			0x0B0000UL
+#define OTA_W25Q_STATE			0x0C0000UL
+#define OTA_W25Q_SECTOR_SIZE	0x1000UL
+#define OTA_W25Q_SLOT_SIZE		0x10000UL
+
+#define OTA_BOOT_MAGIC			0x3141544FUL	// "OTA1"
+#define OTA_BOOT_ATTEMPTS		3
+
+#define OTA_BOOT_IDLE			0
+#define OTA_BOOT_PENDING		1
+#define OTA_BOOT_TRIAL			2
+#define OTA_BOOT_CONFIRMED		3
+#define OTA_BOOT_ROLLED_BACK	4
+#define OTA_BOOT_BACKED_UP		5
+
+typedef struct __attribute__((packed)) {
+	uint32_t magic;			// OTA_BOOT_MAGIC
+	uint32_t sequence;		// incremented by every record
+	uint32_t state;			// OTA_BOOT_*
+	uint32_t image_length;	// bytes of new image in OTA_W25Q_IMAGE
+	uint32_t image_crc;		// crc32 of new image, padded with 0xFF to OTA_APP_SIZE
+	uint32_t backup_crc;	// crc32 of OTA_W25Q_BACKUP, OTA_APP_SIZE bytes
+	uint32_t attempts;		// boots in TRIAL state
+	uint32_t crc;			// crc32 of the fields above
+} ota_boot_record_t;
+
+#define OTA_BOOT_RECORDS		(OTA_W25Q_SECTOR_SIZE / sizeof(ota_boot_record_t))
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
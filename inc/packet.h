@@ -0,0 +1,474 @@
+/**
+ * LoRa uplink frame format for LoggerSoft
+ *
+ * Frame layout (little endian, no padding):
+ *   packet_header_t
+ *   packet_sample_t * header.count   if header.type == PACKET_TYPE_SAMPLES
+ *   packet_stats_t * header.count    if header.type == PACKET_TYPE_STATS
+ *   packet_values_t * header.count   if header.type == PACKET_TYPE_BACKFILL
+ *   relay_entry_t, frame * count     if header.type == PACKET_TYPE_RELAY
+ *   packet_status_t                  if header.flags & PACKET_FLAG_STATUS
+ *   packet_time_t, uint16_t * count  if header.flags & PACKET_FLAG_TIME
+ *   ota_report_t                     if header.type == PACKET_TYPE_OTA, count is 1
+ *   config_report_t                  if header.type == PACKET_TYPE_CONFIG, count is 1
+ *   relay_report_t                   if header.type == PACKET_TYPE_RELAY_STATS, count is 1
+ *   fec_parity_t, see below          if header.type == PACKET_TYPE_PARITY, count is 1
+ *   crash_report_t                   if header.type == PACKET_TYPE_CRASH, count is 1
+ *
+ * Downlink frames, gateway to node, in the receive window after an uplink:
+ *   downlink_header_t
+ *   ota_start_t                      if type == DOWNLINK_TYPE_OTA_START
+ *   ota_fragment_t                   if type == DOWNLINK_TYPE_OTA_FRAGMENT or _PARITY
+ *   config_set_t                     if type == DOWNLINK_TYPE_CONFIG
+ *   downlink_ack_t                   if type == DOWNLINK_TYPE_ACK
+ *   beacon_t                         if type == DOWNLINK_TYPE_BEACON, broadcast
+ */
+
+#ifndef __PACKET_H__
+#define __PACKET_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PACKET_MAX_SAMPLES		8
+#define PACKET_MAX_STATS		2
+#define PACKET_MAX_BACKFILL		16
+
+#define PACKET_TYPE_SAMPLES		0x01
+#define PACKET_TYPE_STATS		0x02
+#define PACKET_TYPE_OTA			0x03
+#define PACKET_TYPE_CONFIG		0x04
+#define PACKET_TYPE_BACKFILL	0x05	// logged samples the gateway missed, always timed
+#define PACKET_TYPE_RELAY		0x06	// frames of downstream nodes
+#define PACKET_TYPE_RELAY_STATS	0x07
+#define PACKET_TYPE_PARITY		0x08	// erasure code over the previous data frames
+#define PACKET_TYPE_CRASH		0x09	// post-mortem of the run before the last reset
+
+#define PACKET_FLAG_STATUS		0x01
+#define PACKET_FLAG_TIME		0x02	// record times follow
+#define PACKET_FLAG_TIME_UNIX	0x04	// record times are Unix time, else node uptime
+
+typedef struct __attribute__((packed)) {
+	uint32_t device_id;
+	uint32_t msg_id;
+	uint8_t type;			// PACKET_TYPE_*
+	uint8_t flags;			// PACKET_FLAG_*
+	uint8_t count;			// number of records
+} packet_header_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t seq;			// sample counter, gaps are suppressed or dropped samples
+	int16_t temperature;	// [0.01 C]
+	uint16_t humidity;		// [0.01 %RH]
+	uint16_t pressure;		// [10 Pa]
+	uint16_t voltage;		// battery at rest [mV]
+} packet_sample_t;
+
+typedef struct __attribute__((packed)) {
+	int16_t temperature;	// [0.01 C]
+	uint16_t humidity;		// [0.01 %RH]
+	uint16_t pressure;		// [10 Pa]
+	uint16_t voltage;		// battery at rest [mV]
+} packet_values_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t first_seq;		// seq of first sample in window
+	uint8_t count;			// number of samples in window
+	packet_values_t min;
+	packet_values_t max;
+	packet_values_t mean;
+	packet_values_t last;
+} packet_stats_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t profile;		// current policy profile
+	uint8_t prev_profile;	// profile before last transition
+	uint16_t voltage;		// battery at rest [mV]
+	uint16_t voltage_load;	// battery during previous TX [mV]
+	int16_t trend;			// battery trend, change per sample [1/256 mV]
+} packet_status_t;
+
+/*
+ * Record times: time of the first record, then for every record the
+ * seconds since the previous one, PACKET_DELTA_UNKNOWN if that does not
+ * fit. A sample is timed when taken, a statistics window when closed.
+ */
+#define PACKET_DELTA_UNKNOWN	0xFFFF
+
+// backfill times below it are uptime of the same boot, PACKET_FLAG_TIME_UNIX is set if none is
+#define PACKET_TIME_UNIX_MIN	1000000000UL
+
+typedef struct __attribute__((packed)) {
+	uint32_t time;			// first record [s], see PACKET_FLAG_TIME_UNIX
+} packet_time_t;
+
+#define PACKET_SAMPLES_SIZE		(sizeof(packet_header_t) \
+		+ PACKET_MAX_SAMPLES * sizeof(packet_sample_t) + sizeof(packet_status_t) \
+		+ sizeof(packet_time_t) + PACKET_MAX_SAMPLES * sizeof(uint16_t))
+#define PACKET_BACKFILL_SIZE	(sizeof(packet_header_t) \
+		+ PACKET_MAX_BACKFILL * (sizeof(packet_values_t) + sizeof(uint16_t)) + sizeof(packet_time_t))
+#define PACKET_MAX_SIZE			((PACKET_SAMPLES_SIZE > PACKET_BACKFILL_SIZE) \
+		? PACKET_SAMPLES_SIZE : PACKET_BACKFILL_SIZE)
+
+/*
+ * Relayed frames: every frame a relay received from a downstream node,
+ * verbatim after the link quality the relay measured. The relay may have
+ * acknowledged it already, the gateway must not.
+ */
+typedef struct __attribute__((packed)) {
+	uint8_t length;			// frame bytes that follow
+	int8_t snr;				// [0.25 dB], as in RegPktSnrValue
+	int16_t rssi;			// [dBm]
+} relay_entry_t;
+
+typedef struct __attribute__((packed)) {
+	uint32_t received;		// downstream frames queued
+	uint32_t forwarded;		// of them sent on
+	uint16_t dropped;		// lost to a full queue or too long
+	uint16_t duplicates;	// forwarding frames repeated after a TxDone timeout
+	uint32_t rx_s;			// time in RX
+	uint32_t tx_ms;			// time on air of forwards, reports and ACKs
+	uint16_t charge_mah;	// radio charge estimate since power-up
+} relay_report_t;
+
+/*
+ * Uplink erasure code: after every group of data frames (samples or
+ * statistics) the node sends parity frames over the whole frames, each
+ * zero padded to the longest one. Parity 0 is their XOR and rebuilds
+ * any one lost frame, parity 1 is sum(g^i * frame i) in GF(2^8) with
+ * polynomial 0x11D and g = 2 and rebuilds a second one with parity 0.
+ * Layout after packet_header_t:
+ *   fec_parity_t
+ *   uint32_t msg_id[group]           data frames, in coefficient order
+ *   uint8_t length[group]            their lengths
+ *   parity, as long as the longest
+ */
+#define FEC_INDEX_XOR			0
+#define FEC_INDEX_RS			1
+
+typedef struct __attribute__((packed)) {
+	uint8_t index;			// FEC_INDEX_*
+	uint8_t group;			// data frames covered
+} fec_parity_t;
+
+/*
+ * Post-mortem, sent once after every reset. The phase is what the node
+ * was doing when it went down. With CRASH_RESET_POWER and a known phase
+ * the supply dropped below the reset level but the RTC domain held, a
+ * brown-out; a cold start has CRASH_PHASE_UNKNOWN.
+ */
+#define CRASH_RESET_POWER		0x01	// power-on or brown-out
+#define CRASH_RESET_PIN			0x02	// NRST
+#define CRASH_RESET_SOFTWARE	0x04	// NVIC_SystemReset(), OTA install
+#define CRASH_RESET_WATCHDOG	0x08	// FWDGT, a hang
+#define CRASH_RESET_FAULT		0x10	// HardFault, pc and lr are valid
+#define CRASH_RESET_OTHER		0x20	// WWDGT, low-power, option bytes
+
+#define CRASH_PHASE_BOOT		0x00	// initialisation before the main loop
+#define CRASH_PHASE_IDLE		0x01	// main loop between tasks
+#define CRASH_PHASE_BATTERY		0x02
+#define CRASH_PHASE_SENSOR		0x03
+#define CRASH_PHASE_LOG			0x04	// external flash
+#define CRASH_PHASE_UPLINK		0x05	// radio, between frames
+#define CRASH_PHASE_TX			0x06
+#define CRASH_PHASE_RX			0x07
+#define CRASH_PHASE_SLEEP		0x08
+#define CRASH_PHASE_UNKNOWN		0xFF	// record lost with the RTC domain
+
+typedef struct __attribute__((packed)) {
+	uint8_t reset;			// CRASH_RESET_*
+	uint8_t phase;			// CRASH_PHASE_*
+	uint16_t voltage;		// last battery reading before the reset [mV], 0 if unknown
+	uint32_t pc;			// faulting instruction, with CRASH_RESET_FAULT
+	uint32_t lr;			// its caller
+	uint16_t resets;		// resets since the RTC domain was powered up
+} crash_report_t;
+
+#define DOWNLINK_BROADCAST			0xFFFFFFFFUL
+
+#define DOWNLINK_TYPE_OTA_START		0x81
+#define DOWNLINK_TYPE_OTA_FRAGMENT	0x82
+#define DOWNLINK_TYPE_OTA_PARITY	0x83
+#define DOWNLINK_TYPE_CONFIG		0x84
+#define DOWNLINK_TYPE_ACK			0x85
+#define DOWNLINK_TYPE_BEACON		0x86
+
+typedef struct __attribute__((packed)) {
+	uint32_t device_id;		// target node or DOWNLINK_BROADCAST
+	uint8_t type;			// DOWNLINK_TYPE_*
+} downlink_header_t;
+
+/*
+ * Uplink acknowledgement with the gateway's view of the link and its
+ * data rate recommendation, first frame of the window. Used by ADR, the
+ * time is used by time sync.
+ */
+#define ACK_NO_CHANGE			0xFF
+
+typedef struct __attribute__((packed)) {
+	uint32_t msg_id;		// acknowledged uplink
+	int8_t snr;				// uplink SNR [0.25 dB], as in RegPktSnrValue
+	int16_t rssi;			// uplink RSSI [dBm]
+	uint8_t sf;				// SX1278_LORA_SF_* to use or ACK_NO_CHANGE
+	uint8_t power;			// SX1278_POWER_* to use or ACK_NO_CHANGE
+	uint32_t time_s;		// gateway Unix time at the end of this transmission, 0 if unknown
+	uint16_t time_ms;		// [ms] part of it
+} downlink_ack_t;
+
+/*
+ * TDMA beacon, sent by the gateway at every multiple of period_s of its
+ * time of day. Slot 0 holds the beacon, node slots follow it, a node
+ * starts sending guard_ms after the start of its slot. Each beacon
+ * carries a few slot assignments, nodes not listed keep their slot.
+ */
+#define BEACON_MAX_ASSIGN		16
+
+typedef struct __attribute__((packed)) {
+	uint32_t device_id;
+	uint16_t slot;			// 1..slot_count
+} beacon_assign_t;
+
+typedef struct __attribute__((packed)) {
+	uint32_t time_s;		// gateway Unix time at the end of this transmission [s]
+	uint16_t time_ms;		// [ms] part of it
+	uint16_t period_s;		// beacon period, divides one day
+	uint16_t slot_ms;		// slot length
+	uint16_t slot_count;	// node slots in a period
+	uint16_t guard_ms;		// TX start after slot start
+	uint8_t assign_count;	// entries in assign
+	beacon_assign_t assign[BEACON_MAX_ASSIGN];
+} beacon_t;
+
+/*
+ * Remote configuration. config_set_t.mask selects the values to change,
+ * the others are ignored. The node answers with config_report_t in the
+ * same window, still on the old settings; new ones are used from the
+ * next cycle on. They are stored, and survive resets, once the gateway
+ * answers an uplink sent with them. Without an answer within
+ * CONFIG_TRIAL_UPLINKS uplinks, or after a reset, the node returns to the
+ * previous settings and reports CONFIG_RESULT_REVERTED on them.
+ * Radio settings are only taken from frames addressed to the node.
+ */
+#define CONFIG_SET_SF			0x01
+#define CONFIG_SET_BW			0x02
+#define CONFIG_SET_POWER		0x04
+#define CONFIG_SET_SYNC_WORD	0x08
+#define CONFIG_SET_PERIOD		0x10
+#define CONFIG_SET_RADIO		(CONFIG_SET_SF | CONFIG_SET_BW | CONFIG_SET_POWER | CONFIG_SET_SYNC_WORD)
+
+#define CONFIG_RESULT_OK		0
+#define CONFIG_RESULT_INVALID	1	// out of range, nothing changed
+#define CONFIG_RESULT_FLASH		2	// not stored, applied until reset
+#define CONFIG_RESULT_REVERTED	3	// no answer on the new settings, previous ones restored
+#define CONFIG_RESULT_BROADCAST	4	// radio settings in a broadcast, nothing changed
+
+typedef struct __attribute__((packed)) {
+	uint8_t sf;				// SX1278_LORA_SF_*, SF7 and up
+	uint8_t bw;				// SX1278_LORA_BW_*, 62.5 kHz and up
+	uint8_t power;			// SX1278_POWER_*
+	uint8_t sync_word;
+	uint8_t sleep_minutes;	// base period, see SLEEP_MINUTES
+} config_values_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t mask;			// CONFIG_SET_*
+	config_values_t values;
+} config_set_t;
+
+typedef struct __attribute__((packed)) {
+	uint8_t result;			// CONFIG_RESULT_*
+	config_values_t values;	// settings of the next cycle
+} config_report_t;
+
+/*
+ * OTA delta is cut into OTA_FRAGMENT_SIZE fragments, the last one padded
+ * with 0xFF. Every OTA_FEC_GROUP consecutive fragments have one parity
+ * fragment, their XOR, which restores any single lost fragment of the group.
+ */
+#define OTA_FRAGMENT_SIZE		64
+#define OTA_FEC_GROUP			8
+
+typedef struct __attribute__((packed)) {
+	uint16_t session;		// any value, a new value restarts reception
+	uint16_t fragments;		// number of data fragments
+	uint16_t delta_length;	// delta bytes
+	uint16_t image_length;	// new image bytes, no more than OTA_APP_SIZE
+	uint32_t base_crc;		// crc32 of running image, the delta applies to it only
+	uint32_t image_crc;		// crc32 of new image, both padded with 0xFF to OTA_APP_SIZE
+} ota_start_t;
+
+typedef struct __attribute__((packed)) {
+	uint16_t session;
+	uint16_t index;			// fragment index, or group index for parity
+	uint8_t data[OTA_FRAGMENT_SIZE];
+} ota_fragment_t;
+
+typedef struct __attribute__((packed)) {
+	uint16_t session;
+	uint16_t received;		// data fragments received or restored
+	uint8_t state;			// OTA_STATE_*
+} ota_report_t;
+
+/*
+ * Delta operations, applied in order to produce the new image:
+ *   OTA_OP_COPY    u16 offset, u16 length    copy from running image
+ *   OTA_OP_INSERT  u16 length, data          literal bytes
+ *   OTA_OP_END
+ */
+#define OTA_OP_END				0x00
+#define OTA_OP_COPY				0x01
+#define OTA_OP_INSERT			0x02
+
+/**
+ * \brief Fill sample record
+ *
+ * Converts sensor readings to record units, saturating on overflow.
+ *
+ * \param[out] sample		Record to fill
+ * \param[in]  seq			Sample counter
+ * \param[in]  temperature	Temperature in [C]
+ * \param[in]  humidity		Relative humidity in [%]
+ * \param[in]  pressure		Pressure in [Pa]
+ * \param[in]  voltage		Battery voltage in [mV]
+ */
+void packet_fill_sample(packet_sample_t * sample, uint8_t seq,
+		float temperature, float humidity, float pressure, uint16_t voltage);
+
+/**
+ * \brief Build frame
+ *
+ * \param[out] buf			Destination, at least PACKET_MAX_SIZE bytes
+ * \param[in]  msg_id		Message counter
+ * \param[in]  samples		Sample records
+ * \param[in]  count		Number of sample records, no more than PACKET_MAX_SAMPLES
+ * \param[in]  status		Status record or NULL
+ * \param[in]  times		Sample times [s] or NULL
+ * \param[in]  unix_time	Times are Unix time
+ *
+ * \return     Frame length in bytes
+ */
+uint8_t packet_build(uint8_t * buf, uint32_t msg_id,
+		const packet_sample_t * samples, uint8_t count,
+		const packet_status_t * status, const uint32_t * times, uint8_t unix_time);
+
+/**
+ * \brief Build statistics frame
+ *
+ * Same as packet_build() for aggregated windows.
+ *
+ * \param[out] buf			Destination, at least PACKET_MAX_SIZE bytes
+ * \param[in]  msg_id		Message counter
+ * \param[in]  stats		Window records
+ * \param[in]  count		Number of window records, no more than PACKET_MAX_STATS
+ * \param[in]  status		Status record or NULL
+ * \param[in]  times		Window close times [s] or NULL
+ * \param[in]  unix_time	Times are Unix time
+ *
+ * \return     Frame length in bytes
+ */
+uint8_t packet_build_stats(uint8_t * buf, uint32_t msg_id,
+		const packet_stats_t * stats, uint8_t count,
+		const packet_status_t * status, const uint32_t * times, uint8_t unix_time);
+
+/**
+ * \brief Build backfill frame
+ *
+ * \param[out] buf			Destination, at least PACKET_MAX_SIZE bytes
+ * \param[in]  msg_id		Message counter
+ * \param[in]  values		Logged records, oldest first
+ * \param[in]  count		Number of records, no more than PACKET_MAX_BACKFILL
+ * \param[in]  times		Record times [s]
+ * \param[in]  unix_time	Times are Unix time
+ *
+ * \return     Frame length in bytes
+ */
+uint8_t packet_build_backfill(uint8_t * buf, uint32_t msg_id,
+		const packet_values_t * values, uint8_t count,
+		const uint32_t * times, uint8_t unix_time);
+
+/**
+ * \brief Build relay frame
+ *
+ * \param[out] buf			Destination, room for header and entries
+ * \param[in]  msg_id		Message counter
+ * \param[in]  entries		relay_entry_t and frame pairs
+ * \param[in]  size			Bytes in entries
+ * \param[in]  count		Number of pairs
+ *
+ * \return     Frame length in bytes
+ */
+uint8_t packet_build_relay(uint8_t * buf, uint32_t msg_id,
+		const uint8_t * entries, uint8_t size, uint8_t count);
+
+/**
+ * \brief Build relay statistics frame
+ *
+ * \param[out] buf			Destination, at least PACKET_MAX_SIZE bytes
+ * \param[in]  msg_id		Message counter
+ * \param[in]  report		Relay statistics
+ *
+ * \return     Frame length in bytes
+ */
+uint8_t packet_build_relay_report(uint8_t * buf, uint32_t msg_id,
+		const relay_report_t * report);
+
+/**
+ * \brief Build parity frame
+ *
+ * \param[out] buf			Destination, at least PACKET_MAX_SIZE bytes
+ * \param[in]  msg_id		Message counter
+ * \param[in]  parity		Index and group size
+ * \param[in]  msg_ids		Message counters of the data frames
+ * \param[in]  lengths		Their lengths
+ * \param[in]  data			Parity bytes
+ * \param[in]  size			Number of parity bytes
+ *
+ * \return     Frame length in bytes
+ */
+uint8_t packet_build_parity(uint8_t * buf, uint32_t msg_id, const fec_parity_t * parity,
+		const uint32_t * msg_ids, const uint8_t * lengths, const uint8_t * data, uint8_t size);
+
+/**
+ * \brief Build post-mortem frame
+ *
+ * \param[out] buf			Destination, at least PACKET_MAX_SIZE bytes
+ * \param[in]  msg_id		Message counter
+ * \param[in]  report		Reset cause and record of the previous run
+ *
+ * \return     Frame length in bytes
+ */
+uint8_t packet_build_crash(uint8_t * buf, uint32_t msg_id,
+		const crash_report_t * report);
+
+/**
+ * \brief Build OTA report frame
+ *
+ * \param[out] buf			Destination, at least PACKET_MAX_SIZE bytes
+ * \param[in]  msg_id		Message counter
+ * \param[in]  report		Update state
+ *
+ * \return     Frame length in bytes
+ */
+uint8_t packet_build_ota(uint8_t * buf, uint32_t msg_id,
+		const ota_report_t * report);
+
+/**
+ * \brief Build configuration report frame
+ *
+ * \param[out] buf			Destination, at least PACKET_MAX_SIZE bytes
+ * \param[in]  msg_id		Message counter
+ * \param[in]  report		Result and settings
+ *
+ * \return     Frame length in bytes
+ */
+uint8_t packet_build_config(uint8_t * buf, uint32_t msg_id,
+		const config_report_t * report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,94 @@
+/**
+ * Battery-aware operating policy for LoggerSoft
+ *
+ * Picks an operating profile from the battery voltage projected by its
+ * trend. Profiles are ordered from full service (0) to store-only (last),
+ * thresholds and profile contents are set by POLICY_* defines in main.h.
+ */
+
+#ifndef __POLICY_H__
+#define __POLICY_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define POLICY_MARGIN_UNKNOWN	(-128)
+
+typedef struct {
+	uint16_t enter_mv;		// profile is used below this projected voltage
+	uint8_t interval_mul;	// sensor and uplink period multiplier
+	uint8_t batch;			// samples per uplink, no more than PACKET_MAX_SAMPLES
+	uint8_t power;			// SX1278_POWER_*, used if link margin allows
+	uint8_t LoRa_SF;		// SX1278_LORA_SF_*, used if link margin allows
+	int8_t min_margin_db;	// link margin needed for power and LoRa_SF
+	uint8_t store_only;		// sample but send status frames only
+} policy_profile_t;
+
+typedef struct {
+	uint8_t profile;		// index of current profile
+	uint8_t prev_profile;	// index of profile before last transition
+	uint8_t changed;		// transition not yet reported in telemetry
+	int8_t link_margin_db;	// last known link margin, POLICY_MARGIN_UNKNOWN if none
+} policy_t;
+
+extern policy_t policy;
+
+/**
+ * \brief Reset policy to full service profile
+ */
+void policy_init(void);
+
+/**
+ * \brief Re-evaluate profile
+ *
+ * Projects battery voltage by its trend and moves to the matching
+ * profile. Moving back to a better profile needs POLICY_HYSTERESIS_MV
+ * extra headroom.
+ *
+ * \param[in]  voltage	Battery voltage at rest in [mV], 0 if unknown
+ * \param[in]  trend	Battery trend, change per sample [1/256 mV]
+ *
+ * \return     1 if profile changed, 0 otherwise
+ */
+uint8_t policy_update(uint16_t voltage, int32_t trend);
+
+/**
+ * \brief Current profile
+ *
+ * \return     Pointer to current profile
+ */
+const policy_profile_t * policy_current(void);
+
+/**
+ * \brief TX power to use
+ *
+ * \param[in]  base		Power used when link margin is unknown or too low
+ *
+ * \return     SX1278_POWER_*
+ */
+uint8_t policy_tx_power(uint8_t base);
+
+/**
+ * \brief Spreading factor to use
+ *
+ * \param[in]  base		SF used when link margin is unknown or too low
+ *
+ * \return     SX1278_LORA_SF_*
+ */
+uint8_t policy_tx_sf(uint8_t base);
+
+/**
+ * \brief Report link margin
+ *
+ * \param[in]  margin_db	SNR margin over demodulation floor in [dB]
+ */
+void policy_set_link_margin(int8_t margin_db);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,128 @@
+/**
+ * Multi-hop relay for LoggerSoft
+ *
+ * A relay is a well-powered node that stays in continuous RX on
+ * RELAY_RX_SF instead of sleeping and forwards the frames of the
+ * downstream nodes listed in RELAY_NODES to the gateway. Leaf nodes need
+ * no changes: they send their usual frames, the relay queues them as
+ * they are and sends them on in PACKET_TYPE_RELAY frames, batched until
+ * RELAY_BATCH_BYTES are queued or the oldest frame waited
+ * RELAY_MAX_DELAY_S, and along with its own uplinks.
+ *
+ * With RELAY_ACK the relay answers every downstream frame with
+ * downlink_ack_t right away, so ADR and backfill on the leaf see the
+ * relay hop as their link. The ACK carries no time and no data rate
+ * change.
+ *
+ * Leaves never send a msg_id twice, a frame heard twice reached the
+ * relay on two paths and the gateway drops the copy by device_id and
+ * msg_id. What the relay itself can duplicate is its forwarding frame:
+ * when TxDone times out the frame may be on air anyway. The batch stays
+ * queued and goes out again unchanged with the same msg_id, so the
+ * gateway drops it as a repeat, unless the queue overflowed meanwhile.
+ *
+ * Time in RX and on air is counted and reported with the diagnostics
+ * as relay_report_t, together with a charge estimate from RELAY_RX_MA
+ * and RELAY_TX_MA.
+ */
+
+#ifndef __RELAY_H__
+#define __RELAY_H__
+
+#include <stdint.h>
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint8_t queue[RELAY_QUEUE_SIZE];	// relay_entry_t and frame pairs, oldest first
+	uint16_t queued;		// bytes in queue
+	uint8_t entries;		// pairs in queue
+	uint16_t batch;			// bytes in the frame built last
+	uint8_t batch_entries;
+	uint32_t retry_id;		// msg_id of the batch built last, 0 once forwarded
+	uint32_t first_s;		// sched_clock() when the oldest pair was queued
+	uint32_t received;
+	uint32_t forwarded;
+	uint16_t dropped;
+	uint16_t duplicates;
+	uint32_t rx_s;			// time in RX
+	uint16_t rx_ms;			// [ms] part of it
+	uint32_t tx_ms;			// time on air
+} relay_t;
+
+extern relay_t relay;
+
+/**
+ * \brief Take a received frame
+ *
+ * \param[in]  frame	Received bytes
+ * \param[in]  length	Frame length
+ * \param[in]  snr		Packet SNR [0.25 dB]
+ * \param[in]  rssi		Packet RSSI [dBm]
+ * \param[in]  now		sched_clock() value
+ *
+ * \return     1 if it is an uplink of a downstream node, to be acknowledged
+ */
+uint8_t relay_frame(const uint8_t * frame, uint8_t length, int8_t snr, int16_t rssi, uint32_t now);
+
+/**
+ * \brief Build acknowledgement of a downstream frame
+ *
+ * \param[out] buf		Destination, room for downlink_header_t and downlink_ack_t
+ * \param[in]  frame	Frame accepted by relay_frame()
+ * \param[in]  snr		Its SNR [0.25 dB]
+ * \param[in]  rssi		Its RSSI [dBm]
+ *
+ * \return     Frame length in bytes
+ */
+uint8_t relay_build_ack(uint8_t * buf, const uint8_t * frame, int8_t snr, int16_t rssi);
+
+/**
+ * \brief Check whether the queue is due for forwarding
+ *
+ * \param[in]  now		sched_clock() value
+ *
+ * \return     1 if a batch is full or its oldest frame waited long enough
+ */
+uint8_t relay_ready(uint32_t now);
+
+/**
+ * \brief Build a forwarding frame from the oldest queued frames
+ *
+ * Repeats the frame built last, with its msg_id, until relay_forwarded().
+ *
+ * \param[out] buf		Destination, at least RELAY_FRAME_MAX bytes
+ * \param[in,out] msg_id	Message counter, advanced for a new frame
+ *
+ * \return     Frame length in bytes, 0 if the queue is empty
+ */
+uint8_t relay_build(uint8_t * buf, uint32_t * msg_id);
+
+/**
+ * \brief Drop the frames of the last relay_build() from the queue
+ */
+void relay_forwarded(void);
+
+/**
+ * \brief Count radio time
+ *
+ * \param[in]  rx_ms	Time in RX
+ * \param[in]  tx_ms	Time on air
+ */
+void relay_account(uint32_t rx_ms, uint32_t tx_ms);
+
+/**
+ * \brief Fill statistics record
+ *
+ * \param[out] report	Record to fill
+ */
+void relay_report(relay_report_t * report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,63 @@
+/**
+ * IRC40K RTC calibration for LoggerSoft
+ *
+ * Without USE_EXTERNAL_LXTAL the RTC runs from IRC40K, which may be off by
+ * tens of percent while the prescalers of msd_rtc_init() assume 32768 Hz.
+ * TIMER13 channel 0 is remapped to RTCCLK and captures every 8th IRC40K
+ * edge on the IRC8M system clock, which gives the IRC40K frequency to
+ * the IRC8M accuracy (about 1 %, against 25 % uncalibrated).
+ *
+ * The measured frequency is split into RTC prescalers, keeping the
+ * asynchronous one as large as possible for low power, and the remainder
+ * is trimmed by the RTC smooth calibration in steps of 0.95 ppm.
+ *
+ * IRC40K moves with temperature, it is measured again after the sensor
+ * temperature changed by RTCCAL_TEMP_STEP or after RTCCAL_PERIOD_S.
+ */
+
+#ifndef __RTCCAL_H__
+#define __RTCCAL_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint32_t freq_mhz;			// last measured RTCCLK [mHz], 0 if none
+	uint8_t factor_asyn;		// RTC prescalers in use
+	uint16_t factor_syn;
+	int16_t trim;				// smooth calibration [2^-20], positive speeds up
+	float temperature;			// sensor temperature at last run
+	uint8_t temperature_valid;
+	uint32_t last_s;			// sched_clock() at last run
+	uint32_t runs;
+	uint32_t failures;			// measurements out of range
+} rtccal_t;
+
+extern rtccal_t rtccal;
+
+/**
+ * \brief Measure IRC40K and set RTC prescalers and smooth calibration
+ *
+ * Keeps the time of day, may wait up to one second for a second boundary
+ * when the prescalers change.
+ *
+ * \return     1 if applied, 0 if the measurement failed
+ */
+uint8_t rtccal_run(void);
+
+/**
+ * \brief Recalibrate if temperature or time since last run call for it
+ *
+ * \param[in]  now			sched_clock() value
+ * \param[in]  temperature	Sensor temperature [degC]
+ */
+void rtccal_check(uint32_t now, float temperature);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,145 @@
+/**
+ * Multi-rate task scheduler for LoggerSoft
+ *
+ * Every periodic job has its own period and next deadline on a monotonic
+ * second clock derived from the RTC. One wake-up serves all jobs due
+ * within SCHED_COALESCE_S, and the RTC alarm is set to the earliest
+ * remaining deadline, so jobs with different periods share wake-ups.
+ */
+
+#ifndef __SCHED_H__
+#define __SCHED_H__
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	SCHED_BATTERY = 0,		// battery measurement and policy update
+	SCHED_SENSOR,			// sensor sample
+	SCHED_LOG_FLUSH,		// flash log write-back
+	SCHED_UPLINK,			// LoRa uplink of queued records
+	SCHED_DIAG,				// diagnostic status frame
+	SCHED_BEACON,			// TDMA beacon receive window
+	SCHED_TASKS
+} sched_task_t;
+
+#define SCHED_BIT(task)		(1UL << (task))
+
+#define SCHED_SECONDS_PER_DAY	86400UL
+
+typedef struct {
+	uint32_t period[SCHED_TASKS];	// [s], 0 disables task
+	uint32_t deadline[SCHED_TASKS];	// next run on sched_clock() scale
+	uint32_t exact;					// SCHED_BIT() mask of tasks never run ahead of deadline
+	uint32_t day;					// days elapsed since power-up
+	uint32_t last_sod;				// last seen RTC second of day
+	int32_t stepped;				// sum of sched_set_time_of_day() steps [s]
+} sched_t;
+
+extern sched_t sched;
+
+/**
+ * \brief Start scheduler
+ *
+ * Periods are SCHED_*_PERIOD_S defines in main.h. First deadline of every
+ * task is one period from now, power-up work is done by the caller.
+ */
+void sched_init(void);
+
+/**
+ * \brief Monotonic time
+ *
+ * Reads RTC time of day and counts day rollovers. Has to be called at
+ * least once a day, which every wake-up does.
+ *
+ * \return     Seconds since midnight of power-up day
+ */
+uint32_t sched_clock(void);
+
+/**
+ * \brief Change task period
+ *
+ * Next deadline is moved to last run + new period.
+ *
+ * \param[in]  task		Task
+ * \param[in]  period	New period in [s], 0 disables task
+ */
+void sched_set_period(sched_task_t task, uint32_t period);
+
+/**
+ * \brief Monotonic time with milliseconds
+ *
+ * \param[out] ms		Milliseconds into the current second
+ *
+ * \return     Same as sched_clock()
+ */
+uint32_t sched_clock_fine(uint16_t * ms);
+
+/**
+ * \brief Set RTC time of day
+ *
+ * Call right on a second boundary of the new time, the RTC restarts its
+ * second there. sched_clock() and all deadlines move by the same step,
+ * so tasks keep their relative timing.
+ *
+ * \param[in]  sod		New second of day
+ *
+ * \return     Step applied to sched_clock() in [s]
+ */
+int32_t sched_set_time_of_day(uint32_t sod);
+
+/**
+ * \brief Time since power-up
+ *
+ * Unlike sched_clock() not moved by sched_set_time_of_day().
+ *
+ * \param[in]  now		sched_clock() value
+ *
+ * \return     Seconds since midnight of power-up day, less steps
+ */
+uint32_t sched_uptime(uint32_t now);
+
+/**
+ * \brief Move next run of a task
+ *
+ * \param[in]  task		Task
+ * \param[in]  deadline	Next run on sched_clock() scale
+ */
+void sched_set_deadline(sched_task_t task, uint32_t deadline);
+
+/**
+ * \brief Tasks to run now
+ *
+ * \param[in]  now		sched_clock() value
+ *
+ * \return     SCHED_BIT() mask of tasks due within now + SCHED_COALESCE_S,
+ *             tasks in sched.exact only once their deadline is reached
+ */
+uint32_t sched_due(uint32_t now);
+
+/**
+ * \brief Mark tasks done
+ *
+ * Deadlines advance by whole periods past now, missed runs are not
+ * repeated.
+ *
+ * \param[in]  tasks	SCHED_BIT() mask returned by sched_due()
+ * \param[in]  now		sched_clock() value passed to sched_due()
+ */
+void sched_done(uint32_t tasks, uint32_t now);
+
+/**
+ * \brief Earliest deadline
+ *
+ * \return     Earliest deadline of enabled tasks on sched_clock() scale
+ */
+uint32_t sched_next(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,103 @@
+/**
+ * Register-level SPI transfers for LoggerSoft
+ *
+ * The HAL polling calls set up the transfer state, check CRC and frame
+ * size and restart the timeout on every byte, which costs far more than
+ * the byte itself at 8 MHz. The radio, flash and BME280 drivers move
+ * one to a few bytes per register access, so they use these instead.
+ *
+ * Only 8-bit full-duplex master mode as set up by msd_spi0_init() and
+ * msd_spi1_init() is supported, chip select stays with the caller. There
+ * is no timeout, the bus has to be initialised and its clock running.
+ *
+ * SPI1 has a 4 byte FIFO, with BYTEN set RBNE comes per byte, so up to
+ * SPI_FAST_FIFO_DEPTH bytes are kept in flight. SPI0 has no FIFO and
+ * goes byte by byte, a second byte in flight overruns at PSC_2.
+ */
+
+#ifndef __SPI_FAST_H__
+#define __SPI_FAST_H__
+
+#include <stdint.h>
+#include "gd32e23x_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPI_FAST_FIFO_DEPTH		4
+#define SPI_FAST_DUMMY			0x00
+
+#define SPI_FAST_DATA8(periph)	(*(__IO uint8_t *) &SPI_DATA(periph))
+
+/**
+ * \brief Enable SPI for byte transfers and drop stale received data
+ *
+ * \param[in]  periph	SPI0 or SPI1
+ */
+static inline void spi_fast_begin(uint32_t periph) {
+	if (periph == SPI1) {
+		SPI_CTL1(periph) |= SPI_CTL1_BYTEN;
+	}
+	SPI_CTL0(periph) |= SPI_CTL0_SPIEN;
+	while (SPI_STAT(periph) & SPI_STAT_RBNE) {
+		(void) SPI_FAST_DATA8(periph);
+	}
+}
+
+/**
+ * \brief Exchange one byte
+ *
+ * \param[in]  periph	SPI0 or SPI1, after spi_fast_begin()
+ * \param[in]  value	Byte to send
+ *
+ * \return     Byte received meanwhile
+ */
+static inline uint8_t spi_fast_byte(uint32_t periph, uint8_t value) {
+	while (!(SPI_STAT(periph) & SPI_STAT_TBE)) {
+	}
+	SPI_FAST_DATA8(periph) = value;
+	while (!(SPI_STAT(periph) & SPI_STAT_RBNE)) {
+	}
+	return SPI_FAST_DATA8(periph);
+}
+
+/**
+ * \brief Exchange a buffer
+ *
+ * Returns when the last byte is clocked out, chip select may go high.
+ *
+ * \param[in]  periph	SPI0 or SPI1
+ * \param[in]  tx		Bytes to send, NULL sends SPI_FAST_DUMMY
+ * \param[out] rx		Received bytes, NULL drops them, may be tx
+ * \param[in]  length	Number of bytes
+ */
+static inline void spi_fast_transfer(uint32_t periph, const uint8_t * tx, uint8_t * rx,
+		uint16_t length) {
+	uint16_t depth = (periph == SPI1) ? SPI_FAST_FIFO_DEPTH : 1;
+	uint16_t sent = 0;
+	uint16_t received = 0;
+	uint8_t value;
+
+	spi_fast_begin(periph);
+	while (received < length) {
+		if ((sent < length) && (sent - received < depth)
+				&& (SPI_STAT(periph) & SPI_STAT_TBE)) {
+			SPI_FAST_DATA8(periph) = (tx != NULL) ? tx[sent] : SPI_FAST_DUMMY;
+			sent++;
+		}
+		if (SPI_STAT(periph) & SPI_STAT_RBNE) {
+			value = SPI_FAST_DATA8(periph);
+			if (rx != NULL) {
+				rx[received] = value;
+			}
+			received++;
+		}
+	}
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
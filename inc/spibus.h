@@ -0,0 +1,174 @@
+/**
+ * Shared SPI bus manager for LoggerSoft
+ *
+ * One spibus_t per SPI instance runs a queue of transfers, each for a
+ * spibus_device_t with its own chip select, prescaler and clock mode.
+ * A transfer drives CS low, switches the bus to the device settings if
+ * another device used it last, moves its bytes and raises CS again
+ * unless SPIBUS_HOLD_CS asks to continue the transaction with the next
+ * transfer, e.g. a command followed by its data.
+ *
+ * With DMA the queue runs from the DMA interrupt: transfers submitted
+ * back to back, a sensor read and a flash append say, follow each other
+ * without the CPU, completion callbacks run in the interrupt and may
+ * submit further transfers. Without DMA spibus_submit() runs the queue
+ * with spi_fast_transfer() before it returns.
+ *
+ * DMA channels are fixed per instance: SPI0 has channels 1 (RX) and
+ * 2 (TX), SPI1 has 3 and 4, which the console takes for USART1, so
+ * SPI1 polls with USE_CONSOLE. It also polls with USE_FHSS, the DIO1
+ * interrupt talks to the radio on SPI1 and must not meet a transfer
+ * running in the background.
+ *
+ * The radio driver keeps its own register path on SPI1 and relies on
+ * the msd_spi1_init() settings there, so the bus still has one owner at
+ * a time: the driver waits with spibus_idle_wait() for the queue to
+ * drain before it selects the module, and its DIO1 interrupt, given to
+ * spibus_guard(), is masked from the moment a transfer is queued until
+ * the queue is empty and no device holds CS.
+ *
+ * Transfer structures must stay valid until done is set.
+ */
+
+#ifndef __SPIBUS_H__
+#define __SPIBUS_H__
+
+#include <stdint.h>
+#include "gd32e23x_hal.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define SPIBUS_HOLD_CS		0x01	// keep CS low, the next transfer continues the transaction
+
+#define SPIBUS_MODE_MASK	(SPI_CTL0_PSC | SPI_CTL0_CKPL | SPI_CTL0_CKPH)
+
+typedef struct {
+	uint32_t cs_port;		// GPIOx
+	uint32_t cs_pin;		// GPIO_PIN_x
+	uint32_t mode;			// SPI_PSC_* | SPI_CK_PL_*_PH_*
+} spibus_device_t;
+
+typedef struct spibus_xfer spibus_xfer_t;
+
+struct spibus_xfer {
+	const spibus_device_t * device;
+	const uint8_t * tx;		// NULL sends SPI_FAST_DUMMY
+	uint8_t * rx;			// NULL drops received bytes
+	uint16_t length;
+	uint8_t flags;			// SPIBUS_HOLD_CS
+	volatile uint8_t done;	// set when finished, before callback
+	void (*callback)(spibus_xfer_t * xfer);	// may be NULL
+	spibus_xfer_t * next;	// queue link, owned by the bus
+};
+
+typedef struct {
+	uint32_t periph;		// SPI0 or SPI1
+	uint8_t dma;			// run transfers on DMA
+	dma_channel_enum dma_rx;
+	dma_channel_enum dma_tx;
+	spibus_xfer_t * volatile head;	// running transfer
+	spibus_xfer_t * tail;
+	const spibus_device_t * selected;	// CS held low
+	volatile uint8_t busy;	// head is running on DMA
+	uint8_t dummy;			// DMA source of SPI_FAST_DUMMY
+	uint8_t sink;			// DMA destination of dropped bytes
+	uint8_t guard;			// guard_irq is set
+	IRQn_Type guard_irq;	// uses the bus outside the queue, masked while it is in use
+} spibus_t;
+
+extern spibus_t spibus0;
+extern spibus_t spibus1;
+
+/**
+ * \brief Bus of an SPI instance
+ *
+ * \param[in]  periph	SPI0 or SPI1
+ *
+ * \return     spibus0 or spibus1
+ */
+static inline spibus_t * spibus_of(uint32_t periph) {
+	return (periph == SPI0) ? &spibus0 : &spibus1;
+}
+
+/**
+ * \brief Set up bus after msd_spiX_init()
+ *
+ * \param[in]  bus		Bus to set up, its queue has to be empty
+ * \param[in]  periph	SPI0 or SPI1
+ * \param[in]  dma		1 to run transfers on DMA
+ */
+void spibus_init(spibus_t * bus, uint32_t periph, uint8_t dma);
+
+/**
+ * \brief Mask an interrupt while the bus is in use
+ *
+ * For an interrupt handler that talks to a device on the bus without the
+ * queue. Kept over spibus_init().
+ *
+ * \param[in]  bus		Bus of the device
+ * \param[in]  irq		Interrupt of the handler
+ */
+void spibus_guard(spibus_t * bus, IRQn_Type irq);
+
+/**
+ * \brief Wait until all queued transfers are done
+ *
+ * For drivers that use the bus without the queue.
+ *
+ * \param[in]  bus		Bus to wait for
+ */
+void spibus_idle_wait(spibus_t * bus);
+
+/**
+ * \brief Queue a transfer
+ *
+ * \param[in]  bus		Bus of the device
+ * \param[in]  xfer		Transfer, device, buffers, length, flags and
+ *                      callback filled in
+ */
+void spibus_submit(spibus_t * bus, spibus_xfer_t * xfer);
+
+/**
+ * \brief Wait for a queued transfer
+ *
+ * \param[in]  xfer		Submitted transfer
+ */
+void spibus_wait(spibus_xfer_t * xfer);
+
+/**
+ * \brief Queue a transfer and wait for it
+ *
+ * \param[in]  bus		Bus of the device
+ * \param[in]  device	Target device
+ * \param[in]  tx		Bytes to send, NULL sends SPI_FAST_DUMMY
+ * \param[out] rx		Received bytes, NULL drops them
+ * \param[in]  length	Number of bytes
+ * \param[in]  flags	SPIBUS_HOLD_CS
+ */
+void spibus_transfer(spibus_t * bus, const spibus_device_t * device,
+		const uint8_t * tx, uint8_t * rx, uint16_t length, uint8_t flags);
+
+/**
+ * \brief End a transaction held with SPIBUS_HOLD_CS
+ *
+ * Raises CS once the queue is empty, nothing if the device is not selected.
+ *
+ * \param[in]  bus		Bus of the device
+ * \param[in]  device	Device holding CS
+ */
+void spibus_release(spibus_t * bus, const spibus_device_t * device);
+
+/**
+ * \brief Handle DMA interrupt of the bus
+ *
+ * \param[in]  bus		Bus on the interrupting channels
+ */
+void spibus_dma_irq(spibus_t * bus);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
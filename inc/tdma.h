@@ -0,0 +1,114 @@
+/**
+ * Beacon-synchronized TDMA uplinks for LoggerSoft
+ *
+ * The gateway sends beacon_t at every multiple of TDMA_PERIOD_S of its
+ * time of day. On a beacon the node sets its RTC to the gateway time,
+ * takes its slot and moves the uplink task onto it. Uplink and beacon
+ * tasks are then in sched.exact and woken on their deadline, the last
+ * second is waited out with the sub-second RTC counter.
+ *
+ * Clock drift is measured as the error found at each beacon over the
+ * time since the previous one. Wake-ups are corrected by the drift and
+ * the beacon window is opened a guard time early:
+ *   guard = TDMA_GUARD_MIN_MS + time since sync * jitter
+ * where jitter is the mean deviation of the drift estimates. It starts at
+ * TDMA_DRIFT_INIT_PPM and shrinks as the drift estimate settles.
+ *
+ * Without sync the node listens for a whole period (a scan), repeated
+ * every TDMA_RESCAN_S, and sends its uplinks unslotted meanwhile. After
+ * TDMA_MAX_MISSED beacons missed in a row the sync is dropped.
+ */
+
+#ifndef __TDMA_H__
+#define __TDMA_H__
+
+#include <stdint.h>
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint8_t synced;				// RTC follows the gateway, uplinks are slotted
+	uint8_t received;			// beacon received in the current window
+	uint8_t missed;				// beacons missed in a row
+	uint8_t assigned;			// slot was assigned by the gateway
+	uint16_t slot;				// own slot, 1..slot_count
+	uint16_t slot_ms;			// from last beacon
+	uint16_t slot_count;
+	uint16_t guard_ms;
+	uint32_t slot_end;			// hal_basetick at the end of the own slot, after tdma_slot_wait()
+	uint32_t sync_s;			// sched_clock() at last sync, a whole gateway second
+	uint32_t beacon_ms;			// gateway time of next beacon, [ms] after sync_s
+	uint32_t window_ms;			// length of next beacon window
+	uint32_t scan_s;			// next scan while not synchronized, sched_clock() scale
+	int32_t drift_ppm;			// local clock rate error, positive if fast
+	int32_t jitter_ppm;			// mean deviation of drift estimates
+	uint8_t drift_known;		// drift_ppm holds a measurement
+	uint32_t beacons;			// beacons received since power-up
+	uint32_t misses;			// beacons missed since power-up
+} tdma_t;
+
+extern tdma_t tdma;
+
+/**
+ * \brief Start unsynchronized, first scan right away
+ */
+void tdma_init(void);
+
+/**
+ * \brief Prepare a beacon window
+ *
+ * Waits for the window start if synchronized.
+ *
+ * \return     Window length in [ms]
+ */
+uint32_t tdma_window_open(void);
+
+/**
+ * \brief Handle DOWNLINK_TYPE_BEACON
+ *
+ * Call as soon as the frame is received, its arrival time is the time
+ * reference. May wait up to one second to set the RTC on a whole second.
+ *
+ * \param[in]  payload	Frame without downlink_header_t
+ * \param[in]  length	Payload length
+ */
+void tdma_beacon(const uint8_t * payload, uint8_t length);
+
+/**
+ * \brief Account for a window without beacon, schedule the next one
+ */
+void tdma_window_close(void);
+
+/**
+ * \brief Put beacon and uplink deadlines on the TDMA frame
+ *
+ * Call after sched_done(), which moves deadlines by whole periods only.
+ * Uplink periods that are no multiple of TDMA_PERIOD_S are stretched to
+ * the next own slot.
+ */
+void tdma_align(void);
+
+/**
+ * \brief Wait for own slot
+ *
+ * Call on the SCHED_UPLINK wake-up. Returns at once if not synchronized.
+ *
+ * \return     1 to send now, 0 if the slot was missed
+ */
+uint8_t tdma_slot_wait(void);
+
+/**
+ * \brief Time left in the own slot
+ *
+ * \return     [ms] after tdma_slot_wait() returned 1, no limit if it was unslotted
+ */
+uint32_t tdma_slot_left(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
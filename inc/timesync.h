@@ -0,0 +1,70 @@
+/**
+ * Wall time from gateway ACKs for LoggerSoft
+ *
+ * Every downlink_ack_t carries the gateway Unix time at the end of its
+ * transmission, so the node learns wall time in the receive window it
+ * opens after each uplink anyway, without extra wake-ups.
+ *
+ * The node keeps wall time as an offset to sched_uptime(). When the
+ * clock is off by more than TIME_SYNC_MAX_ERROR_MS, the RTC is set to
+ * the gateway time of day after the receive window, on a gateway second
+ * boundary. Record times are then Unix time to within
+ * TIME_SYNC_MAX_ERROR_MS plus the drift since the last ACK.
+ */
+
+#ifndef __TIMESYNC_H__
+#define __TIMESYNC_H__
+
+#include <stdint.h>
+#include "packet.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint8_t synced;				// offset_s holds a gateway time
+	uint8_t pending;			// ACK time waits for timesync_apply()
+	uint32_t rx_s;				// sched_clock_fine() at ACK reception
+	uint16_t rx_ms;
+	uint32_t gateway_s;			// gateway Unix time at ACK reception
+	uint16_t gateway_ms;
+	uint32_t offset_s;			// Unix time - sched_uptime()
+	int32_t error_ms;			// local - gateway time at last ACK
+	uint32_t steps;				// RTC corrections since power-up
+} timesync_t;
+
+extern timesync_t timesync;
+
+/**
+ * \brief Take gateway time from DOWNLINK_TYPE_ACK
+ *
+ * Call as soon as the frame is received, its arrival time is the time
+ * reference.
+ *
+ * \param[in]  payload	Frame without downlink_header_t
+ * \param[in]  length	Payload length
+ */
+void timesync_ack(const uint8_t * payload, uint8_t length);
+
+/**
+ * \brief Correct the RTC after the receive window
+ *
+ * May wait up to one second for a gateway second boundary.
+ */
+void timesync_apply(void);
+
+/**
+ * \brief Wall time of an uptime
+ *
+ * \param[in]  uptime	sched_uptime() value
+ *
+ * \return     Unix time if synchronized, uptime otherwise
+ */
+uint32_t timesync_time(uint32_t uptime);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -14,51 +14,60 @@
 #include <string.h>
 
 uint8_t SX1278_SPIRead(SX1278_t * module, uint8_t addr) {
-	uint8_t tmp;
-	SX1278_hw_SetNSS(module->hw, 0);
-	SX1278_hw_SPICommand(module->hw, addr);
-	tmp = SX1278_hw_SPIReadByte(module->hw);
-	SX1278_hw_SetNSS(module->hw, 1);
-	return tmp;
+	uint8_t frame[2] = { addr, 0x00 };
+
+	SX1278_hw_Select(module->hw);
+	SX1278_hw_SPITransfer(module->hw, frame, frame, 2);
+	SX1278_hw_Unselect(module->hw);
+	return frame[1];
 }
 
 void SX1278_SPIWrite(SX1278_t * module, uint8_t addr, uint8_t cmd) {
-	SX1278_hw_SetNSS(module->hw, 0);
-	SX1278_hw_SPICommand(module->hw, addr | 0x80);
-	SX1278_hw_SPICommand(module->hw, cmd);
-	SX1278_hw_SetNSS(module->hw, 1);
+	uint8_t frame[2] = { addr | 0x80, cmd };
+
+	SX1278_hw_Select(module->hw);
+	SX1278_hw_SPITransfer(module->hw, frame, NULL, 2);
+	SX1278_hw_Unselect(module->hw);
 }
 
 void SX1278_SPIBurstRead(SX1278_t * module, uint8_t addr, uint8_t * rxBuf,
 		uint8_t length) {
-	uint8_t i;
 	if (length <= 1) {
 		return;
 	} else {
-		SX1278_hw_SetNSS(module->hw, 0);
-		SX1278_hw_SPICommand(module->hw, addr);
-		for (i = 0; i < length; i++) {
-			*(rxBuf + i) = SX1278_hw_SPIReadByte(module->hw);
-		}
-		SX1278_hw_SetNSS(module->hw, 1);
+		SX1278_hw_Select(module->hw);
+		SX1278_hw_SPITransfer(module->hw, &addr, NULL, 1);
+		SX1278_hw_SPITransfer(module->hw, NULL, rxBuf, length);
+		SX1278_hw_Unselect(module->hw);
 	}
 }
 
 void SX1278_SPIBurstWrite(SX1278_t * module, uint8_t addr, uint8_t * txBuf,
 		uint8_t length) {
-	unsigned char i;
 	if (length <= 1) {
 		return;
 	} else {
-		SX1278_hw_SetNSS(module->hw, 0);
-		SX1278_hw_SPICommand(module->hw, addr | 0x80);
-		for (i = 0; i < length; i++) {
-			SX1278_hw_SPICommand(module->hw, *(txBuf + i));
-		}
-		SX1278_hw_SetNSS(module->hw, 1);
+		addr |= 0x80;
+		SX1278_hw_Select(module->hw);
+		SX1278_hw_SPITransfer(module->hw, &addr, NULL, 1);
+		SX1278_hw_SPITransfer(module->hw, txBuf, NULL, length);
+		SX1278_hw_Unselect(module->hw);
 	}
 }
 
+static void SX1278_settings(SX1278_t * module, SX1278_settings_t * settings) {
+	memset(settings, 0, sizeof(SX1278_settings_t));
+	settings->power = module->power;
+	settings->LoRa_SF = module->LoRa_SF;
+	settings->LoRa_BW = module->LoRa_BW;
+	settings->LoRa_CR = module->LoRa_CR;
+	settings->LoRa_CRC_sum = module->LoRa_CRC_sum;
+	settings->sync_word = module->sync_word;
+	settings->implicit_header = module->implicit_header;
+	settings->preamble = module->preamble;
+	settings->symbol_timeout = module->symbol_timeout;
+}
+
 void SX1278_config(SX1278_t * module) {
 	SX1278_sleep(module); //Change modem mode Must in Sleep mode
 	SX1278_hw_DelayMs(15);
@@ -66,12 +75,7 @@ void SX1278_config(SX1278_t * module) {
 	SX1278_entryLoRa(module);
 	//SX1278_SPIWrite(module, 0x5904); //?? Change digital regulator form 1.6V to 1.47V: see errata note
 
-	uint64_t freq = ((uint64_t) module->frequency << 19) / 32000000;
-	uint8_t freq_reg[3];
-	freq_reg[0] = (uint8_t) (freq >> 16);
-	freq_reg[1] = (uint8_t) (freq >> 8);
-	freq_reg[2] = (uint8_t) (freq >> 0);
-	SX1278_SPIBurstWrite(module, LR_RegFrMsb, (uint8_t*) freq_reg, 3); //setting  frequency parameter
+	SX1278_SPIBurstWrite(module, LR_RegFrMsb, module->frf, 3); //setting  frequency parameter
 
 	SX1278_SPIWrite(module, RegSyncWord, module->sync_word);
 
@@ -90,7 +94,8 @@ void SX1278_config(SX1278_t * module) {
 		SX1278_SPIWrite(module,
 		LR_RegModemConfig2,
 				((SX1278_SpreadFactor[module->LoRa_SF] << 4)
-						+ (SX1278_CRC_Sum[module->LoRa_CRC_sum] << 2) + 0x03));
+						+ (SX1278_CRC_Sum[module->LoRa_CRC_sum] << 2)
+						+ ((module->symbol_timeout >> 8) & 0x03)));
 
 		tmp = SX1278_SPIRead(module, 0x31);
 		tmp &= 0xF8;
@@ -101,23 +106,112 @@ void SX1278_config(SX1278_t * module) {
 		SX1278_SPIWrite(module,
 		LR_RegModemConfig1,
 				((SX1278_LoRaBandwidth[module->LoRa_BW] << 4)
-						+ (SX1278_CodingRate[module->LoRa_CR] << 1) + 0x00)); //Explicit Enable CRC Enable(0x02) & Error Coding rate 4/5(0x01), 4/6(0x02), 4/7(0x03), 4/8(0x04)
+						+ (SX1278_CodingRate[module->LoRa_CR] << 1)
+						+ (module->implicit_header ? 0x01 : 0x00))); //Explicit or Implicit Header & Error Coding rate 4/5(0x01), 4/6(0x02), 4/7(0x03), 4/8(0x04)
 
 		SX1278_SPIWrite(module,
 		LR_RegModemConfig2,
 				((SX1278_SpreadFactor[module->LoRa_SF] << 4)
-						+ (SX1278_CRC_Sum[module->LoRa_CRC_sum] << 2) + 0x00)); //SFactor &  LNA gain set by the internal AGC loop
+						+ (SX1278_CRC_Sum[module->LoRa_CRC_sum] << 2)
+						+ ((module->symbol_timeout >> 8) & 0x03))); //SFactor & SymbTimeout(9:8)
 	}
 
 	SX1278_SPIWrite(module, LR_RegModemConfig3, 0x04);
-	SX1278_SPIWrite(module, LR_RegSymbTimeoutLsb, 0x08); //RegSymbTimeoutLsb Timeout = 0x3FF(Max)
-	SX1278_SPIWrite(module, LR_RegPreambleMsb, 0x00); //RegPreambleMsb
-	SX1278_SPIWrite(module, LR_RegPreambleLsb, 8); //RegPreambleLsb 8+4=12byte Preamble
+	SX1278_SPIWrite(module, LR_RegSymbTimeoutLsb, (uint8_t) module->symbol_timeout); //RegSymbTimeoutLsb Timeout = 0x3FF(Max)
+	SX1278_SPIWrite(module, LR_RegPreambleMsb, (uint8_t) (module->preamble >> 8)); //RegPreambleMsb
+	SX1278_SPIWrite(module, LR_RegPreambleLsb, (uint8_t) module->preamble); //RegPreambleLsb preamble+4.25 symbols
 	SX1278_SPIWrite(module, REG_LR_DIOMAPPING2, 0x01); //RegDioMapping2 DIO5=00, DIO4=01
 	module->readBytes = 0;
+	SX1278_settings(module, &module->applied);
+	module->configured = 1;
 	SX1278_standby(module); //Entry standby mode
 }
 
+void SX1278_update_config(SX1278_t * module) {
+	SX1278_settings_t settings;
+
+	SX1278_settings(module, &settings);
+	if (!module->configured || (memcmp(&settings, &module->applied, sizeof(settings)) != 0)) {
+		SX1278_config(module);
+		return;
+	}
+	// FIFO is not accessible in sleep, FHSS may have left another channel
+	SX1278_standby(module);
+	SX1278_SPIBurstWrite(module, LR_RegFrMsb, module->frf, 3);
+	module->readBytes = 0;
+}
+
+void SX1278_frf(uint64_t frequency, uint8_t * frf) {
+	uint64_t freq = (frequency << 19) / 32000000;
+	frf[0] = (uint8_t) (freq >> 16);
+	frf[1] = (uint8_t) (freq >> 8);
+	frf[2] = (uint8_t) (freq >> 0);
+}
+
+void SX1278_set_frf(SX1278_t * module, const uint8_t * frf) {
+	memcpy(module->frf, frf, 3);
+	SX1278_SPIBurstWrite(module, LR_RegFrMsb, module->frf, 3);
+}
+
+static const uint32_t SX1278_BandwidthHz[10] = { 7800, 10400, 15600, 20800,
+		31250, 41700, 62500, 125000, 250000, 500000 };
+
+uint32_t SX1278_symbol_us(SX1278_t * module) {
+	return (1000000UL << SX1278_SpreadFactor[module->LoRa_SF])
+			/ SX1278_BandwidthHz[module->LoRa_BW];
+}
+
+int SX1278_set_preamble(SX1278_t * module, uint16_t preamble, uint16_t symbol_timeout) {
+	uint32_t symbol_us = SX1278_symbol_us(module);
+	uint32_t settle = (SX1278_RX_SETTLE_US + symbol_us - 1) / symbol_us;
+
+	if ((preamble < SX1278_PREAMBLE_MIN + settle)
+			|| (symbol_timeout < SX1278_SYMBOL_TIMEOUT_MIN + settle)
+			|| (symbol_timeout > SX1278_SYMBOL_TIMEOUT_MAX)
+			|| ((symbol_timeout < preamble) && (symbol_timeout < SX1278_SYMBOL_TIMEOUT_MAX))) {
+		return 0;
+	}
+	module->preamble = preamble;
+	module->symbol_timeout = symbol_timeout;
+	return 1;
+}
+
+uint32_t SX1278_time_on_air_us(SX1278_t * module, uint8_t length, uint8_t implicit) {
+	int32_t sf = SX1278_SpreadFactor[module->LoRa_SF];
+	int32_t crc = (module->LoRa_CRC_sum == SX1278_LORA_CRC_EN) ? 16 : 0;
+	int32_t bits = 8 * length - 4 * sf + 28 + crc - (implicit ? 20 : 0);
+	// preamble + 4.25 sync symbols + 8 symbols, in quarter symbols
+	uint32_t quarters = 4 * (uint32_t) module->preamble + 17 + 4 * 8;
+
+	if (bits > 0) {
+		quarters += 4 * ((bits + 4 * sf - 1) / (4 * sf))
+				* (SX1278_CodingRate[module->LoRa_CR] + 4);
+	}
+	return ((uint64_t) quarters << sf) * 1000000
+			/ (4 * SX1278_BandwidthHz[module->LoRa_BW]);
+}
+
+void SX1278_set_fhss(SX1278_t * module, const uint8_t (*table)[3], uint8_t count,
+		uint8_t period, uint8_t min_sf) {
+	module->hop_table = table;
+	module->hop_count = count;
+	module->hop_period = (count != 0) ? period : 0;
+	module->hop_min_sf = min_sf;
+}
+
+// hop period of the current settings, 0 if the frame does not hop
+static uint8_t SX1278_hop_period(SX1278_t * module) {
+	return (module->LoRa_SF >= module->hop_min_sf) ? module->hop_period : 0;
+}
+
+void SX1278_hop(SX1278_t * module) {
+	uint8_t channel = SX1278_SPIRead(module, LR_RegHopChannel) & 0x3F;
+
+	SX1278_SPIBurstWrite(module, LR_RegFrMsb,
+			(uint8_t*) module->hop_table[channel % module->hop_count], 3);
+	SX1278_SPIWrite(module, LR_RegIrqFlags, 0x02); //clear FhssChangeChannel only
+}
+
 void SX1278_standby(SX1278_t * module) {
 	SX1278_SPIWrite(module, LR_RegOpMode, 0x09);
 	module->status = STANDBY;
@@ -141,11 +235,17 @@ int SX1278_LoRaEntryRx(SX1278_t * module, uint8_t length, uint32_t timeout) {
 
 	module->packetLength = length;
 
-	SX1278_config(module);		//Setting base parameter
+	SX1278_update_config(module);		//Setting base parameter
 	SX1278_SPIWrite(module, REG_LR_PADAC, 0x84);	//Normal and RX
-	SX1278_SPIWrite(module, LR_RegHopPeriod, 0xFF);	//No FHSS
-	SX1278_SPIWrite(module, REG_LR_DIOMAPPING1, 0x01);//DIO=00,DIO1=00,DIO2=00, DIO3=01
-	SX1278_SPIWrite(module, LR_RegIrqFlagsMask, 0x3F);//Open RxDone interrupt & Timeout
+	if (SX1278_hop_period(module)) {
+		SX1278_SPIWrite(module, LR_RegHopPeriod, SX1278_hop_period(module));
+		SX1278_SPIWrite(module, REG_LR_DIOMAPPING1, 0x11);//DIO0=00,DIO1=01 FhssChangeChannel,DIO3=01
+		SX1278_SPIWrite(module, LR_RegIrqFlagsMask, 0x3D);//Open RxDone, Timeout & FhssChangeChannel
+	} else {
+		SX1278_SPIWrite(module, LR_RegHopPeriod, 0xFF);	//No FHSS
+		SX1278_SPIWrite(module, REG_LR_DIOMAPPING1, 0x01);//DIO=00,DIO1=00,DIO2=00, DIO3=01
+		SX1278_SPIWrite(module, LR_RegIrqFlagsMask, 0x3F);//Open RxDone interrupt & Timeout
+	}
 	SX1278_clearLoRaIrq(module);
 	SX1278_SPIWrite(module, LR_RegPayloadLength, length);//Payload Length 21byte(this register must difine when the data long of one byte in SF is 6)
 	addr = SX1278_SPIRead(module, LR_RegFifoRxBaseAddr); //Read RxBaseAddr
@@ -178,7 +278,7 @@ uint8_t SX1278_LoRaRxPacket(SX1278_t * module) {
 		addr = SX1278_SPIRead(module, LR_RegFifoRxCurrentaddr); //last packet addr
 		SX1278_SPIWrite(module, LR_RegFifoAddrPtr, addr); //RxBaseAddr -> FiFoAddrPtr
 
-		if (module->LoRa_SF == SX1278_LORA_SF_6) { //When SpreadFactor is six,will used Implicit Header mode(Excluding internal packet length)
+		if ((module->LoRa_SF == SX1278_LORA_SF_6) || module->implicit_header) { //Implicit Header mode(Excluding internal packet length), always when SpreadFactor is six
 			packet_size = module->packetLength;
 		} else {
 			packet_size = SX1278_SPIRead(module, LR_RegRxNbBytes); //Number for received bytes
@@ -197,12 +297,19 @@ int SX1278_LoRaEntryTx(SX1278_t * module, uint8_t length, uint32_t timeout) {
 
 	module->packetLength = length;
 
-	SX1278_config(module); //setting base parameter
+	SX1278_update_config(module); //setting base parameter
 	SX1278_SPIWrite(module, REG_LR_PADAC, 0x87);	//Tx for 20dBm
-	SX1278_SPIWrite(module, LR_RegHopPeriod, 0x00); //RegHopPeriod NO FHSS
-	SX1278_SPIWrite(module, REG_LR_DIOMAPPING1, 0x41); //DIO0=01, DIO1=00,DIO2=00, DIO3=01
-	SX1278_clearLoRaIrq(module);
-	SX1278_SPIWrite(module, LR_RegIrqFlagsMask, 0xF7); //Open TxDone interrupt
+	if (SX1278_hop_period(module)) {
+		SX1278_SPIWrite(module, LR_RegHopPeriod, SX1278_hop_period(module));
+		SX1278_SPIWrite(module, REG_LR_DIOMAPPING1, 0x51); //DIO0=01, DIO1=01 FhssChangeChannel, DIO3=01
+		SX1278_clearLoRaIrq(module);
+		SX1278_SPIWrite(module, LR_RegIrqFlagsMask, 0xF5); //Open TxDone & FhssChangeChannel interrupt
+	} else {
+		SX1278_SPIWrite(module, LR_RegHopPeriod, 0x00); //RegHopPeriod NO FHSS
+		SX1278_SPIWrite(module, REG_LR_DIOMAPPING1, 0x41); //DIO0=01, DIO1=00,DIO2=00, DIO3=01
+		SX1278_clearLoRaIrq(module);
+		SX1278_SPIWrite(module, LR_RegIrqFlagsMask, 0xF7); //Open TxDone interrupt
+	}
 	SX1278_SPIWrite(module, LR_RegPayloadLength, length); //RegPayloadLength 21byte
 	addr = SX1278_SPIRead(module, LR_RegFifoTxBaseAddr); //RegFiFoTxBaseAddr
 	SX1278_SPIWrite(module, LR_RegFifoAddrPtr, 0x80); //RegFifoAddrPtr, pass addr instead of 0x80
@@ -224,10 +331,12 @@ int SX1278_LoRaEntryTx(SX1278_t * module, uint8_t length, uint32_t timeout) {
 	}
 }
 
-int SX1278_LoRaTxPacket(SX1278_t * module, uint8_t * txBuffer, uint8_t length,
-		uint32_t timeout) {
+void SX1278_LoRaTxStart(SX1278_t * module, uint8_t * txBuffer, uint8_t length) {
 	SX1278_SPIBurstWrite(module, 0x00, txBuffer, length);
 	SX1278_SPIWrite(module, LR_RegOpMode, 0x8b);	//Tx Mode
+}
+
+int SX1278_LoRaTxWait(SX1278_t * module, uint32_t timeout) {
 	while (1) {
 		if (SX1278_hw_GetDIO0(module->hw)) { //if(Get_NIRQ()) //Packet send over
 			SX1278_SPIRead(module, LR_RegIrqFlags);
@@ -245,11 +354,18 @@ int SX1278_LoRaTxPacket(SX1278_t * module, uint8_t * txBuffer, uint8_t length,
 	}
 }
 
+int SX1278_LoRaTxPacket(SX1278_t * module, uint8_t * txBuffer, uint8_t length,
+		uint32_t timeout) {
+	SX1278_LoRaTxStart(module, txBuffer, length);
+	return SX1278_LoRaTxWait(module, timeout);
+}
+
 void SX1278_init(SX1278_t * module, uint64_t frequency, uint8_t power,
 		uint8_t LoRa_SF, uint8_t LoRa_BW, uint8_t LoRa_CR, uint8_t LoRa_CRC_sum,
 		uint8_t packetLength) {
 	SX1278_hw_init(module->hw);
 	module->frequency = frequency;
+	SX1278_frf(frequency, module->frf);
 	module->power = power;
 	module->LoRa_SF = LoRa_SF;
 	module->LoRa_BW = LoRa_BW;
@@ -257,6 +373,8 @@ void SX1278_init(SX1278_t * module, uint64_t frequency, uint8_t power,
 	module->LoRa_CRC_sum = LoRa_CRC_sum;
 	module->packetLength = packetLength;
 	module->sync_word = SX127X_SYNC_WORD_DEFAULT;
+	module->preamble = SX1278_PREAMBLE_DEFAULT;
+	module->symbol_timeout = SX1278_SYMBOL_TIMEOUT_DEFAULT;
 	SX1278_config(module);
 }
 
@@ -265,6 +383,7 @@ void SX1278_init_with_sync_word(SX1278_t * module, uint64_t frequency,
 		uint8_t LoRa_CRC_sum, uint8_t packetLength, uint8_t sync_word) {
 	SX1278_hw_init(module->hw);
 	module->frequency = frequency;
+	SX1278_frf(frequency, module->frf);
 	module->power = power;
 	module->LoRa_SF = LoRa_SF;
 	module->LoRa_BW = LoRa_BW;
@@ -272,6 +391,8 @@ void SX1278_init_with_sync_word(SX1278_t * module, uint64_t frequency,
 	module->LoRa_CRC_sum = LoRa_CRC_sum;
 	module->packetLength = packetLength;
 	module->sync_word = sync_word;
+	module->preamble = SX1278_PREAMBLE_DEFAULT;
+	module->symbol_timeout = SX1278_SYMBOL_TIMEOUT_DEFAULT;
 	SX1278_config(module);
 }
 
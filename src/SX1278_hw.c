@@ -12,46 +12,77 @@
 #include "SX1278_hw.h"
 #include <string.h>
 
-#include "gd32e23x_hal_gpio.h"
 #include "gd32e23x_hal_spi.h"
+#include "gpio_fast.h"
+#include "spi_fast.h"
+
+#define SX1278_HW_NSS		SX_NSS_GPIO_Port, SX_NSS_Pin
+#define SX1278_HW_RESET		SX_RESET_GPIO_Port, SX_RESET_Pin
+#define SX1278_HW_DIO0		SX_DIO0_GPIO_Port, SX_DIO0_Pin
 
 void SX1278_hw_init(SX1278_hw_t * hw) {
-	SX1278_hw_SetNSS(hw, 1);
-	hal_gpio_bit_write(hw->reset.port, hw->reset.pin, SET);
+	SX1278_hw_Unselect(hw);
+	gpio_fast_high(SX1278_HW_RESET);
 }
 
 void SX1278_hw_SetNSS(SX1278_hw_t * hw, int value) {
-	hal_gpio_bit_write(hw->nss.port, hw->nss.pin,
-			(value == 1) ? SET : RESET);
+	if (value == 1) {
+		SX1278_hw_Unselect(hw);
+	} else {
+		SX1278_hw_Select(hw);
+	}
+}
+
+void SX1278_hw_irq_hold(SX1278_hw_t * hw) {
+	if (hw->dio1_irq_used) {
+		NVIC_DisableIRQ(hw->dio1_irq);
+	}
+}
+
+void SX1278_hw_irq_release(SX1278_hw_t * hw) {
+	if (hw->dio1_irq_used) {
+		NVIC_EnableIRQ(hw->dio1_irq);
+	}
+}
+
+void SX1278_hw_Select(SX1278_hw_t * hw) {
+#ifdef USE_SPI_BUS
+	// queued transfers of the other devices go first, the DIO1 handler never waits here
+	spibus_idle_wait(spibus_of(hw->spi->periph));
+#endif // USE_SPI_BUS
+	SX1278_hw_irq_hold(hw);
+	gpio_fast_low(SX1278_HW_NSS);
+}
+
+void SX1278_hw_Unselect(SX1278_hw_t * hw) {
+	gpio_fast_high(SX1278_HW_NSS);
+	SX1278_hw_irq_release(hw);
 }
 
 void SX1278_hw_Reset(SX1278_hw_t * hw) {
-	SX1278_hw_SetNSS(hw, 1);
-	hal_gpio_bit_write(hw->reset.port, hw->reset.pin, RESET);
+	SX1278_hw_Unselect(hw);
+	gpio_fast_low(SX1278_HW_RESET);
 
 	SX1278_hw_DelayMs(1); // at least 100 us
 
-	hal_gpio_bit_write(hw->reset.port, hw->reset.pin, SET);
+	gpio_fast_high(SX1278_HW_RESET);
 
 	SX1278_hw_DelayMs(10); // delay should be 5 ms minimum according to chip manual
 }
 
 void SX1278_hw_SPICommand(SX1278_hw_t * hw, uint8_t cmd) {
-	SX1278_hw_SetNSS(hw, 0);
-	hal_spi_transmit_poll(hw->spi, &cmd, 1, 1000);
-	while (hw->spi->state != HAL_SPI_STATE_READY) {
-	}
+	spi_fast_begin(hw->spi->periph);
+	(void) spi_fast_byte(hw->spi->periph, cmd);
 }
 
 uint8_t SX1278_hw_SPIReadByte(SX1278_hw_t * hw) {
-	uint8_t txByte = 0x00;
-	uint8_t rxByte = 0x00;
+	spi_fast_begin(hw->spi->periph);
+	return spi_fast_byte(hw->spi->periph, 0x00);
+}
 
-	SX1278_hw_SetNSS(hw, 0);
-	hal_spi_transmit_receive_poll(hw->spi, &txByte, &rxByte, 1, 1000);
-	while (hw->spi->state != HAL_SPI_STATE_READY) {
-	}
-	return rxByte;
+void SX1278_hw_SPITransfer(SX1278_hw_t * hw, const uint8_t * tx, uint8_t * rx,
+		uint8_t length) {
+	spi_fast_transfer(hw->spi->periph, tx, rx, length);
 }
 
 void SX1278_hw_DelayMs(uint32_t msec) {
@@ -59,7 +90,7 @@ void SX1278_hw_DelayMs(uint32_t msec) {
 }
 
 int SX1278_hw_GetDIO0(SX1278_hw_t * hw) {
-	return (hal_gpio_output_bit_get(hw->dio0.port, hw->dio0.pin) == SET);
+	return gpio_fast_read(SX1278_HW_DIO0);
 }
 
 #endif // USE_RA_01_SENDER
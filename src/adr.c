@@ -0,0 +1,86 @@
+/**
+ * Adaptive data rate for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_ADR
+
+#include <string.h>
+#include "adr.h"
+#include "SX1278.h"
+
+// demodulation floor per SX1278_LORA_SF_* [0.25 dB], SX1276/77/78 datasheet
+static const int8_t adr_floor[] = { -20, -30, -40, -50, -60, -70, -80 };
+
+adr_t adr;
+
+void adr_init(uint8_t sf, uint8_t power) {
+	memset(&adr, 0, sizeof(adr));
+	adr.sf = sf;
+	adr.power = power;
+	adr.margin_db = ADR_MARGIN_UNKNOWN;
+}
+
+void adr_sent(uint32_t msg_id, uint8_t sf) {
+	adr.expected = msg_id;
+	adr.sent_sf = sf;
+	adr.acked = 0;
+}
+
+void adr_downlink(const uint8_t * payload, uint8_t length) {
+	downlink_ack_t ack;
+	int16_t margin;
+
+	if (length < sizeof(ack)) {
+		return;
+	}
+	memcpy(&ack, payload, sizeof(ack));
+	if ((ack.msg_id != adr.expected) || adr.acked) {
+		return;
+	}
+
+	adr.acked = 1;
+	adr.snr = ack.snr;
+	adr.rssi = ack.rssi;
+
+	margin = (ack.snr - adr_floor[adr.sent_sf]) / 4;
+	adr.margin_db = (margin > INT8_MAX) ? INT8_MAX : (margin < -INT8_MAX) ? -INT8_MAX : margin;
+
+	if ((ack.sf >= ADR_MIN_SF) && (ack.sf <= SX1278_LORA_SF_12)) {
+		adr.sf = ack.sf;
+	}
+	if (ack.power <= SX1278_POWER_11DBM) {
+		adr.power = ack.power;
+	}
+}
+
+uint8_t adr_window_end(void) {
+	uint8_t sf = adr.sf;
+	uint8_t power = adr.power;
+
+	if (adr.acked) {
+		adr.acks++;
+		adr.missed = 0;
+	} else {
+		adr.misses++;
+		adr.missed++;
+		// margin is stale once the gateway went quiet
+		adr.margin_db = ADR_MARGIN_UNKNOWN;
+		if ((adr.missed % ADR_ACK_LIMIT) == 0) {
+			if (adr.power != SX1278_POWER_20DBM) {
+				adr.power = SX1278_POWER_20DBM;
+			} else if (adr.sf < SX1278_LORA_SF_12) {
+				adr.sf++;
+			}
+		}
+	}
+
+#ifdef USE_BATTERY_POLICY
+	policy_set_link_margin((adr.margin_db == ADR_MARGIN_UNKNOWN) ? POLICY_MARGIN_UNKNOWN : adr.margin_db);
+#endif // USE_BATTERY_POLICY
+
+	return (sf != adr.sf) || (power != adr.power);
+}
+
+#endif // USE_ADR
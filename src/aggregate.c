@@ -0,0 +1,84 @@
+/**
+ * Windowed statistics for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_AGGREGATION
+
+#include "aggregate.h"
+
+static void aggregate_values(const packet_sample_t * sample, int32_t * values) {
+	values[0] = sample->temperature;
+	values[1] = sample->humidity;
+	values[2] = sample->pressure;
+	values[3] = sample->voltage;
+}
+
+static void aggregate_store(packet_values_t * dst, const int32_t * values) {
+	dst->temperature = (int16_t)values[0];
+	dst->humidity = (uint16_t)values[1];
+	dst->pressure = (uint16_t)values[2];
+	dst->voltage = (uint16_t)values[3];
+}
+
+void aggregate_reset(aggregate_t * agg) {
+	agg->count = 0;
+}
+
+void aggregate_add(aggregate_t * agg, const packet_sample_t * sample) {
+	int32_t values[AGGREGATE_CHANNELS];
+	uint8_t i;
+
+	if (agg->count == UINT8_MAX) {
+		return;
+	}
+
+	aggregate_values(sample, values);
+
+	if (agg->count == 0) {
+		agg->first_seq = sample->seq;
+		for (i = 0; i < AGGREGATE_CHANNELS; i++) {
+			agg->min[i] = values[i];
+			agg->max[i] = values[i];
+			agg->sum[i] = 0;
+		}
+	}
+
+	for (i = 0; i < AGGREGATE_CHANNELS; i++) {
+		if (values[i] < agg->min[i]) {
+			agg->min[i] = values[i];
+		}
+		if (values[i] > agg->max[i]) {
+			agg->max[i] = values[i];
+		}
+		// 255 * 65535 fits int32_t, no overflow check needed
+		agg->sum[i] += values[i];
+		agg->last[i] = values[i];
+	}
+	agg->count++;
+}
+
+void aggregate_get(const aggregate_t * agg, packet_stats_t * stats) {
+	int32_t mean[AGGREGATE_CHANNELS];
+	int32_t half = agg->count / 2;
+	uint8_t i;
+
+	for (i = 0; i < AGGREGATE_CHANNELS; i++) {
+		// round half away from zero, sum of temperature can be negative
+		if (agg->sum[i] >= 0) {
+			mean[i] = (agg->sum[i] + half) / agg->count;
+		} else {
+			mean[i] = (agg->sum[i] - half) / agg->count;
+		}
+	}
+
+	stats->first_seq = agg->first_seq;
+	stats->count = agg->count;
+	aggregate_store(&stats->min, agg->min);
+	aggregate_store(&stats->max, agg->max);
+	aggregate_store(&stats->mean, mean);
+	aggregate_store(&stats->last, agg->last);
+}
+
+#endif // USE_AGGREGATION
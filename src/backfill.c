@@ -0,0 +1,165 @@
+/**
+ * Store-and-forward backfill from the flash log for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_BACKFILL
+
+#include <string.h>
+#include "backfill.h"
+
+backfill_t backfill;
+
+static void backfill_refill(uint32_t uptime) {
+	uint32_t refill = (uptime - backfill.credit_s) * BACKFILL_DUTY_PERMILLE;
+
+	if (refill > BACKFILL_CREDIT_MAX_MS) {
+		refill = BACKFILL_CREDIT_MAX_MS;
+	}
+	backfill.credit_ms += refill;
+	if (backfill.credit_ms > BACKFILL_CREDIT_MAX_MS) {
+		backfill.credit_ms = BACKFILL_CREDIT_MAX_MS;
+	}
+	backfill.credit_s = uptime;
+}
+
+// times of one frame are a single run, deltas cannot encode a clock step
+static uint8_t backfill_step(uint32_t previous, uint32_t time) {
+	return (time < previous) || (time - previous >= PACKET_DELTA_UNKNOWN)
+			|| ((previous >= PACKET_TIME_UNIX_MIN) != (time >= PACKET_TIME_UNIX_MIN));
+}
+
+void backfill_init(void) {
+	memset(&backfill, 0, sizeof(backfill));
+	backfill.start = flashlog.head + flashlog.pending;
+	backfill.end = backfill.start;
+	backfill.live_start = backfill.start;
+	backfill.live_end = backfill.start;
+	backfill.credit_ms = BACKFILL_CREDIT_MAX_MS;
+}
+
+void backfill_dropped(void) {
+	backfill.dropped = 1;
+}
+
+void backfill_live_sent(uint32_t msg_id) {
+	// records get log indices in order, the next one is the first not sent
+	backfill.live_start = backfill.live_end;
+	backfill.live_end = flashlog.head + flashlog.pending;
+	backfill.expected = msg_id;
+	backfill.count = 0;
+	backfill.acked = 0;
+}
+
+uint8_t backfill_build(uint8_t * buf, uint32_t msg_id, uint32_t uptime) {
+	flashlog_record_t record;
+	packet_values_t values[BACKFILL_MAX_RECORDS];
+	uint32_t times[BACKFILL_MAX_RECORDS];
+	uint8_t from = 0;
+	uint8_t to;
+	uint8_t i;
+
+	backfill_refill(uptime);
+
+	// the ring may have overwritten the oldest ones meanwhile
+	if (backfill.start < flashlog.tail) {
+		backfill.start = flashlog.tail;
+	}
+	if (!backfill.link || (backfill.start >= backfill.end)
+			|| (backfill.credit_ms < (int32_t) backfill.airtime_ms)) {
+		return 0;
+	}
+	if (backfill.end > flashlog.head) {
+		flashlog_flush();
+		if (backfill.end > flashlog.head) {
+			return 0;
+		}
+	}
+
+	to = (backfill.end - backfill.start > BACKFILL_MAX_RECORDS) ?
+			BACKFILL_MAX_RECORDS : backfill.end - backfill.start;
+#ifdef BACKFILL_NEWEST_FIRST
+	backfill.first = backfill.end - to;
+#else
+	backfill.first = backfill.start;
+#endif // BACKFILL_NEWEST_FIRST
+
+	for (i = 0; i < to; i++) {
+		if (!flashlog_read(backfill.first + i, &record)) {
+			return 0;
+		}
+		values[i] = record.values;
+		times[i] = record.time;
+	}
+
+	// keep the run next to the end the backlog drains from
+	for (i = 1; i < to; i++) {
+		if (backfill_step(times[i - 1], times[i])) {
+#ifdef BACKFILL_NEWEST_FIRST
+			from = i;
+#else
+			to = i;
+			break;
+#endif // BACKFILL_NEWEST_FIRST
+		}
+	}
+
+	backfill.first += from;
+	backfill.count = to - from;
+	backfill.expected = msg_id;
+	backfill.acked = 0;
+	return packet_build_backfill(buf, msg_id, &values[from], backfill.count,
+			&times[from], times[from] >= PACKET_TIME_UNIX_MIN);
+}
+
+void backfill_sent(uint32_t airtime_ms) {
+	backfill.airtime_ms = airtime_ms;
+	backfill.credit_ms -= airtime_ms;
+}
+
+void backfill_ack(const uint8_t * payload, uint8_t length) {
+	downlink_ack_t ack;
+
+	if (length < sizeof(ack)) {
+		return;
+	}
+	memcpy(&ack, payload, sizeof(ack));
+	if (ack.msg_id == backfill.expected) {
+		backfill.acked = 1;
+	}
+}
+
+uint8_t backfill_window_end(void) {
+	uint8_t acked = backfill.acked;
+
+	backfill.link = acked;
+	backfill.acked = 0;
+
+	if (backfill.count != 0) {
+		// frames are cut from either end of the backlog
+		if (acked) {
+			if (backfill.first == backfill.start) {
+				backfill.start += backfill.count;
+			} else {
+				backfill.end = backfill.first;
+			}
+			backfill.frames++;
+			backfill.records += backfill.count;
+		}
+		backfill.count = 0;
+		return acked;
+	}
+
+	// live uplink, its records join the backlog unless all of them got through
+	if (!acked || backfill.dropped) {
+		if (backfill.start >= backfill.end) {
+			backfill.start = backfill.live_start;
+		}
+		backfill.end = backfill.live_end;
+	}
+	backfill.dropped = 0;
+	return acked;
+}
+
+#endif // USE_BACKFILL
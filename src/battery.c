@@ -0,0 +1,94 @@
+/**
+ * Battery monitor for LoggerSoft
+ *
+ * Both channels use the x16 hardware oversampler configured in
+ * msd_adc_init, so every software trigger returns a 16 bit sum of
+ * 16 conversions. VDDA cancels out of the ratio battery / VREFINT:
+ *
+ *   Vbat = DIVIDER * VREFINT * raw_bat / raw_vref
+ */
+
+#include "main.h"
+
+#ifdef USE_BATTERY_MONITOR
+
+#include "gd32e23x_hal.h"
+#include "gd32e23x_hal_init.h"
+#include "battery.h"
+
+#define BATTERY_ADC_FULL_SCALE	(4095UL * 16UL)
+
+battery_t battery;
+
+static uint16_t battery_convert(uint8_t channel, uint32_t sample_time) {
+	hal_adc_regularch_config_struct adc_regchannel_parameter;
+
+	hal_adc_struct_init(HAL_ADC_REGULARCH_CONFIG_STRUCT, &adc_regchannel_parameter);
+	adc_regchannel_parameter.regular_channel = channel;
+	adc_regchannel_parameter.regular_sequence = ADC_REGULAR_SEQUENCE_0;
+	adc_regchannel_parameter.sample_time = sample_time;
+	hal_adc_regular_channel_config(&adc_info, &adc_regchannel_parameter);
+
+	if (hal_adc_start(&adc_info) != HAL_ERR_NONE) {
+		return 0;
+	}
+	if (hal_adc_regular_conversion_poll(&adc_info, BATTERY_ADC_TIMEOUT) != HAL_ERR_NONE) {
+		hal_adc_stop(&adc_info);
+		return 0;
+	}
+	return hal_adc_regular_value_get(&adc_info);
+}
+
+static uint16_t battery_measure(void) {
+	uint32_t raw_vref;
+	uint32_t raw_bat;
+
+	// VREFINT needs ~10 us to start and >= 17 us sample time, 71.5 cycles at 4 MHz fits
+	adc_tempsensor_vrefint_enable();
+	raw_vref = battery_convert(ADC_CHANNEL_VREFINT, ADC_SAMPLETIME_71POINT5);
+	raw_bat = battery_convert(ADC_CHANNEL_9, ADC_SAMPLETIME_71POINT5);
+	hal_adc_stop(&adc_info);
+	adc_tempsensor_vrefint_disable();
+
+	if ((raw_vref == 0) || (raw_bat == 0)) {
+		return 0;
+	}
+
+	battery.vdda_mv = (uint16_t)((BATTERY_VREFINT_MV * BATTERY_ADC_FULL_SCALE) / raw_vref);
+	return (uint16_t)((BATTERY_DIVIDER * BATTERY_VREFINT_MV * raw_bat) / raw_vref);
+}
+
+uint16_t battery_sample_idle(void) {
+	uint16_t mv = battery_measure();
+	int32_t delta;
+
+	if (mv == 0) {
+		return 0;
+	}
+
+	if (battery.valid) {
+		delta = ((int32_t)mv - (int32_t)battery.idle_mv) * 256;
+		battery.trend += (delta - battery.trend) >> BATTERY_TREND_SHIFT;
+	}
+	battery.idle_mv = mv;
+	battery.valid = 1;
+	return mv;
+}
+
+uint16_t battery_sample_load(void) {
+	uint16_t mv = battery_measure();
+
+	if (mv != 0) {
+		battery.load_mv = mv;
+	}
+	return mv;
+}
+
+uint16_t battery_sag_mv(void) {
+	if ((battery.load_mv == 0) || (battery.load_mv >= battery.idle_mv)) {
+		return 0;
+	}
+	return battery.idle_mv - battery.load_mv;
+}
+
+#endif // USE_BATTERY_MONITOR
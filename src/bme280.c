@@ -23,6 +23,8 @@
 #include <stddef.h>
 #include "bme280.h"
 #include "gd32e23x_hal_basetick.h"
+#include "gpio_fast.h"
+#include "spi_fast.h"
 
 /**
  * @defgroup BME280_priv Private Resources
@@ -88,6 +90,13 @@ float combineToFloat(int32_t integerPart, int32_t fractionalPart)
     return result;
 }
 
+#ifdef USE_SPI_BUS
+	/// chip select and the msd_spi0_init() settings of the sensor
+static const spibus_device_t bme280_spibus_device = {
+	BME280_CS_GPIO_Port, BME_CS_Pin, SPI_PSC_2 | SPI_CK_PL_LOW_PH_1EDGE
+};
+#endif // USE_SPI_BUS
+
 /**
  *@defgroup BME280_privfunct Functions
  *@{
@@ -101,17 +110,27 @@ int8_t bme280_read_platform_spec(uint8_t reg_addr, uint8_t *rxbuff, uint8_t rxle
 	BME280_Driver_t *drv = (BME280_Driver_t *)driver;
 	struct spi_bus_data *spi = (struct spi_bus_data *)drv->env_spec_data;
 
+#ifdef USE_SPI_BUS
+	/* send register's address to be read, keep chip select low */
+	spibus_transfer(spibus_of(spi->spi_handle->periph), &bme280_spibus_device, &reg_addr, NULL,
+			1U, SPIBUS_HOLD_CS);
+
+	/* read data, chip select goes high after it */
+	spibus_transfer(spibus_of(spi->spi_handle->periph), &bme280_spibus_device, NULL, rxbuff,
+			rxlen, 0);
+#else
 	/* set chip select low */
-	hal_gpio_bit_reset(spi->NCS_gpio, spi->NCS_pin);
+	gpio_fast_low(BME280_CS_GPIO_Port, BME_CS_Pin);
 
 	/* send register's address to be read */
-	if(hal_spi_transmit_poll(spi->spi_handle, &reg_addr, 1U, 200) != HAL_ERR_NONE) return -1;
+	spi_fast_transfer(spi->spi_handle->periph, &reg_addr, NULL, 1U);
 
 	/* read data */
-	if(hal_spi_receive_poll(spi->spi_handle, rxbuff, rxlen, 200) != HAL_ERR_NONE) return -1;
+	spi_fast_transfer(spi->spi_handle->periph, NULL, rxbuff, rxlen);
 
 	/* set chip select high */
-	hal_gpio_bit_set(spi->NCS_gpio, spi->NCS_pin);
+	gpio_fast_high(BME280_CS_GPIO_Port, BME_CS_Pin);
+#endif // USE_SPI_BUS
 
 	return 0;
 }
@@ -131,14 +150,19 @@ int8_t bme280_write_platform_spec(uint8_t reg_addr, uint8_t value, void *driver)
 	buff[0] = reg_addr & 0x7F;	// first element keeps address to be written (MSB must be reset in write mode!)
 	buff[1] = value;			// second element keeps value to bw written
 
+#ifdef USE_SPI_BUS
+	/* send register's address and value at once */
+	spibus_transfer(spibus_of(spi->spi_handle->periph), &bme280_spibus_device, buff, NULL, 2U, 0);
+#else
 	/* set chip select low */
-	hal_gpio_bit_reset(spi->NCS_gpio, spi->NCS_pin);
+	gpio_fast_low(BME280_CS_GPIO_Port, BME_CS_Pin);
 
 	/* send register's address and value at once */
-	if(hal_spi_transmit_poll(spi->spi_handle, buff, 2U, 200) != HAL_ERR_NONE) return -1;
+	spi_fast_transfer(spi->spi_handle->periph, buff, NULL, 2U);
 
 	/* set chip select high */
-	hal_gpio_bit_set(spi->NCS_gpio, spi->NCS_pin);
+	gpio_fast_high(BME280_CS_GPIO_Port, BME_CS_Pin);
+#endif // USE_SPI_BUS
 
 	return 0;
 }
@@ -0,0 +1,46 @@
+/**
+ * Per-frame channel hopping for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_CHANNEL_PLAN
+
+#include "channel.h"
+
+static const uint32_t channel_plan[] = CHANNEL_PLAN;
+
+#define CHANNEL_COUNT	(sizeof(channel_plan) / sizeof(channel_plan[0]))
+
+static uint8_t channel_frf[CHANNEL_COUNT][3];
+
+// integer hash with full avalanche, neighbouring IDs and counters land far apart
+static uint32_t channel_mix(uint32_t x) {
+	x ^= x >> 16;
+	x *= 0x7FEB352DUL;
+	x ^= x >> 15;
+	x *= 0x846CA68BUL;
+	x ^= x >> 16;
+	return x;
+}
+
+void channel_init(void) {
+	uint8_t i;
+
+	for (i = 0; i < CHANNEL_COUNT; i++) {
+		SX1278_frf(channel_plan[i], channel_frf[i]);
+	}
+}
+
+uint8_t channel_hop(SX1278_t * module, uint32_t msg_id) {
+	uint8_t channel = channel_mix(DEVICE_ID ^ channel_mix(msg_id)) % CHANNEL_COUNT;
+
+	SX1278_set_frf(module, channel_frf[channel]);
+	return channel;
+}
+
+void channel_home(SX1278_t * module) {
+	SX1278_set_frf(module, channel_frf[0]);
+}
+
+#endif // USE_CHANNEL_PLAN
@@ -0,0 +1,195 @@
+/**
+ * Remote configuration for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_REMOTE_CONFIG
+
+#include <string.h>
+#include "gd32e23x_hal.h"
+#include "config.h"
+#include "crc32.h"
+
+_Static_assert(sizeof(config_record_t) % 4 == 0, "config_record_t must be whole words");
+
+config_t config;
+
+static uint32_t config_record_crc(const config_record_t * record) {
+	return crc32_update(0, (const uint8_t*) record, sizeof(config_record_t) - sizeof(uint32_t));
+}
+
+static uint8_t config_valid(const config_values_t * values) {
+	// SF6 is implicit header only, narrower bands need a TCXO the Ra-01 lacks
+	return (values->sf >= SX1278_LORA_SF_7) && (values->sf <= SX1278_LORA_SF_12)
+			&& (values->bw >= SX1278_LORA_BW_62_5KHZ) && (values->bw <= SX1278_LORA_BW_500KHZ)
+			&& (values->power <= SX1278_POWER_11DBM)
+			&& (values->sync_word != SX127X_SYNC_WORD_LORAWAN)
+#ifdef USE_IMPLICIT_HEADER
+			&& (values->sync_word != IMPLICIT_SYNC_WORD)
+#endif // USE_IMPLICIT_HEADER
+			&& (values->sleep_minutes >= 1) && (values->sleep_minutes <= 60);
+}
+
+// latest valid record or NULL, index of the first free one
+static const config_record_t * config_scan(uint32_t * free_slot) {
+	const config_record_t * record = (const config_record_t*) CONFIG_FLASH_BASE;
+	const config_record_t * latest = NULL;
+	uint32_t i;
+
+	for (i = 0; i < CONFIG_FLASH_RECORDS; i++, record++) {
+		if (record->magic == 0xFFFFFFFFUL) {
+			break;
+		}
+		if ((record->magic == CONFIG_MAGIC) && (record->crc == config_record_crc(record))
+				&& config_valid(&record->values)) {
+			latest = record;
+		}
+	}
+	*free_slot = i;
+	return latest;
+}
+
+static uint8_t config_store(void) {
+	config_record_t record;
+	uint32_t words[sizeof(config_record_t) / 4];
+	uint32_t address;
+	uint32_t slot;
+	uint8_t i;
+	uint8_t ok = 1;
+
+	config_scan(&slot);
+
+	memset(&record, 0xFF, sizeof(record));
+	record.magic = CONFIG_MAGIC;
+	record.values = config.values;
+	record.sequence = config.sequence + 1;
+	record.crc = config_record_crc(&record);
+	// packed record may be unaligned, program from a word copy
+	memcpy(words, &record, sizeof(words));
+
+	hal_fmc_unlock();
+	if (slot == CONFIG_FLASH_RECORDS) {
+		ok = (hal_fmc_page_erase(CONFIG_FLASH_BASE) == FMC_READY);
+		slot = 0;
+	}
+	address = CONFIG_FLASH_BASE + slot * sizeof(record);
+	for (i = 0; ok && (i < sizeof(record) / 4); i++) {
+		ok = (hal_fmc_word_program(address + i * 4, words[i]) == FMC_READY);
+	}
+	hal_fmc_lock();
+
+	if (!ok || (memcmp((const void*) address, &record, sizeof(record)) != 0)) {
+		return 0;
+	}
+	config.sequence = record.sequence;
+	return 1;
+}
+
+void config_init(void) {
+	const config_record_t * record;
+	uint32_t slot;
+
+	memset(&config, 0, sizeof(config));
+	config.values.sf = LORA_SF;
+	config.values.bw = LORA_BW;
+	config.values.power = LORA_POWER;
+	config.values.sync_word = SX127X_SYNC_WORD_DEFAULT;
+	config.values.sleep_minutes = SLEEP_MINUTES;
+
+	record = config_scan(&slot);
+	if (record != NULL) {
+		config.values = record->values;
+		config.sequence = record->sequence;
+	}
+	config.changed = 1;
+}
+
+void config_downlink(const uint8_t * payload, uint8_t length, uint8_t broadcast) {
+	config_set_t set;
+	config_values_t values;
+
+	if (length < sizeof(set)) {
+		return;
+	}
+	memcpy(&set, payload, sizeof(set));
+
+	config.report = 1;
+	if (broadcast && (set.mask & CONFIG_SET_RADIO)) {
+		// one bad value would take every node off the air at once
+		config.result = CONFIG_RESULT_BROADCAST;
+		return;
+	}
+
+	values = config.values;
+	if (set.mask & CONFIG_SET_SF) {
+		values.sf = set.values.sf;
+	}
+	if (set.mask & CONFIG_SET_BW) {
+		values.bw = set.values.bw;
+	}
+	if (set.mask & CONFIG_SET_POWER) {
+		values.power = set.values.power;
+	}
+	if (set.mask & CONFIG_SET_SYNC_WORD) {
+		values.sync_word = set.values.sync_word;
+	}
+	if (set.mask & CONFIG_SET_PERIOD) {
+		values.sleep_minutes = set.values.sleep_minutes;
+	}
+
+	if (!config_valid(&values)) {
+		config.result = CONFIG_RESULT_INVALID;
+		return;
+	}
+	if (memcmp(&values, &config.values, sizeof(values)) == 0) {
+		// repeated frame, nothing to write
+		config.result = CONFIG_RESULT_OK;
+		return;
+	}
+
+	// stored by config_heard() once the node is heard with them
+	if (!config.trial) {
+		config.previous = config.values;
+	}
+	config.values = values;
+	config.changed = 1;
+	config.trial = CONFIG_TRIAL_UPLINKS;
+	config.result = CONFIG_RESULT_OK;
+}
+
+void config_heard(void) {
+	// not applied yet, a second frame of the same window proves nothing
+	if (!config.trial || config.changed) {
+		return;
+	}
+	config.trial = 0;
+	if (!config_store()) {
+		config.result = CONFIG_RESULT_FLASH;
+		config.report = 1;
+	}
+}
+
+void config_uplink(void) {
+	if (!config.trial || config.changed) {
+		return;
+	}
+	if (--config.trial == 0) {
+		config.values = config.previous;
+		config.changed = 1;
+		config.result = CONFIG_RESULT_REVERTED;
+		config.report = 1;
+	}
+}
+
+uint8_t config_report(config_report_t * report) {
+	if (!config.report) {
+		return 0;
+	}
+	report->result = config.result;
+	report->values = config.values;
+	config.report = 0;
+	return 1;
+}
+
+#endif // USE_REMOTE_CONFIG
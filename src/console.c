@@ -0,0 +1,627 @@
+/**
+ * USART1 command console for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_CONSOLE
+
+#include <string.h>
+#include "gd32e23x_hal.h"
+#include "gd32e23x_hal_init.h"
+#include "console.h"
+#include "fmt.h"
+
+#define CONSOLE_DMA_TX		DMA_CH3
+#define CONSOLE_DMA_RX		DMA_CH4
+#define CONSOLE_LOG_MAX		4
+#define CONSOLE_BENCH_RUNS	1000
+
+console_t console;
+
+static const char * const console_task_names[SCHED_TASKS] = {
+	"battery", "sensor", "flush", "uplink", "diag", "beacon"
+};
+
+/*
+ * Output
+ */
+
+// start DMA on the contiguous part of the ring, interrupts must be off
+static void console_kick(void) {
+	uint16_t length;
+
+	if (console.tx_busy || (console.tx_head == console.tx_tail)) {
+		return;
+	}
+
+	if (console.tx_head > console.tx_tail) {
+		length = console.tx_head - console.tx_tail;
+	} else {
+		length = CONSOLE_TX_SIZE - console.tx_tail;
+	}
+
+	dma_channel_disable(CONSOLE_DMA_TX);
+	dma_memory_address_config(CONSOLE_DMA_TX, (uint32_t) &console.tx[console.tx_tail]);
+	dma_transfer_number_config(CONSOLE_DMA_TX, length);
+	dma_flag_clear(CONSOLE_DMA_TX, DMA_FLAG_FTF);
+	console.tx_busy = length;
+	dma_channel_enable(CONSOLE_DMA_TX);
+}
+
+void console_write(const char * data, uint16_t length) {
+	uint16_t next;
+
+	while (length--) {
+		next = (console.tx_head + 1) % CONSOLE_TX_SIZE;
+		if (next == console.tx_tail) {
+			console.tx_dropped += length + 1;
+			break;
+		}
+		console.tx[console.tx_head] = *data++;
+		console.tx_head = next;
+	}
+
+	__disable_irq();
+	console_kick();
+	__enable_irq();
+}
+
+void console_print(const char * str) {
+	console_write(str, strlen(str));
+}
+
+void console_put_uint(uint32_t value) {
+	char buffer[FMT_UINT_SIZE];
+
+	console_write(buffer, fmt_uint(buffer, value) - buffer);
+}
+
+void console_put_int(int32_t value) {
+	char buffer[FMT_INT_SIZE];
+
+	console_write(buffer, fmt_int(buffer, value) - buffer);
+}
+
+void console_put_hex(uint32_t value, uint8_t digits) {
+	char buffer[FMT_HEX_SIZE];
+
+	console_write(buffer, fmt_hex(buffer, value, digits) - buffer);
+}
+
+void console_put_fixed(int32_t value, uint8_t decimals) {
+	char buffer[FMT_FIXED_SIZE];
+
+	console_write(buffer, fmt_fixed(buffer, value, decimals) - buffer);
+}
+
+/*
+ * Hardware
+ */
+
+void console_resume(void) {
+	dma_parameter_struct dma_init_struct;
+
+	hal_rcu_periph_clk_enable(RCU_DMA);
+
+	dma_struct_para_init(&dma_init_struct);
+	dma_init_struct.periph_addr = (uint32_t) &USART_RDATA(USART1);
+	dma_init_struct.periph_width = DMA_PERIPHERAL_WIDTH_8BIT;
+	dma_init_struct.periph_inc = DMA_PERIPH_INCREASE_DISABLE;
+	dma_init_struct.memory_addr = (uint32_t) console.rx;
+	dma_init_struct.memory_width = DMA_MEMORY_WIDTH_8BIT;
+	dma_init_struct.memory_inc = DMA_MEMORY_INCREASE_ENABLE;
+	dma_init_struct.number = CONSOLE_RX_SIZE;
+	dma_init_struct.priority = DMA_PRIORITY_LOW;
+	dma_init_struct.direction = DMA_PERIPHERAL_TO_MEMORY;
+	dma_deinit(CONSOLE_DMA_RX);
+	dma_init(CONSOLE_DMA_RX, &dma_init_struct);
+	dma_circulation_enable(CONSOLE_DMA_RX);
+
+	dma_init_struct.periph_addr = (uint32_t) &USART_TDATA(USART1);
+	dma_init_struct.number = 0;
+	dma_init_struct.direction = DMA_MEMORY_TO_PERIPHERAL;
+	dma_deinit(CONSOLE_DMA_TX);
+	dma_init(CONSOLE_DMA_TX, &dma_init_struct);
+	dma_interrupt_enable(CONSOLE_DMA_TX, DMA_INT_FTF);
+
+	// DMA restarts at the beginning of rx
+	console.rx_tail = 0;
+	dma_channel_enable(CONSOLE_DMA_RX);
+
+	hal_uart_start(&uart1_info);
+	usart_dma_receive_config(USART1, USART_DENR_ENABLE);
+	usart_dma_transmit_config(USART1, USART_DENT_ENABLE);
+	usart_interrupt_flag_clear(USART1, USART_INT_FLAG_IDLE);
+	usart_interrupt_enable(USART1, USART_INT_IDLE);
+	hal_nvic_periph_irq_enable(DMA_Channel3_4_IRQn, 3);
+
+	__disable_irq();
+	console.tx_busy = 0;
+	console_kick();
+	__enable_irq();
+}
+
+void console_suspend(void) {
+	uint16_t sent;
+
+	// parse what arrived, the rest of rx is lost with the DMA position
+	console.rx_pending = 1;
+	console_poll();
+	dma_channel_disable(CONSOLE_DMA_RX);
+
+	// no waiting for output, console_resume() sends the rest of the ring
+	__disable_irq();
+	dma_channel_disable(CONSOLE_DMA_TX);
+	if (console.tx_busy) {
+		sent = console.tx_busy - dma_transfer_number_get(CONSOLE_DMA_TX);
+		console.tx_tail = (console.tx_tail + sent) % CONSOLE_TX_SIZE;
+		console.tx_busy = 0;
+	}
+	__enable_irq();
+	hal_nvic_periph_irq_disable(DMA_Channel3_4_IRQn);
+}
+
+void console_irq(void) {
+	if (usart_interrupt_flag_get(USART1, USART_INT_FLAG_IDLE) == SET) {
+		usart_interrupt_flag_clear(USART1, USART_INT_FLAG_IDLE);
+		console.rx_pending = 1;
+	}
+	if (usart_flag_get(USART1, USART_FLAG_ORERR) == SET) {
+		usart_flag_clear(USART1, USART_FLAG_ORERR);
+	}
+}
+
+void console_dma_irq(void) {
+	if (dma_interrupt_flag_get(CONSOLE_DMA_TX, DMA_INT_FLAG_FTF) == SET) {
+		dma_interrupt_flag_clear(CONSOLE_DMA_TX, DMA_INT_FLAG_FTF);
+		console.tx_tail = (console.tx_tail + console.tx_busy) % CONSOLE_TX_SIZE;
+		console.tx_busy = 0;
+		console_kick();
+	}
+}
+
+/*
+ * Commands
+ */
+
+static uint8_t console_parse_uint(const char * str, uint32_t * value) {
+	uint32_t result = 0;
+
+	if (*str == '\0') {
+		return 0;
+	}
+	for (; *str; str++) {
+		if ((*str < '0') || (*str > '9')) {
+			return 0;
+		}
+		result = result * 10 + (*str - '0');
+	}
+	*value = result;
+	return 1;
+}
+
+static void console_cmd_help(uint8_t argc, char ** argv) {
+	console_print("status | mem | log <index> [count] | sched <task> <s> | radio power|sf <n> | bench\r\n");
+}
+
+static void console_cmd_status(uint8_t argc, char ** argv) {
+	uint8_t i;
+
+	console_print("id ");
+	console_put_hex(DEVICE_ID, 8);
+	console_print(" up ");
+	console_put_uint(sched_clock());
+	console_print(" s\r\n");
+#ifdef USE_CRASH_LOG
+	// previous run
+	console_print("reset ");
+	console_put_hex(crashlog.report.reset, 2);
+	console_print(" phase ");
+	console_put_hex(crashlog.report.phase, 2);
+	console_print(" pc ");
+	console_put_hex(crashlog.report.pc, 8);
+	console_print(" lr ");
+	console_put_hex(crashlog.report.lr, 8);
+	console_print(" ");
+	console_put_uint(crashlog.report.voltage);
+	console_print(" mV resets ");
+	console_put_uint(crashlog.report.resets);
+	console_print("\r\n");
+#endif // USE_CRASH_LOG
+#ifdef USE_BATTERY_MONITOR
+	console_print("battery ");
+	console_put_uint(battery.idle_mv);
+	console_print(" mV load ");
+	console_put_uint(battery.load_mv);
+	console_print(" mV trend ");
+	console_put_int(battery.trend);
+	console_print("\r\n");
+#endif // USE_BATTERY_MONITOR
+#ifdef USE_BATTERY_POLICY
+	console_print("profile ");
+	console_put_uint(policy.profile);
+	console_print(" margin ");
+	console_put_int(policy.link_margin_db);
+	console_print(" dB\r\n");
+#endif // USE_BATTERY_POLICY
+#ifdef USE_RTC_CALIBRATION
+	console_print("rtc clock ");
+	console_put_fixed(rtccal.freq_mhz, 3);
+	console_print(" Hz psc ");
+	console_put_uint(rtccal.factor_asyn);
+	console_print("/");
+	console_put_uint(rtccal.factor_syn);
+	console_print(" trim ");
+	console_put_int(rtccal.trim);
+	console_print(" failed ");
+	console_put_uint(rtccal.failures);
+	console_print("\r\n");
+#endif // USE_RTC_CALIBRATION
+#ifdef USE_RA_01_SENDER
+	console_print("msg ");
+	console_put_uint(msg_id);
+	console_print(" queued ");
+	console_put_uint(samples_count);
+	console_print(" power ");
+	console_put_uint(lora_power);
+	console_print(" sf ");
+	console_put_uint(lora_sf + 6);
+	console_print("\r\n");
+#endif // USE_RA_01_SENDER
+#ifdef USE_ADR
+	console_print("adr snr ");
+	console_put_fixed(adr.snr * 25, 2);
+	console_print(" rssi ");
+	console_put_int(adr.rssi);
+	console_print(" acks ");
+	console_put_uint(adr.acks);
+	console_print(" missed ");
+	console_put_uint(adr.misses);
+	console_print("\r\n");
+#endif // USE_ADR
+#ifdef USE_TDMA
+	console_print(tdma.synced ? "tdma slot " : "tdma unsynced slot ");
+	console_put_uint(tdma.slot);
+	console_print(tdma.assigned ? " drift " : "? drift ");
+	console_put_int(tdma.drift_ppm);
+	console_print(" ppm jitter ");
+	console_put_int(tdma.jitter_ppm);
+	console_print(" ppm beacons ");
+	console_put_uint(tdma.beacons);
+	console_print(" missed ");
+	console_put_uint(tdma.misses);
+	console_print("\r\n");
+#endif // USE_TDMA
+#ifdef USE_SEND_ON_DELTA
+	console_print("delta suppressed ");
+	console_put_fixed(delta_suppression_permille(), 1);
+	console_print(" %\r\n");
+#endif // USE_SEND_ON_DELTA
+#ifdef USE_FLASH_LOG
+	console_print("log ");
+	console_put_uint(flashlog.tail);
+	console_print("..");
+	console_put_uint(flashlog.head);
+	console_print(" pending ");
+	console_put_uint(flashlog.pending);
+	console_print("\r\n");
+#endif // USE_FLASH_LOG
+#ifdef USE_BACKFILL
+	console_print("backfill ");
+	console_put_uint(backfill.start);
+	console_print("..");
+	console_put_uint(backfill.end);
+	console_print(" sent ");
+	console_put_uint(backfill.records);
+	console_print(" credit ");
+	console_put_int(backfill.credit_ms);
+	console_print(" ms\r\n");
+#endif // USE_BACKFILL
+#ifdef USE_RELAY
+	console_print("relay queued ");
+	console_put_uint(relay.entries);
+	console_print(" forwarded ");
+	console_put_uint(relay.forwarded);
+	console_print(" dropped ");
+	console_put_uint(relay.dropped);
+	console_print(" rx ");
+	console_put_uint(relay.rx_s);
+	console_print(" s tx ");
+	console_put_uint(relay.tx_ms);
+	console_print(" ms\r\n");
+#endif // USE_RELAY
+#ifdef USE_IMPLICIT_HEADER
+	console_print("implicit header frames ");
+	console_put_uint(implicit_frames);
+	console_print(" saved ");
+	console_put_int(implicit_saved_us / 1000);
+	console_print(" ms\r\n");
+#endif // USE_IMPLICIT_HEADER
+	for (i = 0; i < SCHED_TASKS; i++) {
+		console_print(console_task_names[i]);
+		console_print(" ");
+		console_put_uint(sched.period[i]);
+		console_print(" s, next ");
+		console_put_uint(sched.deadline[i]);
+		console_print("\r\n");
+	}
+}
+
+static void console_cmd_mem(uint8_t argc, char ** argv) {
+#ifdef USE_MEM_STATS
+	memstat_t stat;
+
+	memstat_get(&stat);
+	console_print("ram data ");
+	console_put_uint(stat.data);
+	console_print(" bss ");
+	console_put_uint(stat.bss);
+	console_print(" free ");
+	console_put_uint(stat.gap);
+	console_print("\r\nstack ");
+	console_put_uint(stat.stack_peak);
+	console_print(" of ");
+	console_put_uint(stat.stack);
+	console_print(stat.stack_peak > stat.stack ? " OVERFLOW\r\n" : "\r\n");
+	console_print("flash ");
+	console_put_uint(stat.flash);
+	console_print(" of ");
+	console_put_uint(stat.flash_size);
+	console_print("\r\n");
+#else
+	console_print("no mem stats\r\n");
+#endif // USE_MEM_STATS
+}
+
+static void console_cmd_log(uint8_t argc, char ** argv) {
+#ifdef USE_FLASH_LOG
+	flashlog_record_t record;
+	uint32_t index;
+	uint32_t count = 1;
+
+	if ((argc < 2) || !console_parse_uint(argv[1], &index)
+			|| ((argc > 2) && !console_parse_uint(argv[2], &count))) {
+		console_print("usage: log <index> [count]\r\n");
+		return;
+	}
+	// keep output within the TX ring
+	if (count > CONSOLE_LOG_MAX) {
+		count = CONSOLE_LOG_MAX;
+	}
+
+	hal_spi_start(&FLASH_SPI_PORT);
+	for (; count--; index++) {
+		console_put_uint(index);
+		if (!flashlog_read(index, &record)) {
+			console_print(": none\r\n");
+			continue;
+		}
+		console_print(": t ");
+		console_put_uint(record.time);
+		console_print(" ");
+		console_put_fixed(record.values.temperature, 2);
+		console_print(" C ");
+		console_put_fixed(record.values.humidity, 2);
+		console_print(" % ");
+		console_put_fixed(record.values.pressure, 1);
+		console_print(" hPa ");
+		console_put_uint(record.values.voltage);
+		console_print(" mV\r\n");
+	}
+	hal_spi_stop(&FLASH_SPI_PORT);
+#else
+	console_print("no log\r\n");
+#endif // USE_FLASH_LOG
+}
+
+static void console_cmd_sched(uint8_t argc, char ** argv) {
+	uint32_t period;
+	uint8_t i;
+
+	if ((argc == 3) && console_parse_uint(argv[2], &period) && (period < SCHED_SECONDS_PER_DAY)) {
+		for (i = 0; i < SCHED_TASKS; i++) {
+			if (strcmp(argv[1], console_task_names[i]) == 0) {
+				sched_set_period((sched_task_t) i, period);
+				console_print("ok\r\n");
+				return;
+			}
+		}
+	}
+	console_print("usage: sched <task> <seconds>\r\n");
+}
+
+static void console_cmd_radio(uint8_t argc, char ** argv) {
+#ifdef USE_RA_01_SENDER
+	uint32_t value;
+
+	if ((argc == 3) && console_parse_uint(argv[2], &value)) {
+		if ((strcmp(argv[1], "power") == 0) && (value <= SX1278_POWER_11DBM)) {
+			lora_power = value;
+			console_print("ok\r\n");
+			return;
+		}
+		// SF6 is implicit header only, the gateway would lose the node
+		if ((strcmp(argv[1], "sf") == 0) && (value >= 7) && (value <= 12)) {
+			lora_sf = value - 6;
+			console_print("ok\r\n");
+			return;
+		}
+	}
+	console_print("usage: radio power <0..3> | radio sf <7..12>\r\n");
+#else
+	console_print("no radio\r\n");
+#endif // USE_RA_01_SENDER
+}
+
+#ifdef USE_RA_01_SENDER
+
+static void console_bench_fill_sample(void) {
+	packet_sample_t sample;
+
+	packet_fill_sample(&sample, 0, 21.37f, 45.6f, 101325.0f, 3700);
+}
+
+static void console_bench_packet_build(void) {
+	packet_sample_t records[PACKET_MAX_SAMPLES];
+	uint8_t buf[PACKET_MAX_SIZE];
+
+	memset(records, 0, sizeof(records));
+	packet_build(buf, 0, records, PACKET_MAX_SAMPLES, NULL, NULL, 0);
+}
+
+// RegVersion read, 2 bytes, at 8 MHz cycles per byte are 4 * us per run
+static void console_bench_spi_hal(void) {
+	uint8_t tx[2] = { 0x42, 0x00 };
+	uint8_t rx[2];
+
+	SX1278_hw_SetNSS(&SX1278_hw, 0);
+	hal_spi_transmit_receive_poll(SX1278_hw.spi, tx, rx, 2, 1000);
+	SX1278_hw_SetNSS(&SX1278_hw, 1);
+}
+
+static void console_bench_spi_fast(void) {
+	SX1278_SPIRead(&SX1278, 0x42);
+}
+
+#endif // USE_RA_01_SENDER
+
+static void console_bench_fmt(void) {
+	char buffer[48];
+	char * p;
+
+	p = fmt_str(buffer, "battery ");
+	p = fmt_uint(p, 3712);
+	p = fmt_str(p, " mV trend ");
+	p = fmt_int(p, -37);
+	p = fmt_str(p, " T ");
+	fmt_fixed(p, 2137, 2);
+}
+
+#ifdef USE_BATTERY_MONITOR
+
+static void console_bench_battery(void) {
+	battery_sample_idle();
+}
+
+#endif // USE_BATTERY_MONITOR
+
+static const struct {
+	const char * name;
+	void (*run)(void);
+} console_benches[] = {
+#ifdef USE_RA_01_SENDER
+	{ "fill_sample", console_bench_fill_sample },
+	{ "packet_build", console_bench_packet_build },
+	{ "spi_hal", console_bench_spi_hal },
+	{ "spi_fast", console_bench_spi_fast },
+#endif // USE_RA_01_SENDER
+#ifdef USE_BATTERY_MONITOR
+	{ "battery", console_bench_battery },
+#endif // USE_BATTERY_MONITOR
+	{ "fmt", console_bench_fmt },
+	{ NULL, NULL }
+};
+
+static void console_cmd_bench(uint8_t argc, char ** argv) {
+#ifdef USE_BATTERY_MONITOR
+	// the battery bench must not move the readings the policy runs on
+	battery_t battery_saved = battery;
+#endif // USE_BATTERY_MONITOR
+	uint32_t start;
+	uint16_t n;
+	uint8_t i;
+
+	for (i = 0; console_benches[i].name != NULL; i++) {
+		start = hal_basetick_count_get();
+		for (n = 0; n < CONSOLE_BENCH_RUNS; n++) {
+			console_benches[i].run();
+		}
+		// ms per CONSOLE_BENCH_RUNS runs is us per run
+		console_print(console_benches[i].name);
+		console_print(" ");
+		console_put_uint(hal_basetick_count_get() - start);
+		console_print(" us\r\n");
+	}
+#ifdef USE_BATTERY_MONITOR
+	battery = battery_saved;
+#endif // USE_BATTERY_MONITOR
+}
+
+static const struct {
+	const char * name;
+	void (*run)(uint8_t argc, char ** argv);
+} console_commands[] = {
+	{ "help", console_cmd_help },
+	{ "status", console_cmd_status },
+	{ "mem", console_cmd_mem },
+	{ "log", console_cmd_log },
+	{ "sched", console_cmd_sched },
+	{ "radio", console_cmd_radio },
+	{ "bench", console_cmd_bench },
+};
+
+static void console_execute(char * line) {
+	char * argv[CONSOLE_MAX_ARGS];
+	uint8_t argc = 0;
+	uint8_t i;
+
+	// split on spaces in place
+	while (*line && (argc < CONSOLE_MAX_ARGS)) {
+		while (*line == ' ') {
+			*line++ = '\0';
+		}
+		if (*line == '\0') {
+			break;
+		}
+		argv[argc++] = line;
+		while (*line && (*line != ' ')) {
+			line++;
+		}
+	}
+	if (argc == 0) {
+		return;
+	}
+
+	for (i = 0; i < sizeof(console_commands) / sizeof(console_commands[0]); i++) {
+		if (strcmp(argv[0], console_commands[i].name) == 0) {
+			console_commands[i].run(argc, argv);
+			return;
+		}
+	}
+	console_print("unknown command, try help\r\n");
+}
+
+void console_poll(void) {
+	uint16_t head;
+	char c;
+
+	if (!console.rx_pending) {
+		return;
+	}
+	console.rx_pending = 0;
+
+	head = CONSOLE_RX_SIZE - dma_transfer_number_get(CONSOLE_DMA_RX);
+	if (head == CONSOLE_RX_SIZE) {
+		head = 0;
+	}
+
+	while (console.rx_tail != head) {
+		c = console.rx[console.rx_tail];
+		console.rx_tail = (console.rx_tail + 1) % CONSOLE_RX_SIZE;
+
+		if ((c == '\r') || (c == '\n')) {
+			console.line[console.line_length] = '\0';
+			console.line_length = 0;
+			console_execute(console.line);
+		} else if ((c == '\b') || (c == 0x7F)) {
+			if (console.line_length) {
+				console.line_length--;
+			}
+		} else if (console.line_length < CONSOLE_LINE_SIZE - 1) {
+			console.line[console.line_length++] = c;
+		}
+	}
+}
+
+#endif // USE_CONSOLE
@@ -0,0 +1,130 @@
+/**
+ * Post-mortem log and watchdog for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_CRASH_LOG
+
+#include "gd32e23x_hal.h"
+#include "crashlog.h"
+
+#define CRASHLOG_RECORD		RTC_BKP0
+#define CRASHLOG_PC			RTC_BKP1
+#define CRASHLOG_LR			RTC_BKP2
+#define CRASHLOG_STATE		RTC_BKP3
+
+#define CRASHLOG_PHASE_SHIFT	16
+#define CRASHLOG_PHASE_MASK		(0xFFUL << CRASHLOG_PHASE_SHIFT)
+#define CRASHLOG_VOLTAGE_MASK	0xFFFFUL
+#define CRASHLOG_FAULT			(1UL << 31)	// in CRASHLOG_STATE
+#define CRASHLOG_RESETS_MASK	0xFFFFUL
+
+crashlog_t crashlog;
+
+// backup registers are written with BKPWEN only
+static void crashlog_unlock(void) {
+	rcu_periph_clock_enable(RCU_PMU);
+	pmu_backup_write_enable();
+}
+
+void crashlog_init(void) {
+	crash_report_t * report = &crashlog.report;
+	uint32_t flags = RCU_RSTSCK;
+	uint32_t record;
+	uint32_t state;
+
+	crashlog_unlock();
+	rcu_periph_clock_enable(RCU_RTC);
+	record = CRASHLOG_RECORD;
+	state = CRASHLOG_STATE;
+
+	report->reset = 0;
+	if (flags & (RCU_RSTSCK_PORRSTF | RCU_RSTSCK_V12RSTF)) {
+		report->reset |= CRASH_RESET_POWER;
+	}
+	if (flags & RCU_RSTSCK_EPRSTF) {
+		report->reset |= CRASH_RESET_PIN;
+	}
+	if (flags & RCU_RSTSCK_SWRSTF) {
+		report->reset |= CRASH_RESET_SOFTWARE;
+	}
+	if (flags & RCU_RSTSCK_FWDGTRSTF) {
+		report->reset |= CRASH_RESET_WATCHDOG;
+	}
+	if (flags & (RCU_RSTSCK_WWDGTRSTF | RCU_RSTSCK_LPRSTF | RCU_RSTSCK_OBLRSTF)) {
+		report->reset |= CRASH_RESET_OTHER;
+	}
+	rcu_all_reset_flag_clear();
+
+	report->pc = 0;
+	report->lr = 0;
+	if ((record >> 24) == CRASHLOG_MAGIC) {
+		report->phase = (uint8_t) ((record & CRASHLOG_PHASE_MASK) >> CRASHLOG_PHASE_SHIFT);
+		report->voltage = (uint16_t) (record & CRASHLOG_VOLTAGE_MASK);
+		report->resets = (uint16_t) ((state & CRASHLOG_RESETS_MASK) + 1);
+		if (state & CRASHLOG_FAULT) {
+			// the handler resets by software
+			report->reset = (report->reset & ~CRASH_RESET_SOFTWARE) | CRASH_RESET_FAULT;
+			report->pc = CRASHLOG_PC;
+			report->lr = CRASHLOG_LR;
+		}
+	} else {
+		// cold start, the RTC domain lost power
+		report->phase = CRASH_PHASE_UNKNOWN;
+		report->voltage = 0;
+		report->resets = 0;
+	}
+	crashlog.pending = 1;
+
+	CRASHLOG_RECORD = ((uint32_t) CRASHLOG_MAGIC << 24)
+			| ((uint32_t) CRASH_PHASE_BOOT << CRASHLOG_PHASE_SHIFT) | report->voltage;
+	CRASHLOG_PC = 0;
+	CRASHLOG_LR = 0;
+	CRASHLOG_STATE = report->resets;
+
+	// cannot be stopped, and nothing may hang from here on
+	fwdgt_config(CRASHLOG_WDT_RELOAD, CRASHLOG_WDT_PSC);
+	fwdgt_enable();
+}
+
+uint8_t crashlog_phase(uint8_t phase) {
+	uint32_t record = CRASHLOG_RECORD;
+
+	CRASHLOG_RECORD = (record & ~CRASHLOG_PHASE_MASK) | ((uint32_t) phase << CRASHLOG_PHASE_SHIFT);
+	return (uint8_t) ((record & CRASHLOG_PHASE_MASK) >> CRASHLOG_PHASE_SHIFT);
+}
+
+void crashlog_voltage(uint16_t voltage) {
+	CRASHLOG_RECORD = (CRASHLOG_RECORD & ~CRASHLOG_VOLTAGE_MASK) | voltage;
+}
+
+void crashlog_feed(void) {
+	fwdgt_counter_reload();
+}
+
+void crashlog_fault(const uint32_t * frame) {
+	crashlog_unlock();
+	CRASHLOG_PC = frame[6];
+	CRASHLOG_LR = frame[5];
+	CRASHLOG_STATE |= CRASHLOG_FAULT;
+	NVIC_SystemReset();
+}
+
+// passes the stack frame of the fault, MSP or PSP after EXC_RETURN bit 2
+__attribute__((naked)) void HardFault_Handler(void) {
+	__asm volatile (
+		"movs r0, #4\n"
+		"mov r1, lr\n"
+		"tst r0, r1\n"
+		"bne 1f\n"
+		"mrs r0, msp\n"
+		"b 2f\n"
+		"1:\n"
+		"mrs r0, psp\n"
+		"2:\n"
+		"bl crashlog_fault\n"
+	);
+}
+
+#endif // USE_CRASH_LOG
@@ -0,0 +1,18 @@
+/**
+ * CRC-32 for LoggerSoft
+ */
+
+#include "crc32.h"
+
+uint32_t crc32_update(uint32_t crc, const uint8_t * data, uint32_t length) {
+	uint8_t bit;
+
+	crc = ~crc;
+	while (length--) {
+		crc ^= *data++;
+		for (bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (0xEDB88320UL & (0UL - (crc & 1)));
+		}
+	}
+	return ~crc;
+}
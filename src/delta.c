@@ -0,0 +1,55 @@
+/**
+ * Send-on-delta reporting for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_SEND_ON_DELTA
+
+#include "delta.h"
+
+delta_t delta;
+
+static uint8_t delta_exceeds(int32_t a, int32_t b, int32_t band) {
+	int32_t diff = a - b;
+
+	if (diff < 0) {
+		diff = -diff;
+	}
+	return diff > band;
+}
+
+uint8_t delta_check(const packet_sample_t * sample) {
+	uint8_t send;
+
+	delta.sampled++;
+
+	if (!delta.has_last || (delta.suppressed >= DELTA_HEARTBEAT)) {
+		send = 1;
+	} else {
+		send = delta_exceeds(sample->temperature, delta.last.temperature, DELTA_TEMPERATURE)
+				|| delta_exceeds(sample->humidity, delta.last.humidity, DELTA_HUMIDITY)
+				|| delta_exceeds(sample->pressure, delta.last.pressure, DELTA_PRESSURE)
+				|| delta_exceeds(sample->voltage, delta.last.voltage, DELTA_VOLTAGE);
+	}
+
+	if (!send) {
+		delta.suppressed++;
+		return 0;
+	}
+
+	delta.last = *sample;
+	delta.has_last = 1;
+	delta.suppressed = 0;
+	delta.sent++;
+	return 1;
+}
+
+uint16_t delta_suppression_permille(void) {
+	if (delta.sampled == 0) {
+		return 0;
+	}
+	return (uint16_t)(((delta.sampled - delta.sent) * 1000ULL) / delta.sampled);
+}
+
+#endif // USE_SEND_ON_DELTA
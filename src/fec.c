@@ -0,0 +1,87 @@
+/**
+ * Uplink erasure coding for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_UPLINK_FEC
+
+#include <string.h>
+#include "fec.h"
+
+_Static_assert(sizeof(packet_header_t) + sizeof(fec_parity_t)
+		+ FEC_GROUP * (sizeof(uint32_t) + 1) + FEC_SIZE <= PACKET_MAX_SIZE, "FEC_GROUP too big");
+
+fec_t fec;
+
+#if FEC_PARITY > 1
+
+#define FEC_POLY	0x1D		// x^8 + x^4 + x^3 + x^2 + 1, generator 2
+
+// multiplication in GF(2^8), a byte at a time is fast enough for a frame per wake-up
+static uint8_t fec_mul(uint8_t a, uint8_t b) {
+	uint8_t product = 0;
+
+	while (b) {
+		if (b & 1) {
+			product ^= a;
+		}
+		a = (a & 0x80) ? (uint8_t) (a << 1) ^ FEC_POLY : (uint8_t) (a << 1);
+		b >>= 1;
+	}
+	return product;
+}
+
+#endif // FEC_PARITY > 1
+
+void fec_add(const uint8_t * frame, uint8_t length, uint32_t msg_id) {
+#if FEC_PARITY > 1
+	uint8_t coefficient = 1;
+#endif // FEC_PARITY > 1
+	uint8_t i;
+
+	if ((length > FEC_SIZE) || (fec.count == FEC_GROUP)) {
+		return;
+	}
+	for (i = 0; i < length; i++) {
+		fec.parity[FEC_INDEX_XOR][i] ^= frame[i];
+	}
+#if FEC_PARITY > 1
+	// g^count
+	for (i = 0; i < fec.count; i++) {
+		coefficient = fec_mul(coefficient, 2);
+	}
+	for (i = 0; i < length; i++) {
+		fec.parity[FEC_INDEX_RS][i] ^= fec_mul(coefficient, frame[i]);
+	}
+#endif // FEC_PARITY > 1
+
+	fec.msg_id[fec.count] = msg_id;
+	fec.length[fec.count] = length;
+	fec.count++;
+	if (length > fec.size) {
+		fec.size = length;
+	}
+}
+
+uint8_t fec_ready(void) {
+	return fec.count == FEC_GROUP;
+}
+
+uint8_t fec_build(uint8_t * buf, uint32_t msg_id, uint8_t index) {
+	fec_parity_t parity;
+
+	parity.index = index;
+	parity.group = fec.count;
+	return packet_build_parity(buf, msg_id, &parity, fec.msg_id, fec.length,
+			fec.parity[index], fec.size);
+}
+
+void fec_reset(void) {
+	uint32_t groups = fec.groups + 1;
+
+	memset(&fec, 0, sizeof(fec));
+	fec.groups = groups;
+}
+
+#endif // USE_UPLINK_FEC
@@ -0,0 +1,127 @@
+/**
+ * Sample log in external W25Q flash for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_FLASH_LOG
+
+#include <string.h>
+#include "flashlog.h"
+
+flashlog_t flashlog;
+
+static uint32_t flashlog_address(uint32_t index) {
+	return FLASHLOG_BASE + (index % FLASHLOG_CAPACITY) * sizeof(flashlog_record_t);
+}
+
+static uint32_t flashlog_read_index(uint32_t address) {
+	uint32_t index;
+
+	Flash_Read(address, (uint8_t*) &index, sizeof(index));
+	return index;
+}
+
+uint8_t flashlog_init(void) {
+	uint32_t index;
+	uint32_t newest = FLASHLOG_INDEX_EMPTY;
+	uint32_t newest_sector = 0;
+	uint32_t sector;
+	uint32_t i;
+
+	memset(&flashlog, 0, sizeof(flashlog));
+
+	if (!Flash_Init()) {
+		return 0;
+	}
+
+	// the sector with the newest first record holds the head
+	for (sector = 0; sector < FLASHLOG_SECTORS; sector++) {
+		index = flashlog_read_index(FLASHLOG_BASE + sector * EXT_FLASH_SECTOR_SIZE);
+		if ((index != FLASHLOG_INDEX_EMPTY)
+				&& ((newest == FLASHLOG_INDEX_EMPTY) || (index > newest))) {
+			newest = index;
+			newest_sector = sector;
+		}
+	}
+
+	if (newest != FLASHLOG_INDEX_EMPTY) {
+		flashlog.head = newest;
+		for (i = 1; i < FLASHLOG_RECORDS_PER_SECTOR; i++) {
+			index = flashlog_read_index(FLASHLOG_BASE + newest_sector * EXT_FLASH_SECTOR_SIZE
+					+ i * sizeof(flashlog_record_t));
+			if (index == FLASHLOG_INDEX_EMPTY) {
+				break;
+			}
+			flashlog.head = index;
+		}
+		flashlog.head++;
+	}
+
+	// head sector is partly written, the rest of the ring is full
+	if (flashlog.head > FLASHLOG_CAPACITY) {
+		flashlog.tail = flashlog.head - FLASHLOG_CAPACITY
+				+ (FLASHLOG_RECORDS_PER_SECTOR - flashlog.head % FLASHLOG_RECORDS_PER_SECTOR)
+				% FLASHLOG_RECORDS_PER_SECTOR;
+	}
+
+	Flash_PowerDown();
+	flashlog.ready = 1;
+	return 1;
+}
+
+void flashlog_append(uint32_t time, const packet_sample_t * sample) {
+	flashlog_record_t * record;
+
+	if (flashlog.pending == FLASHLOG_BUFFER) {
+		memmove(&flashlog.buffer[0], &flashlog.buffer[1],
+				(FLASHLOG_BUFFER - 1) * sizeof(flashlog_record_t));
+		flashlog.pending--;
+	}
+
+	record = &flashlog.buffer[flashlog.pending++];
+	record->time = time;
+	record->values.temperature = sample->temperature;
+	record->values.humidity = sample->humidity;
+	record->values.pressure = sample->pressure;
+	record->values.voltage = sample->voltage;
+}
+
+void flashlog_flush(void) {
+	uint32_t address;
+	uint8_t i;
+
+	if (!flashlog.ready || (flashlog.pending == 0)) {
+		return;
+	}
+
+	Flash_PowerUp();
+
+	for (i = 0; i < flashlog.pending; i++) {
+		address = flashlog_address(flashlog.head);
+		if ((address % EXT_FLASH_SECTOR_SIZE) == 0) {
+			Flash_SErase4k(address);
+			if (flashlog.head >= FLASHLOG_CAPACITY) {
+				flashlog.tail = flashlog.head - FLASHLOG_CAPACITY + FLASHLOG_RECORDS_PER_SECTOR;
+			}
+		}
+		flashlog.buffer[i].index = flashlog.head++;
+		// records never cross a page, sizeof(flashlog_record_t) divides EXT_FLASH_PAGE_SIZE
+		Flash_Write(address, (uint8_t*) &flashlog.buffer[i], sizeof(flashlog_record_t));
+	}
+	flashlog.pending = 0;
+
+	Flash_PowerDown();
+}
+
+uint8_t flashlog_read(uint32_t index, flashlog_record_t * record) {
+	if (!flashlog.ready || (index < flashlog.tail) || (index >= flashlog.head)) {
+		return 0;
+	}
+	Flash_PowerUp();
+	Flash_Read(flashlog_address(index), (uint8_t*) record, sizeof(flashlog_record_t));
+	Flash_PowerDown();
+	return record->index == index;
+}
+
+#endif // USE_FLASH_LOG
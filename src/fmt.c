@@ -0,0 +1,84 @@
+/**
+ * Integer formatter for LoggerSoft
+ */
+
+#include "fmt.h"
+
+char * fmt_str(char * dst, const char * src) {
+	while (*src) {
+		*dst++ = *src++;
+	}
+	*dst = '\0';
+	return dst;
+}
+
+// digits are produced backwards into a scratch buffer, then copied
+static char * fmt_digits(char * dst, uint32_t value, uint8_t min_digits) {
+	char scratch[10];
+	uint8_t n = 0;
+
+	do {
+		scratch[n++] = '0' + (value % 10);
+		value /= 10;
+	} while (value || (n < min_digits));
+
+	while (n) {
+		*dst++ = scratch[--n];
+	}
+	*dst = '\0';
+	return dst;
+}
+
+char * fmt_uint(char * dst, uint32_t value) {
+	return fmt_digits(dst, value, 1);
+}
+
+char * fmt_int(char * dst, int32_t value) {
+	if (value < 0) {
+		*dst++ = '-';
+		// negate as unsigned, INT32_MIN has no positive counterpart
+		return fmt_digits(dst, 0U - (uint32_t) value, 1);
+	}
+	return fmt_digits(dst, value, 1);
+}
+
+char * fmt_hex(char * dst, uint32_t value, uint8_t digits) {
+	static const char hex[] = "0123456789ABCDEF";
+	uint8_t n = 8;
+
+	// skip leading zeros beyond requested width
+	while ((n > 1) && (n > digits) && !(value >> ((n - 1) * 4))) {
+		n--;
+	}
+	while (n) {
+		n--;
+		*dst++ = hex[(value >> (n * 4)) & 0x0F];
+	}
+	*dst = '\0';
+	return dst;
+}
+
+char * fmt_fixed(char * dst, int32_t value, uint8_t decimals) {
+	uint32_t magnitude;
+	uint32_t scale = 1;
+	uint8_t i;
+
+	if (decimals == 0) {
+		return fmt_int(dst, value);
+	}
+
+	for (i = 0; i < decimals; i++) {
+		scale *= 10;
+	}
+
+	if (value < 0) {
+		*dst++ = '-';
+		magnitude = 0U - (uint32_t) value;
+	} else {
+		magnitude = value;
+	}
+
+	dst = fmt_digits(dst, magnitude / scale, 1);
+	*dst++ = '.';
+	return fmt_digits(dst, magnitude % scale, decimals);
+}
@@ -358,7 +358,10 @@ void msd_adc_init(void)
     adc_init_parameter.resolution_select = ADC_RESOLUTION_12B;
     adc_init_parameter.data_alignment = ADC_DATAALIGN_RIGHT;
     adc_init_parameter.scan_mode = DISABLE;
-    adc_init_parameter.oversample_config.oversample_mode = DISABLE;
+    adc_init_parameter.oversample_config.oversample_mode = ENABLE;
+    adc_init_parameter.oversample_config.oversample_ratio = ADC_OVERSAMPLE_RATIO_MUL16;
+    adc_init_parameter.oversample_config.oversample_shift = ADC_OVERSAMPLE_SHIFT_NONE;
+    adc_init_parameter.oversample_config.oversample_triggermode = ADC_OVERSAMPLE_ALL_CONVERT;
     hal_adc_init(&adc_info, &adc_init_parameter);
 
     adc_reginit_parameter.length = 1;
@@ -370,7 +373,7 @@ void msd_adc_init(void)
 
     adc_regchannel_parameter.regular_channel = ADC_CHANNEL_9;
     adc_regchannel_parameter.regular_sequence = ADC_REGULAR_SEQUENCE_0;
-    adc_regchannel_parameter.sample_time = ADC_SAMPLETIME_239POINT5;
+    adc_regchannel_parameter.sample_time = ADC_SAMPLETIME_71POINT5;
     hal_adc_regular_channel_config(&adc_info, &adc_regchannel_parameter);
 
     hal_adc_calibration(&adc_info);
@@ -457,6 +460,10 @@ void msd_rtc_init(void)
     hal_rtc_init(&rtc_init_parameter);
 
     /* user code [rtc_init local 1] begin */
+#ifdef USE_RTC_CALIBRATION
+    // prescalers above assume 32768 Hz, IRC40K is far off
+    rtccal_run();
+#endif // USE_RTC_CALIBRATION
     /* user code [rtc_init local 1] end */
 }
 
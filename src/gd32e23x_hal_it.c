@@ -32,6 +32,7 @@ OF SUCH DAMAGE.
 #include "gd32e23x_hal_it.h"
 #include "gd32e23x_hal.h"
 #include "gd32e23x_hal_init.h"
+#include "main.h"
 
 void NMI_Handler(void)
 {
@@ -41,6 +42,8 @@ void NMI_Handler(void)
     /* user code [NonMaskableInt_IRQn local 1] end */
 }
 
+#ifndef USE_CRASH_LOG
+// with USE_CRASH_LOG in crashlog.c, it needs the stack frame untouched
 void HardFault_Handler(void)
 {
     /* user code [HardFault_IRQn local 0] begin */
@@ -52,6 +55,7 @@ void HardFault_Handler(void)
     /* user code [HardFault_IRQn local 1] begin */
     /* user code [HardFault_IRQn local 1] end */
 }
+#endif // USE_CRASH_LOG
 
 void SVC_Handler(void)
 {
@@ -66,6 +70,17 @@ void RTC_IRQHandler(void)
 	hal_rtc_irq();
 }
 
+void EXTI4_15_IRQHandler(void)
+{
+#ifdef USE_FHSS
+	if (exti_interrupt_flag_get(SX_DIO1_EXTI) != RESET)
+	{
+		exti_interrupt_flag_clear(SX_DIO1_EXTI);
+		SX1278_hop(&SX1278);
+	}
+#endif // USE_FHSS
+}
+
 
 void PendSV_Handler(void)
 {
@@ -96,9 +111,28 @@ void TIMER0_BRK_UP_TRG_COM_IRQHandler(void)
 void USART1_IRQHandler(void)
 {
     /* user code [USART1_IRQn local 0] begin */
+#ifdef USE_CONSOLE
+    console_irq();
+    return;
+#endif // USE_CONSOLE
     /* user code [USART1_IRQn local 0] end */
     hal_uart_irq(&uart1_info);
     /* user code [USART1_IRQn local 1] begin */
-    hal_uart_transmit_poll(&uart1_info, "USART1_IRQHandler\r\n", 19, 1000);
     /* user code [USART1_IRQn local 1] end */
 }
+
+void DMA_Channel1_2_IRQHandler(void)
+{
+#ifdef USE_SPI_BUS
+    spibus_dma_irq(&spibus0);
+#endif // USE_SPI_BUS
+}
+
+void DMA_Channel3_4_IRQHandler(void)
+{
+#ifdef USE_CONSOLE
+    console_dma_irq();
+#elif defined(USE_SPI_BUS)
+    spibus_dma_irq(&spibus1);
+#endif // USE_CONSOLE
+}
@@ -3,9 +3,13 @@
 
 #include "main.h"
 
+#include <string.h>
+
 const uint32_t logger_id __attribute__((section(".logger_id"), used)) = LOGGER_ID;
 const uint32_t magic_signature __attribute__((section(".magic_signature"), used)) = MAGIC_SIGNATURE;
 
+uint8_t sleep_minutes = SLEEP_MINUTES;
+
 #ifdef USE_BME280_SPI
 
 BME280_t bme;
@@ -26,35 +30,837 @@ BMP280_HandleTypedef bmp280;
 
 SX1278_t SX1278;
 SX1278_hw_t SX1278_hw;
-struct txPack {
-	uint32_t device_id;
-	uint32_t msg_id;
-	float humidity;
-	float temperature;
-	float pressure;
-	float voltage;
-};
+
+packet_sample_t samples[PACKET_MAX_SAMPLES];
+uint8_t samples_count = 0;
+uint8_t sample_seq = 0;
+uint32_t msg_id = 1;
+uint8_t tx_buffer[PACKET_MAX_SIZE];
+uint8_t lora_power = LORA_POWER;
+uint8_t lora_sf = LORA_SF;
+
+#ifdef USE_AGGREGATION
+aggregate_t window;
+packet_stats_t stats[PACKET_MAX_STATS];
+uint8_t stats_count = 0;
+#endif // USE_AGGREGATION
+
+#ifdef USE_TIMESTAMPS
+// sched_uptime() of queued records, converted to wall time when sent
+uint32_t sample_times[PACKET_MAX_SAMPLES];
+#ifdef USE_AGGREGATION
+uint32_t stats_times[PACKET_MAX_STATS];
+uint32_t window_time;
+#endif // USE_AGGREGATION
+#endif // USE_TIMESTAMPS
+
+#ifdef USE_RELAY
+uint8_t relay_buffer[RELAY_FRAME_MAX];
+#endif // USE_RELAY
+
+#ifdef USE_OTA
+// image is installed, reset into the bootloader at the end of the uplink
+uint8_t ota_reset = 0;
+// gd32e23x_flash_ota.ld only, any other script fails the link
+extern uint32_t __ota_app[];
+#endif // USE_OTA
+
+#ifdef USE_IMPLICIT_HEADER
+uint32_t implicit_frames = 0;
+int32_t implicit_saved_us = 0;
+#endif // USE_IMPLICIT_HEADER
 
 #endif // USE_RA_01_SENDER
 
 
-void uart_trns_cmpd(hal_uart_dev_struct *uart)
+void emptyFunc()
 {
 
 }
 
-void uart_recv_byte(hal_uart_dev_struct *uart)
+void uart_print(const char * str)
 {
-	hal_uart_transmit_interrupt(&uart1_info, "p\r\n", 3, uart_trns_cmpd);
+#ifdef USE_CONSOLE
+	console_print(str);
+#else
+	hal_uart_transmit_poll(&uart1_info, (void*)str, strlen(str), 1000);
+#endif // USE_CONSOLE
 }
 
-void emptyFunc()
+// Unix time once synchronized, uptime before
+uint32_t wall_time(uint32_t uptime)
+{
+#ifdef USE_TIME_SYNC
+	return timesync_time(uptime);
+#else
+	return uptime;
+#endif // USE_TIME_SYNC
+}
+
+// SCHED_*_PERIOD_S follow the base period
+void set_periods(void)
+{
+	uint32_t mul = 1;
+
+#ifdef USE_BATTERY_POLICY
+	mul = policy_current()->interval_mul;
+#endif // USE_BATTERY_POLICY
+
+	sched_set_period(SCHED_BATTERY, SCHED_BATTERY_PERIOD_S * sleep_minutes / SLEEP_MINUTES);
+	sched_set_period(SCHED_SENSOR, SCHED_SENSOR_PERIOD_S * sleep_minutes / SLEEP_MINUTES * mul);
+	sched_set_period(SCHED_UPLINK, SCHED_UPLINK_PERIOD_S * sleep_minutes / SLEEP_MINUTES * mul);
+}
+
+#ifdef USE_RA_01_SENDER
+
+#ifdef LORA_PREAMBLE_MIN_MS
+// preamble symbols that last LORA_PREAMBLE_MIN_MS at the current SF and BW
+void lora_preamble(void)
+{
+	uint32_t symbol_us = SX1278_symbol_us(&SX1278);
+	uint32_t preamble = (LORA_PREAMBLE_MIN_MS * 1000UL + symbol_us - 1) / symbol_us;
+	uint32_t timeout;
+
+	if (preamble < LORA_PREAMBLE)
+	{
+		preamble = LORA_PREAMBLE;
+	}
+	if (preamble > UINT16_MAX)
+	{
+		preamble = UINT16_MAX;
+	}
+	// a single RX has to wait out the longer preamble
+	timeout = (preamble > LORA_SYMBOL_TIMEOUT) ? preamble : LORA_SYMBOL_TIMEOUT;
+	SX1278_set_preamble(&SX1278, preamble,
+			(timeout > SX1278_SYMBOL_TIMEOUT_MAX) ? SX1278_SYMBOL_TIMEOUT_MAX : timeout);
+}
+#endif // LORA_PREAMBLE_MIN_MS
+
+// frame on the current channel
+int lora_transmit(uint8_t * data, uint8_t length)
 {
+#ifdef USE_CRASH_LOG
+	uint8_t phase;
+#endif // USE_CRASH_LOG
+	int ret;
+
+#ifdef LORA_PREAMBLE_MIN_MS
+	lora_preamble();
+#endif // LORA_PREAMBLE_MIN_MS
+	if (!SX1278_LoRaEntryTx(&SX1278, length, 50))
+	{
+		return 0;
+	}
+#ifdef USE_CRASH_LOG
+	// PA current, the likely moment for a brown-out
+	phase = crashlog_phase(CRASH_PHASE_TX);
+	// frames go out back to back, each may take LORA_TX_TIMEOUT_MS
+	crashlog_feed();
+#endif // USE_CRASH_LOG
+	SX1278_LoRaTxStart(&SX1278, data, length);
+
+#ifdef USE_BATTERY_MONITOR
+	// catch battery sag while PA is on
+	SX1278_hw_DelayMs(BATTERY_LOAD_SAMPLE_DELAY_MS);
+	battery_sample_load();
+#endif // USE_BATTERY_MONITOR
+
+	ret = SX1278_LoRaTxWait(&SX1278, LORA_TX_TIMEOUT_MS);
+#ifdef USE_CRASH_LOG
+	crashlog_phase(phase);
+#endif // USE_CRASH_LOG
+	return ret;
+}
 
+// uplink frame, on a channel of its own with USE_CHANNEL_PLAN,
+// data has room for IMPLICIT_HEADER_LENGTH bytes with USE_IMPLICIT_HEADER
+int lora_send(uint8_t * data, uint8_t length)
+{
+#ifdef USE_IMPLICIT_HEADER
+	uint8_t sync_word;
+	int ret;
+#endif // USE_IMPLICIT_HEADER
+
+#ifdef USE_CHANNEL_PLAN
+	channel_hop(&SX1278, msg_id);
+#endif // USE_CHANNEL_PLAN
+#ifdef USE_IMPLICIT_HEADER
+	if (length <= IMPLICIT_HEADER_LENGTH)
+	{
+		memset(data + length, 0, IMPLICIT_HEADER_LENGTH - length);
+		// to the implicit receiver of the gateway only
+		sync_word = SX1278.sync_word;
+		SX1278.sync_word = IMPLICIT_SYNC_WORD;
+		SX1278.implicit_header = 1;
+		ret = lora_transmit(data, IMPLICIT_HEADER_LENGTH);
+		SX1278.implicit_header = 0;
+		SX1278.sync_word = sync_word;
+		if (ret)
+		{
+			implicit_frames++;
+			implicit_saved_us += (int32_t) SX1278_time_on_air_us(&SX1278, length, 0)
+					- (int32_t) SX1278_time_on_air_us(&SX1278, IMPLICIT_HEADER_LENGTH, 1);
+		}
+		return ret;
+	}
+#endif // USE_IMPLICIT_HEADER
+	return lora_transmit(data, length);
+}
+
+#ifdef USE_CRASH_LOG
+// post-mortem of the previous run, once per reset, on the settings of the samples before
+void send_crash_report(void)
+{
+	if (crashlog.pending)
+	{
+		if (lora_send(tx_buffer, packet_build_crash(tx_buffer, msg_id, &crashlog.report)))
+		{
+			msg_id++;
+			crashlog.pending = 0;
+		}
+	}
 }
+#endif // USE_CRASH_LOG
+
+#ifdef USE_FHSS
+
+static const uint32_t fhss_channels[] = FHSS_CHANNELS;
+
+#define FHSS_COUNT	(sizeof(fhss_channels) / sizeof(fhss_channels[0]))
+
+static uint8_t fhss_frf[FHSS_COUNT][3];
+
+// hop table and FhssChangeChannel interrupt on DIO1
+void fhss_init(void)
+{
+	uint8_t i;
+
+	for (i = 0; i < FHSS_COUNT; i++)
+	{
+		SX1278_frf(fhss_channels[i], fhss_frf[i]);
+	}
+
+	rcu_periph_clock_enable(RCU_CFGCMP);
+	syscfg_exti_line_config(EXTI_SOURCE_GPIOA, SX_DIO1_EXTI_SOURCE);
+	exti_init(SX_DIO1_EXTI, EXTI_INTERRUPT, EXTI_TRIG_RISING);
+	exti_interrupt_flag_clear(SX_DIO1_EXTI);
+	nvic_irq_enable(SX_DIO1_IRQn, 1);
+
+	SX1278_hw.dio1_irq = SX_DIO1_IRQn;
+	SX1278_hw.dio1_irq_used = 1;
+#ifdef USE_SPI_BUS
+	// the hop talks to the radio, not while the flash has the bus
+	spibus_guard(spibus_of(SX1278_hw.spi->periph), SX_DIO1_IRQn);
+#endif // USE_SPI_BUS
+	SX1278_set_fhss(&SX1278, (const uint8_t (*)[3]) fhss_frf, FHSS_COUNT,
+			FHSS_HOP_SYMBOLS, FHSS_MIN_SF);
+}
+
+#endif // USE_FHSS
+
+#ifdef USE_DOWNLINK
+
+// radio must be in continuous RX, returns frame length or 0 after window_ms,
+// or after max_ms if a preamble or header is being received then
+uint8_t lora_receive_max(uint32_t window_ms, uint32_t max_ms)
+{
+	uint32_t waited = 0;
+	uint8_t length = 0;
+#ifdef USE_CRASH_LOG
+	uint8_t phase = crashlog_phase(CRASH_PHASE_RX);
+#endif // USE_CRASH_LOG
+
+	while (1)
+	{
+		if (SX1278_LoRaRxPacket(&SX1278))
+		{
+			length = SX1278.readBytes;
+			break;
+		}
+		// keep listening while a preamble or header is being received
+		if ((waited >= window_ms) && !(SX1278_SPIRead(&SX1278, LR_RegModemStat) & 0x01))
+		{
+			break;
+		}
+		if (waited >= max_ms)
+		{
+			break;
+		}
+#ifdef USE_CRASH_LOG
+		// a TDMA scan listens for a whole period
+		crashlog_feed();
+#endif // USE_CRASH_LOG
+		SX1278_hw_DelayMs(1);
+		waited++;
+	}
+#ifdef USE_CRASH_LOG
+	crashlog_phase(phase);
+#endif // USE_CRASH_LOG
+	return length;
+}
+
+// a frame detected late in the window may take LORA_TX_TIMEOUT_MS to arrive
+uint8_t lora_receive(uint32_t window_ms)
+{
+	return lora_receive_max(window_ms, window_ms + LORA_TX_TIMEOUT_MS);
+}
+
+void downlink_dispatch(const uint8_t * frame, uint8_t length)
+{
+	downlink_header_t header;
+
+	if (length < sizeof(header))
+	{
+		return;
+	}
+	memcpy(&header, frame, sizeof(header));
+	if ((header.device_id != DEVICE_ID) && (header.device_id != DOWNLINK_BROADCAST))
+	{
+		return;
+	}
+#ifdef USE_REMOTE_CONFIG
+	if (header.device_id == DEVICE_ID)
+	{
+		// the gateway hears the node on its current settings
+		config_heard();
+	}
+#endif // USE_REMOTE_CONFIG
+
+	switch (header.type)
+	{
+#ifdef USE_OTA
+	case DOWNLINK_TYPE_OTA_START:
+	case DOWNLINK_TYPE_OTA_FRAGMENT:
+	case DOWNLINK_TYPE_OTA_PARITY:
+		ota_downlink(header.type, frame + sizeof(header), length - sizeof(header));
+		break;
+#endif // USE_OTA
+#if defined(USE_ADR) || defined(USE_TIME_SYNC) || defined(USE_BACKFILL)
+	case DOWNLINK_TYPE_ACK:
+#ifdef USE_ADR
+		adr_downlink(frame + sizeof(header), length - sizeof(header));
+#endif // USE_ADR
+#ifdef USE_TIME_SYNC
+		timesync_ack(frame + sizeof(header), length - sizeof(header));
+#endif // USE_TIME_SYNC
+#ifdef USE_BACKFILL
+		backfill_ack(frame + sizeof(header), length - sizeof(header));
+#endif // USE_BACKFILL
+		break;
+#endif // USE_ADR || USE_TIME_SYNC || USE_BACKFILL
+#ifdef USE_REMOTE_CONFIG
+	case DOWNLINK_TYPE_CONFIG:
+		config_downlink(frame + sizeof(header), length - sizeof(header),
+				header.device_id == DOWNLINK_BROADCAST);
+		break;
+#endif // USE_REMOTE_CONFIG
+#ifdef USE_TDMA
+	case DOWNLINK_TYPE_BEACON:
+		tdma_beacon(frame + sizeof(header), length - sizeof(header));
+		break;
+#endif // USE_TDMA
+	default:
+		break;
+	}
+}
+
+// receive window after an uplink, the gateway sends queued frames back to back
+void downlink_receive(void)
+{
+	uint8_t frames;
+	uint8_t length;
+
+	if (!SX1278_LoRaEntryRx(&SX1278, SX1278_MAX_PACKET - 1, DOWNLINK_WINDOW_MS))
+	{
+		return;
+	}
+	for (frames = 0; frames < DOWNLINK_MAX_FRAMES; frames++)
+	{
+		length = lora_receive(DOWNLINK_WINDOW_MS);
+		if (length == 0)
+		{
+			break;
+		}
+		downlink_dispatch(SX1278.rxBuffer, length);
+	}
+	SX1278_standby(&SX1278);
+}
+
+#ifdef USE_TDMA
+
+// beacon window, or a scan of a whole period while not synchronized
+void beacon_receive(void)
+{
+	uint32_t window = tdma_window_open();
+	uint32_t start = hal_basetick_count_get();
+	uint32_t elapsed;
+	uint8_t length;
+
+	SX1278.LoRa_SF = TDMA_BEACON_SF;
+#ifdef USE_CHANNEL_PLAN
+	channel_home(&SX1278);
+#endif // USE_CHANNEL_PLAN
+	if (SX1278_LoRaEntryRx(&SX1278, SX1278_MAX_PACKET - 1, 50))
+	{
+		while (!tdma.received)
+		{
+			elapsed = hal_basetick_count_get() - start;
+			if (elapsed >= window)
+			{
+				break;
+			}
+			length = lora_receive(window - elapsed);
+			if (length == 0)
+			{
+				break;
+			}
+			downlink_dispatch(SX1278.rxBuffer, length);
+		}
+		SX1278_standby(&SX1278);
+	}
+	tdma_window_close();
+}
+
+#endif // USE_TDMA
+
+// answers to downlinks, sent right after the receive window
+void send_reports(void)
+{
+#ifdef USE_OTA
+	ota_report_t ota_state;
+
+	if (ota_report(&ota_state))
+	{
+		lora_send(tx_buffer, packet_build_ota(tx_buffer, msg_id++, &ota_state));
+	}
+#endif // USE_OTA
+#ifdef USE_REMOTE_CONFIG
+	config_report_t config_state;
+
+	if (config_report(&config_state))
+	{
+		lora_send(tx_buffer, packet_build_config(tx_buffer, msg_id++, &config_state));
+	}
+#endif // USE_REMOTE_CONFIG
+}
+
+// what the frames of the last window asked for, after every window of an uplink
+void downlink_process(void)
+{
+#ifdef USE_TIME_SYNC
+	timesync_apply();
+#endif // USE_TIME_SYNC
+#ifdef USE_OTA
+	if (ota_process())
+	{
+		ota_reset = 1;
+	}
+#endif // USE_OTA
+	send_reports();
+}
+
+#ifdef USE_BACKFILL
+
+// logged records the gateway missed, after the live uplink got through
+void send_backfill(uint32_t now)
+{
+	uint32_t start;
+#ifdef USE_TDMA
+	uint32_t cycle = backfill.airtime_ms + DOWNLINK_WINDOW_MS;
+#endif // USE_TDMA
+	uint8_t frames;
+	uint8_t length;
+	uint8_t acked;
+
+	// log and radio share the SPI bus, it is started already
+	for (frames = 0; frames < BACKFILL_MAX_FRAMES; frames++)
+	{
+#ifdef USE_TDMA
+		// frame and its window end in the own slot, the last one is the estimate
+		if (cycle > tdma_slot_left())
+		{
+			break;
+		}
+#endif // USE_TDMA
+		length = backfill_build(tx_buffer, msg_id, sched_uptime(now));
+		if (length == 0)
+		{
+			break;
+		}
+		start = hal_basetick_count_get();
+		if (!lora_send(tx_buffer, length))
+		{
+			break;
+		}
+		backfill_sent(hal_basetick_count_get() - start);
+		msg_id++;
+		downlink_receive();
+		acked = backfill_window_end();
+		downlink_process();
+#ifdef USE_OTA
+		if (ota_reset)
+		{
+			break;
+		}
+#endif // USE_OTA
+		if (!acked)
+		{
+			break;
+		}
+#ifdef USE_TDMA
+		cycle = hal_basetick_count_get() - start;
+#endif // USE_TDMA
+	}
+}
+
+#endif // USE_BACKFILL
+
+#endif // USE_DOWNLINK
+
+#ifdef USE_UPLINK_FEC
+
+// parity frames once a group of data frames went out
+void send_parity(void)
+{
+	uint8_t index;
+
+	if (!fec_ready())
+	{
+		return;
+	}
+	for (index = 0; index < FEC_PARITY; index++)
+	{
+		lora_send(tx_buffer, fec_build(tx_buffer, msg_id++, index));
+	}
+	fec_reset();
+}
+
+#endif // USE_UPLINK_FEC
+
+#ifdef USE_RELAY
+
+// downstream frames until the deadline or a full batch, acknowledged at once
+void relay_receive(uint32_t next)
+{
+#ifdef RELAY_ACK
+	uint8_t ack[sizeof(downlink_header_t) + sizeof(downlink_ack_t)];
+	uint32_t tx_start;
+#endif // RELAY_ACK
+	uint32_t start = hal_basetick_count_get();
+	uint32_t tx_ms = 0;
+	uint32_t now;
+	uint32_t left;
+	uint16_t ms;
+	uint8_t listening = 0;
+	uint8_t length;
+	int8_t snr;
+	int16_t rssi;
+
+	SX1278.LoRa_SF = RELAY_RX_SF;
+	SX1278.power = lora_power;
+	while ((sched_clock() < next) && !relay_ready(sched_clock()))
+	{
+		if (!listening && !SX1278_LoRaEntryRx(&SX1278, SX1278_MAX_PACKET - 1, 50))
+		{
+			break;
+		}
+		listening = 1;
+		// a frame still arriving at the deadline is cut off, the own uplink is due
+		now = sched_clock_fine(&ms);
+		left = (now < next) ? (next - now) * 1000UL - ms : 0;
+		length = lora_receive_max((left < 1000) ? left : 1000, left);
+		if (length == 0)
+		{
+			continue;
+		}
+		// packet RSSI on the 433 MHz port, corrected below the noise floor
+		snr = (int8_t) SX1278_SPIRead(&SX1278, LR_RegPktSnrValue);
+		rssi = SX1278_SPIRead(&SX1278, LR_RegPktRssiValue) - 164 + ((snr < 0) ? snr / 4 : 0);
+		if (!relay_frame(SX1278.rxBuffer, length, snr, rssi, sched_clock()))
+		{
+			continue;
+		}
+#ifdef RELAY_ACK
+		// the node listens right after its TX, on this channel
+		tx_start = hal_basetick_count_get();
+		lora_transmit(ack, relay_build_ack(ack, SX1278.rxBuffer, snr, rssi));
+		tx_ms += hal_basetick_count_get() - tx_start;
+		listening = 0;
+#endif // RELAY_ACK
+	}
+	SX1278_standby(&SX1278);
+	relay_account(hal_basetick_count_get() - start - tx_ms, tx_ms);
+}
+
+// queued downstream frames on the own settings, statistics with diagnostics
+void send_relay(uint8_t report)
+{
+	relay_report_t stats;
+	uint32_t start = hal_basetick_count_get();
+	uint8_t frames;
+	uint8_t length;
+
+	SX1278.power = lora_power;
+	SX1278.LoRa_SF = lora_sf;
+	if (report)
+	{
+		relay_report(&stats);
+		lora_send(tx_buffer, packet_build_relay_report(tx_buffer, msg_id++, &stats));
+	}
+	for (frames = 0; frames < RELAY_MAX_FRAMES; frames++)
+	{
+		length = relay_build(relay_buffer, &msg_id);
+		if ((length == 0) || !lora_send(relay_buffer, length))
+		{
+			break;
+		}
+		relay_forwarded();
+	}
+	relay_account(0, hal_basetick_count_get() - start);
+}
+
+#endif // USE_RELAY
+
+#ifdef USE_REMOTE_CONFIG
+
+// takes effect with the next TX or RX entry, see SX1278_update_config()
+void apply_config(void)
+{
+	lora_sf = config.values.sf;
+	lora_power = config.values.power;
+	SX1278.LoRa_BW = config.values.bw;
+	SX1278.sync_word = config.values.sync_word;
+	sleep_minutes = config.values.sleep_minutes;
+	set_periods();
+#ifdef USE_ADR
+	// new base settings restart ADR
+	adr_init(lora_sf, lora_power);
+#endif // USE_ADR
+	config.changed = 0;
+}
+
+#endif // USE_REMOTE_CONFIG
+
+#ifdef USE_AGGREGATION
+
+void close_window(void)
+{
+	if (window.count == 0)
+	{
+		return;
+	}
+	// queue is full only when uplinks are off, keep the newest windows
+	if (stats_count == PACKET_MAX_STATS)
+	{
+		memmove(&stats[0], &stats[1], (PACKET_MAX_STATS - 1) * sizeof(packet_stats_t));
+#ifdef USE_TIMESTAMPS
+		memmove(&stats_times[0], &stats_times[1], (PACKET_MAX_STATS - 1) * sizeof(uint32_t));
+#endif // USE_TIMESTAMPS
+#ifdef USE_BACKFILL
+		backfill_dropped();
+#endif // USE_BACKFILL
+		stats_count--;
+	}
+#ifdef USE_TIMESTAMPS
+	stats_times[stats_count] = window_time;
+#endif // USE_TIMESTAMPS
+	aggregate_get(&window, &stats[stats_count++]);
+	aggregate_reset(&window);
+}
+
+#endif // USE_AGGREGATION
+
+void store_sample(uint32_t time, float temperature, float humidity, float pressure, uint16_t voltage)
+{
+	packet_sample_t sample;
+
+	packet_fill_sample(&sample, sample_seq++, temperature, humidity, pressure, voltage);
+
+#ifdef USE_FLASH_LOG
+	// log keeps every sample, whatever the uplink sends
+	flashlog_append(wall_time(sched_uptime(time)), &sample);
+#endif // USE_FLASH_LOG
+
+#ifdef USE_AGGREGATION
+#ifdef USE_TIMESTAMPS
+	window_time = sched_uptime(time);
+#endif // USE_TIMESTAMPS
+	aggregate_add(&window, &sample);
+	// uplink closes the window, this bounds it while uplinks stay away
+	if (window.count >= AGGREGATE_WINDOW)
+	{
+		close_window();
+	}
+	return;
+#endif // USE_AGGREGATION
+
+#ifdef USE_SEND_ON_DELTA
+	if (!delta_check(&sample))
+	{
+		return;
+	}
+#endif // USE_SEND_ON_DELTA
+
+	// queue is full only when uplinks are off, keep the newest samples
+	if (samples_count == PACKET_MAX_SAMPLES)
+	{
+		memmove(&samples[0], &samples[1], (PACKET_MAX_SAMPLES - 1) * sizeof(packet_sample_t));
+#ifdef USE_TIMESTAMPS
+		memmove(&sample_times[0], &sample_times[1], (PACKET_MAX_SAMPLES - 1) * sizeof(uint32_t));
+#endif // USE_TIMESTAMPS
+#ifdef USE_BACKFILL
+		backfill_dropped();
+#endif // USE_BACKFILL
+		samples_count--;
+	}
+#ifdef USE_TIMESTAMPS
+	sample_times[samples_count] = sched_uptime(time);
+#endif // USE_TIMESTAMPS
+	samples[samples_count++] = sample;
+}
+
+void fill_status(packet_status_t * status)
+{
+	memset(status, 0, sizeof(packet_status_t));
+#ifdef USE_BATTERY_POLICY
+	status->profile = policy.profile;
+	status->prev_profile = policy.prev_profile;
+#endif // USE_BATTERY_POLICY
+#ifdef USE_BATTERY_MONITOR
+	status->voltage = battery.idle_mv;
+	status->voltage_load = battery.load_mv;
+	status->trend = (battery.trend > INT16_MAX) ? INT16_MAX :
+			(battery.trend < INT16_MIN) ? INT16_MIN : (int16_t)battery.trend;
+#endif // USE_BATTERY_MONITOR
+}
+
+int send_samples(uint8_t diag)
+{
+	packet_status_t status_record;
+	packet_status_t * status = NULL;
+	const uint32_t * times = NULL;
+	uint8_t unix_time = 0;
+	uint8_t length;
+	uint8_t count;
+	uint8_t store_only = 0;
+	int ret;
+#ifdef USE_TIMESTAMPS
+	uint32_t times_record[PACKET_MAX_SAMPLES];
+	uint8_t i;
+#endif // USE_TIMESTAMPS
+
+	if (diag)
+	{
+		status = &status_record;
+	}
+
+#ifdef USE_BATTERY_POLICY
+	// report profile transition once
+	if (policy.changed)
+	{
+		status = &status_record;
+	}
+
+	SX1278.power = policy_tx_power(lora_power);
+	SX1278.LoRa_SF = policy_tx_sf(lora_sf);
+	store_only = policy_current()->store_only;
+#else
+	SX1278.power = lora_power;
+	SX1278.LoRa_SF = lora_sf;
+#endif // USE_BATTERY_POLICY
+
+	if (status != NULL)
+	{
+		fill_status(status);
+	}
+
+#ifdef USE_TIMESTAMPS
+#ifdef USE_AGGREGATION
+	for (i = 0; i < stats_count; i++)
+	{
+		times_record[i] = wall_time(stats_times[i]);
+	}
+#else
+	for (i = 0; i < samples_count; i++)
+	{
+		times_record[i] = wall_time(sample_times[i]);
+	}
+#endif // USE_AGGREGATION
+	times = times_record;
+#ifdef USE_TIME_SYNC
+	unix_time = timesync.synced;
+#endif // USE_TIME_SYNC
+#endif // USE_TIMESTAMPS
+
+#ifdef USE_AGGREGATION
+	count = stats_count;
+#else
+	count = samples_count;
+#endif // USE_AGGREGATION
+	// store-only sends the status alone, samples stay queued
+	if (store_only)
+	{
+		count = 0;
+	}
+
+#ifdef USE_AGGREGATION
+	length = packet_build_stats(tx_buffer, msg_id, stats, count, status, times, unix_time);
+#else
+	length = packet_build(tx_buffer, msg_id, samples, count, status, times, unix_time);
+#endif // USE_AGGREGATION
+	ret = lora_send(tx_buffer, length);
+#ifdef USE_UPLINK_FEC
+	if (ret)
+	{
+		fec_add(tx_buffer, length, msg_id);
+	}
+#endif // USE_UPLINK_FEC
+	msg_id++;
+
+	if (ret && !store_only)
+	{
+		samples_count = 0;
+#ifdef USE_AGGREGATION
+		stats_count = 0;
+#endif // USE_AGGREGATION
+	}
+#ifdef USE_BATTERY_POLICY
+	if (ret)
+	{
+		policy.changed = 0;
+	}
+#endif // USE_BATTERY_POLICY
+	return ret;
+}
+
+uint8_t uplink_ready(uint8_t batch)
+{
+#ifdef USE_AGGREGATION
+	// batch counts windows here, a frame holds no more than PACKET_MAX_STATS
+	return stats_count >= ((batch < PACKET_MAX_STATS) ? batch : PACKET_MAX_STATS);
+#else
+	return samples_count >= batch;
+#endif // USE_AGGREGATION
+}
+
+#endif // USE_RA_01_SENDER
 
 int main(void)
 {
+#ifdef USE_MEM_STATS
+    // before anything runs on the stack that is to be measured
+    memstat_paint();
+#endif // USE_MEM_STATS
+#ifdef USE_CRASH_LOG
+    // watchdog covers the clock setup already
+    crashlog_init();
+#endif // USE_CRASH_LOG
+
+#ifdef USE_OTA
+    // application is linked behind the bootloader
+    SCB->VTOR = (uint32_t) __ota_app;
+#endif // USE_OTA
+
     msd_system_init();
     msd_clock_init();
 
@@ -67,11 +873,26 @@ int main(void)
     msd_timer0_init();
     msd_timer2_init();
     msd_usart1_init();
-
-    char buffer[256];
-    float dataToSend[4];
-    uint32_t message_length;
+#ifdef USE_SPI_BUS
+    spibus_init(&spibus0, SPI0, SPIBUS0_DMA);
+    spibus_init(&spibus1, SPI1, SPIBUS1_DMA);
+#endif // USE_SPI_BUS
+
+    char buffer[64];
+    char * p;
+#ifndef USE_BATTERY_MONITOR
     uint16_t adc_raw_value;
+#endif // USE_BATTERY_MONITOR
+    uint16_t voltage;
+    uint8_t uplink_batch = 1;
+    uint8_t uplink_enabled = 1;
+    uint32_t now;
+    uint32_t next;
+    uint32_t wake;
+#ifdef USE_MCU_DEEPSLEEP_MODE
+    uint32_t alarm;
+#endif // USE_MCU_DEEPSLEEP_MODE
+    uint32_t due;
 
     // Start SPI, i2c, uart and adc
 
@@ -79,14 +900,34 @@ int main(void)
     hal_spi_start(&spi1_info);
     hal_i2c_start(&i2c1_info);
     hal_uart_start(&uart1_info);
-    hal_adc_start(&adc_info);
+
+#ifdef USE_CONSOLE
+    console_resume();
+#endif // USE_CONSOLE
 
    /*
     * TRY ADC
     */
 
+#ifdef USE_BATTERY_MONITOR
+    voltage = battery_sample_idle();
+#else
+    hal_adc_start(&adc_info);
     hal_adc_regular_conversion_poll(&adc_info, 1000);
-    adc_raw_value = hal_adc_regular_value_get(&adc_info);
+    // x16 oversampled without shift, see msd_adc_init()
+    adc_raw_value = hal_adc_regular_value_get(&adc_info) >> 4;
+    voltage = (uint16_t)((2 * adc_raw_value) * 0.814f); // 2 mul because of 1/1 R-div
+#endif // USE_BATTERY_MONITOR
+#ifdef USE_CRASH_LOG
+    crashlog_voltage(voltage);
+#endif // USE_CRASH_LOG
+
+#ifdef USE_BATTERY_POLICY
+    policy_init();
+#endif // USE_BATTERY_POLICY
+
+    sched_init();
+    now = sched_clock();
 
 #ifdef USE_BME280_SPI
 
@@ -135,8 +976,20 @@ int main(void)
 		//do something when error occurred
 	}
 
-    message_length = sprintf(buffer, "H: %d.%d   T: %d.%d   P: %d.%d...\r\n", bme_data.humidity_int, bme_data.humidity_fract, bme_data.temp_int, bme_data.temp_fract, bme_data.pressure_int, bme_data.pressure_fract);
-    hal_uart_transmit_poll(&uart1_info, buffer, message_length, 1000);
+    p = fmt_str(buffer, "H: ");
+    p = fmt_int(p, bme_data.humidity_int);
+    p = fmt_str(p, ".");
+    p = fmt_int(p, bme_data.humidity_fract);
+    p = fmt_str(p, "   T: ");
+    p = fmt_int(p, bme_data.temp_int);
+    p = fmt_str(p, ".");
+    p = fmt_int(p, bme_data.temp_fract);
+    p = fmt_str(p, "   P: ");
+    p = fmt_int(p, bme_data.pressure_int);
+    p = fmt_str(p, ".");
+    p = fmt_int(p, bme_data.pressure_fract);
+    fmt_str(p, "...\r\n");
+    uart_print(buffer);
 
 #endif // USE_BME280_SPI
 
@@ -159,15 +1012,17 @@ int main(void)
 		// do smth when error occurred
 	}
 
-	message_length =  sprintf(buffer, "found %s (%x)\r\n", bmp280.id == BME280_CHIP_ID ? "BME280" : "BMP280", bmp280.id);
+	p = fmt_str(buffer, (bmp280.id == BME280_CHIP_ID) ? "found BME280 (" : "found BMP280 (");
+	p = fmt_hex(p, bmp280.id, 1);
+	fmt_str(p, ")\r\n");
+	uart_print(buffer);
 
 	hal_basetick_delay_ms(300);
 
 	// perform single read operation
 	if (!bmp280_read_float(&bmp280, &temperature, &pressure, &humidity))
 	{
-		message_length = sprintf(buffer, "Temperature/pressure reading failed\r\n");
-		hal_uart_transmit_poll(&uart1_info, buffer, message_length, 1000);
+		uart_print("Temperature/pressure reading failed\r\n");
 	}
 
 #endif // USE_BME280_I2C
@@ -180,11 +1035,22 @@ int main(void)
 
 	if (Flash_TestAvailability() == 0)
 	{
-	    message_length = sprintf(buffer, "Something wrong with W25Q...\r\n");
-	    hal_uart_transmit_poll(&uart1_info, buffer, message_length, 1000);
+	    uart_print("Something wrong with W25Q...\r\n");
 		//do something when error occurred
 	}
 
+#ifdef USE_FLASH_LOG
+	flashlog_init();
+#endif // USE_FLASH_LOG
+
+#ifdef USE_BACKFILL
+	backfill_init();
+#endif // USE_BACKFILL
+
+#ifdef USE_OTA
+	ota_init();
+#endif // USE_OTA
+
 #endif // USE_W25Q_EXT_FLASH
 
 #ifdef USE_RA_01_SENDER
@@ -192,61 +1058,77 @@ int main(void)
 	 * INIT LORA MODULE RA-01
 	 */
 
-	struct txPack pack;
-	pack.device_id = *((uint32_t*)0x0800FFF8);
-	pack.msg_id = 1;
-	pack.humidity = 0.0f;
-	pack.temperature = 0.0f;
-	pack.pressure = 0.0f;
-	pack.voltage = 0.0f;
-
 	//initialize LoRa module
-	SX1278_hw.dio0.port = SX_DIO0_GPIO_Port;
-	SX1278_hw.dio0.pin = SX_DIO0_Pin;
-	SX1278_hw.nss.port = SX_NSS_GPIO_Port;
-	SX1278_hw.nss.pin = SX_NSS_Pin;
-	SX1278_hw.reset.port = SX_RESET_GPIO_Port;
-	SX1278_hw.reset.pin = SX_RESET_Pin;
 	SX1278_hw.spi = &spi1_info;
 	SX1278.hw = &SX1278_hw;
 
-	SX1278_init(&SX1278, 433000000, SX1278_POWER_20DBM, SX1278_LORA_SF_12,
-			SX1278_LORA_BW_125KHZ, SX1278_LORA_CR_4_8, SX1278_LORA_CRC_EN, 24);
+	SX1278_init(&SX1278, LORA_FREQUENCY, LORA_POWER, LORA_SF,
+			LORA_BW, LORA_CR, SX1278_LORA_CRC_EN, 24);
+	SX1278_set_preamble(&SX1278, LORA_PREAMBLE, LORA_SYMBOL_TIMEOUT);
 
-#ifdef USE_BME280_SPI
+#ifdef USE_CHANNEL_PLAN
+	channel_init();
+#endif // USE_CHANNEL_PLAN
 
-	pack.humidity = combineToFloat(bme_data.humidity_int, bme_data.humidity_fract);
-	pack.temperature = combineToFloat(bme_data.temp_int, bme_data.temp_fract);
-	pack.pressure = combineToFloat(bme_data.pressure_int, bme_data.pressure_fract);
+#ifdef USE_FHSS
+	fhss_init();
+#endif // USE_FHSS
 
-#endif // USE_BME280_SPI
+#ifdef USE_ADR
+	adr_init(lora_sf, lora_power);
+#endif // USE_ADR
 
-#ifdef USE_BME280_I2C
+#ifdef USE_REMOTE_CONFIG
+	config_init();
+	apply_config();
+#endif // USE_REMOTE_CONFIG
 
-	pack.humidity = humidity;
-	pack.temperature = temperature;
-	pack.pressure = pressure;
+#ifdef USE_TDMA
+	tdma_init();
+#endif // USE_TDMA
 
-#endif // USE_BME280_I2C
+#ifdef USE_BME280_SPI
+	store_sample(now, combineToFloat(bme_data.temp_int, bme_data.temp_fract),
+			combineToFloat(bme_data.humidity_int, bme_data.humidity_fract),
+			combineToFloat(bme_data.pressure_int, bme_data.pressure_fract), voltage);
+#endif // USE_BME280_SPI
 
-	pack.voltage = (2 * adc_raw_value) * 0.000814f; // 2 mul because of 1/1 R-div
+#ifdef USE_BME280_I2C
+	store_sample(now, temperature, humidity, pressure, voltage);
+#endif // USE_BME280_I2C
 
-	uint32_t ret1 = SX1278_LoRaEntryTx(&SX1278, sizeof(pack), 50);
-	uint32_t ret2 = SX1278_LoRaTxPacket(&SX1278, (uint8_t*)(&pack), sizeof(pack), 2500);
+#ifdef USE_AGGREGATION
+	// first record holds the power-up sample only
+	close_window();
+#endif // USE_AGGREGATION
 
-	pack.msg_id = pack.msg_id + 1;
+	// first frame goes out right after power-up regardless of batching
+	send_samples(0);
+#ifdef USE_CRASH_LOG
+	send_crash_report();
+#endif // USE_CRASH_LOG
 
 #endif // USE_RA_01_SENDER
 
+#ifdef USE_CRASH_LOG
+    crashlog_feed();
+#endif // USE_CRASH_LOG
     hal_basetick_delay_ms(5000);
 
 #ifdef USE_TEST_PACKET_SPAMMING
 
     for (int i = 0; i < 36; i++)
     {
-		uint32_t ret1 = SX1278_LoRaEntryTx(&SX1278, sizeof(pack), 50);
-		uint32_t ret2 = SX1278_LoRaTxPacket(&SX1278, (uint8_t*)(&pack), sizeof(pack), 2500);
-		pack.msg_id = pack.msg_id + 1;
+#ifdef USE_BME280_I2C
+		store_sample(sched_clock(), temperature, humidity, pressure, voltage);
+#endif // USE_BME280_I2C
+#ifdef USE_AGGREGATION
+		close_window();
+#endif // USE_AGGREGATION
+		send_samples(0);
+#ifdef USE_CRASH_LOG
+		crashlog_feed();
+#endif // USE_CRASH_LOG
 		hal_basetick_delay_ms(12500);
     }
 
@@ -267,6 +1149,12 @@ int main(void)
 
     while (1)
     {
+#ifdef USE_CRASH_LOG
+		crashlog_feed();
+		crashlog_phase(CRASH_PHASE_IDLE);
+#endif // USE_CRASH_LOG
+		now = sched_clock();
+		due = sched_due(now);
 
 #ifdef DEINIT_ALL_PERIPH_DURING_MCU_SLEEP
 
@@ -279,67 +1167,274 @@ int main(void)
 		msd_timer2_init();
 		msd_usart1_init();
 		msd_i2c1_init();
+#ifdef USE_SPI_BUS
+		spibus_init(&spibus0, SPI0, SPIBUS0_DMA);
+		spibus_init(&spibus1, SPI1, SPIBUS1_DMA);
+#endif // USE_SPI_BUS
+
+#ifdef USE_CONSOLE
+		console_resume();
+#endif // USE_CONSOLE
 
 #endif // DEINIT_ALL_PERIPH_DURING_MCU_SLEEP
 
-		// Wake up ADC, get value and sleep
-		hal_adc_start(&adc_info);
-		hal_adc_regular_conversion_poll(&adc_info, 1000);
-		adc_raw_value = hal_adc_regular_value_get(&adc_info);
-		hal_adc_stop(&adc_info);
+#ifdef USE_TDMA
+		if (due & SCHED_BIT(SCHED_BEACON))
+		{
+			hal_spi_start(SX1278_hw.spi);
+			SX1278_standby(&SX1278);
+			beacon_receive();
+			SX1278_sleep(&SX1278);
+			hal_spi_stop(SX1278_hw.spi);
+			// a beacon steps the clock
+			now = sched_clock();
+		}
+
+		// diagnostics wait for the own slot
+		if (tdma.synced && (due & SCHED_BIT(SCHED_DIAG)) && !(due & SCHED_BIT(SCHED_UPLINK)))
+		{
+			due &= ~SCHED_BIT(SCHED_DIAG);
+			sched_set_deadline(SCHED_DIAG, sched.deadline[SCHED_UPLINK]);
+		}
+#endif // USE_TDMA
+
+		if (due & SCHED_BIT(SCHED_BATTERY))
+		{
+#ifdef USE_CRASH_LOG
+			crashlog_phase(CRASH_PHASE_BATTERY);
+#endif // USE_CRASH_LOG
+			// Wake up ADC, get value and sleep
+#ifdef USE_BATTERY_MONITOR
+			voltage = battery_sample_idle();
+#else
+			hal_adc_start(&adc_info);
+			hal_adc_regular_conversion_poll(&adc_info, 1000);
+			// x16 oversampled without shift, see msd_adc_init()
+			adc_raw_value = hal_adc_regular_value_get(&adc_info) >> 4;
+			hal_adc_stop(&adc_info);
+			voltage = (uint16_t)((2 * adc_raw_value) * 0.814f); // 2 mul because of 1/1 R-div
+#endif // USE_BATTERY_MONITOR
+#ifdef USE_CRASH_LOG
+			crashlog_voltage(voltage);
+#endif // USE_CRASH_LOG
+
+#ifdef USE_BATTERY_POLICY
+			policy_update(battery.idle_mv, battery.trend);
+			set_periods();
+			uplink_batch = policy_current()->batch;
+			uplink_enabled = !policy_current()->store_only;
+#endif // USE_BATTERY_POLICY
+		}
 
+		if (due & SCHED_BIT(SCHED_SENSOR))
+		{
+#ifdef USE_CRASH_LOG
+			crashlog_phase(CRASH_PHASE_SENSOR);
+#endif // USE_CRASH_LOG
 #ifdef USE_BME280_SPI
 
-		// Wake up BME's SPI, wake up bme, read values, sleep bme, stop BME's SPI
-		hal_spi_start(bme_spi.spi_handle);
-		bme_config.mode = BME280_NORMALMODE;
-		BME280_ConfigureAll(&bme, &bme_config);
-		BME280_ReadAllLast(&bme, &bme_data);
-		bme_config.mode = BME280_SLEEPMODE;
-		BME280_ConfigureAll(&bme, &bme_config);
-		hal_spi_stop(bme_spi.spi_handle);
+			// Wake up BME's SPI, wake up bme, read values, sleep bme, stop BME's SPI
+			hal_spi_start(bme_spi.spi_handle);
+			bme_config.mode = BME280_NORMALMODE;
+			BME280_ConfigureAll(&bme, &bme_config);
+			BME280_ReadAllLast(&bme, &bme_data);
+			bme_config.mode = BME280_SLEEPMODE;
+			BME280_ConfigureAll(&bme, &bme_config);
+			hal_spi_stop(bme_spi.spi_handle);
 
 #endif
 
 #ifdef USE_BME280_I2C
 
-		// Wake up BME's I2C, wake up bme, read values, sleep bme, stop BME's I2C
-		hal_i2c_start(bmp280.i2c);
-		bmp280_wakeup(&bmp280);
-		bmp280_read_float(&bmp280, &temperature, &pressure, &humidity);
-		bmp280_sleep(&bmp280);
-		hal_i2c_stop(bmp280.i2c);
+			// Wake up BME's I2C, wake up bme, read values, sleep bme, stop BME's I2C
+			hal_i2c_start(bmp280.i2c);
+			bmp280_wakeup(&bmp280);
+			bmp280_read_float(&bmp280, &temperature, &pressure, &humidity);
+			bmp280_sleep(&bmp280);
+			hal_i2c_stop(bmp280.i2c);
 
 #endif
 
 #ifdef USE_RA_01_SENDER
 
-		// Fill pack with values before sending
+			// Queue sample until uplink
+#ifdef USE_BME280_SPI
+			store_sample(now, combineToFloat(bme_data.temp_int, bme_data.temp_fract),
+					combineToFloat(bme_data.humidity_int, bme_data.humidity_fract),
+					combineToFloat(bme_data.pressure_int, bme_data.pressure_fract), voltage);
+#endif
+#ifdef USE_BME280_I2C
+			store_sample(now, temperature, humidity, pressure, voltage);
+#endif
+
+#endif // USE_RA_01_SENDER
+
+#ifdef USE_RTC_CALIBRATION
+			// IRC40K follows the temperature
 #ifdef USE_BME280_SPI
-		pack.humidity = combineToFloat(bme_data.humidity_int, bme_data.humidity_fract);
-		pack.temperature = combineToFloat(bme_data.temp_int, bme_data.temp_fract);
-		pack.pressure = combineToFloat(bme_data.pressure_int, bme_data.pressure_fract);
+			rtccal_check(now, combineToFloat(bme_data.temp_int, bme_data.temp_fract));
 #endif
 #ifdef USE_BME280_I2C
-		pack.humidity = humidity;
-		pack.temperature = temperature;
-		pack.pressure = pressure;
+			rtccal_check(now, temperature);
 #endif
-		pack.voltage = (2 * adc_raw_value) * 0.000814f; // 2 mul because of 1/1 R-div
+#endif // USE_RTC_CALIBRATION
+		}
+
+#ifdef USE_FLASH_LOG
+		// flush early rather than drop buffered records
+		if ((due & SCHED_BIT(SCHED_LOG_FLUSH)) || (flashlog.pending >= FLASHLOG_BUFFER))
+		{
+#ifdef USE_CRASH_LOG
+			crashlog_phase(CRASH_PHASE_LOG);
+#endif // USE_CRASH_LOG
+			hal_spi_start(&FLASH_SPI_PORT);
+			flashlog_flush();
+			hal_spi_stop(&FLASH_SPI_PORT);
+		}
+#endif // USE_FLASH_LOG
+
+#ifdef USE_RA_01_SENDER
+
+#ifdef USE_AGGREGATION
+		// one record per uplink window, with the sample taken above
+		if (due & SCHED_BIT(SCHED_UPLINK))
+		{
+			close_window();
+		}
+#endif // USE_AGGREGATION
+
+		// store-only still reports its status, just no samples
+		if (((due & SCHED_BIT(SCHED_DIAG)) || ((due & SCHED_BIT(SCHED_UPLINK))
+				&& ((uplink_enabled && uplink_ready(uplink_batch))
+#ifdef USE_BATTERY_POLICY
+				|| policy.changed
+#endif // USE_BATTERY_POLICY
+				)))
+#ifdef USE_TDMA
+				&& tdma_slot_wait()
+#endif // USE_TDMA
+				)
+		{
+#ifdef USE_CRASH_LOG
+			crashlog_phase(CRASH_PHASE_UPLINK);
+#endif // USE_CRASH_LOG
+			// START Ra-01 SPI, wake up Ra-01, send packet, sleep Ra-01, stop Ra-01 SPI
+			hal_spi_start(SX1278_hw.spi);
+			SX1278_standby(&SX1278);
+#ifdef USE_DOWNLINK
+			if (send_samples((due & SCHED_BIT(SCHED_DIAG)) != 0))
+			{
+#ifdef USE_ADR
+				adr_sent(msg_id - 1, SX1278.LoRa_SF);
+#endif // USE_ADR
+#ifdef USE_BACKFILL
+				if (uplink_enabled)
+				{
+					backfill_live_sent(msg_id - 1);
+				}
+#endif // USE_BACKFILL
+#ifdef USE_OTA
+				// image that got a frame out is good
+				ota_confirm();
+#endif // USE_OTA
+				downlink_receive();
+#ifdef USE_ADR
+				if (adr_window_end())
+				{
+					lora_sf = adr.sf;
+					lora_power = adr.power;
+				}
+#endif // USE_ADR
+#ifdef USE_BACKFILL
+				if (uplink_enabled)
+				{
+					backfill_window_end();
+				}
+#endif // USE_BACKFILL
+				downlink_process();
+#ifdef USE_BACKFILL
+				if (uplink_enabled)
+				{
+					send_backfill(sched_clock());
+				}
+#endif // USE_BACKFILL
+			}
+#else
+			send_samples((due & SCHED_BIT(SCHED_DIAG)) != 0);
+#endif // USE_DOWNLINK
+#ifdef USE_UPLINK_FEC
+			send_parity();
+#endif // USE_UPLINK_FEC
+#ifdef USE_CRASH_LOG
+			// in case it did not get out after power-up
+			send_crash_report();
+#endif // USE_CRASH_LOG
+#ifdef USE_RELAY
+			// queued frames ride along with the own uplink
+			if (uplink_enabled)
+			{
+				send_relay((due & SCHED_BIT(SCHED_DIAG)) != 0);
+			}
+#endif // USE_RELAY
+			SX1278_sleep(&SX1278);
+			hal_spi_stop(SX1278_hw.spi);
+
+#ifdef USE_REMOTE_CONFIG
+			// report went out on the old settings, switch now
+			config_uplink();
+			if (config.changed)
+			{
+				apply_config();
+			}
+#endif // USE_REMOTE_CONFIG
+
+#ifdef USE_OTA
+			if (ota_reset)
+			{
+				// bootloader installs the new image
+				NVIC_SystemReset();
+			}
+#endif // USE_OTA
+		}
+
+#endif // USE_RA_01_SENDER
+
+#if defined(USE_TDMA) || defined(USE_TIME_SYNC)
+		// downlinks may have stepped the clock
+		now = sched_clock();
+#endif // USE_TDMA || USE_TIME_SYNC
+
+		sched_done(due, now);
+
+#ifdef USE_TDMA
+		tdma_align();
+#endif // USE_TDMA
 
-		// START Ra-01 SPI, wake up Ra-01, send packet, sleep Ra-01, stop Ra-01 SPI
+#ifdef USE_CONSOLE
+		// commands run in the wake-up anyway, output drains by DMA
+		console_poll();
+#endif // USE_CONSOLE
+
+#ifdef USE_RELAY
+		// relay listens instead of sleeping, a full batch goes out at once
 		hal_spi_start(SX1278_hw.spi);
 		SX1278_standby(&SX1278);
-		SX1278_LoRaEntryTx(&SX1278, sizeof(pack), 50);
-		SX1278_LoRaTxPacket(&SX1278, (uint8_t*)(&pack), sizeof(pack), 2500);
+		relay_receive(sched_next());
+		if (uplink_enabled && relay_ready(sched_clock()))
+		{
+			send_relay(0);
+		}
 		SX1278_sleep(&SX1278);
 		hal_spi_stop(SX1278_hw.spi);
-		pack.msg_id += 1; // Increment msg_id for next message
-
-#endif // USE_RA_01_SENDER
+		continue;
+#endif // USE_RELAY
 
 #ifdef DEINIT_ALL_PERIPH_DURING_MCU_SLEEP
 
+#ifdef USE_CONSOLE
+		console_suspend();
+#endif // USE_CONSOLE
+
 		// deinit all periph
 		msd_gpio_deinit();
 		msd_adc_deinit();
@@ -352,56 +1447,73 @@ int main(void)
 
 #endif // DEINIT_ALL_PERIPH_DURING_MCU_SLEEP
 
-#ifdef USE_MCU_DEEPSLEEP_MODE
-
-		rtc_parameter_struct rtc_initpara_struct;
-		uint8_t temp;
-		// rtc alarm config and sleep until alarm, then wake up and disable alarm
-		// IMPORTANT NOTE: state of alarm register must change between 2 alarms
-		hal_rtc_alarm_disable();
-		hal_nvic_periph_irq_disable(RTC_IRQn);
-		rtc_interrupt_disable(RTC_INT_ALARM);
-		rtc_alarm_time.rtc_alarm_mask = HAL_RTC_ALARM_DATE_MASK | HAL_RTC_ALARM_HOUR_MASK;
-		rtc_current_time_get(&rtc_initpara_struct);
-		temp = rtc_bcd_2_normal(rtc_initpara_struct.rtc_minute) + SLEEP_MINUTES;
-		if (temp >= 60)
+		// one wake-up for the earliest deadline, later ones are coalesced into it
+		now = sched_clock();
+		next = sched_next();
+		if (next <= now + SCHED_MIN_SLEEP_S)
 		{
-			temp -= 60;
+			continue;
 		}
-		rtc_alarm_time.rtc_alarm_minute = rtc_normal_2_bcd(temp);
-		rtc_alarm_time.rtc_alarm_second = 0x00;
-		hal_rtc_alarm_config(&rtc_alarm_time);
-		rtc_alarm_subsecond_config(RTC_MASKSSC_0_14, 0);
-		rtc_flag_clear(RTC_FLAG_ALARM0);
-		hal_rtc_alarm_enable_interrupt(emptyFunc);
-		rtc_interrupt_enable(RTC_INT_ALARM);
-		hal_nvic_periph_irq_enable(RTC_IRQn, 2);
-		hal_rtc_alarm_enable();
-
-		hal_basetick_suspend();
-		hal_pmu_to_deepsleepmode(HAL_PMU_LDO_LOWPOWER, HAL_WFI_CMD);
-		hal_basetick_resume();
-
-		hal_rtc_alarm_disable();
-		hal_nvic_periph_irq_disable(RTC_IRQn);
-		rtc_interrupt_disable(RTC_INT_ALARM);
-		rtc_flag_clear(RTC_FLAG_ALARM0);
 
-#endif // USE_MCU_DEEPSLEEP_MODE
+#ifdef USE_CRASH_LOG
+		crashlog_phase(CRASH_PHASE_SLEEP);
+#endif // USE_CRASH_LOG
+		do
+		{
+			wake = next;
+#ifdef USE_CRASH_LOG
+			// FWDGT counts on in deep sleep, wake up in time to feed it
+			if (wake > now + CRASHLOG_SLEEP_MAX_S)
+			{
+				wake = now + CRASHLOG_SLEEP_MAX_S;
+			}
+#endif // USE_CRASH_LOG
 
-#ifndef USE_MCU_DEEPSLEEP_MODE
+#ifdef USE_MCU_DEEPSLEEP_MODE
 
-		hal_basetick_delay_ms(SLEEP_MINUTES * 1000 * 60);
+			// rtc alarm config and sleep until alarm, then wake up and disable alarm
+			// IMPORTANT NOTE: state of alarm register must change between 2 alarms
+			hal_rtc_alarm_disable();
+			hal_nvic_periph_irq_disable(RTC_IRQn);
+			rtc_interrupt_disable(RTC_INT_ALARM);
+			// match hour, minute and second of the deadline
+			alarm = wake % SCHED_SECONDS_PER_DAY;
+			rtc_alarm_time.rtc_alarm_mask = HAL_RTC_ALARM_DATE_MASK;
+			rtc_alarm_time.rtc_alarm_hour = rtc_normal_2_bcd(alarm / 3600);
+			rtc_alarm_time.rtc_alarm_minute = rtc_normal_2_bcd((alarm / 60) % 60);
+			rtc_alarm_time.rtc_alarm_second = rtc_normal_2_bcd(alarm % 60);
+			hal_rtc_alarm_config(&rtc_alarm_time);
+			rtc_alarm_subsecond_config(RTC_MASKSSC_0_14, 0);
+			rtc_flag_clear(RTC_FLAG_ALARM0);
+			hal_rtc_alarm_enable_interrupt(emptyFunc);
+			rtc_interrupt_enable(RTC_INT_ALARM);
+			hal_nvic_periph_irq_enable(RTC_IRQn, 2);
+			hal_rtc_alarm_enable();
+
+			hal_basetick_suspend();
+			hal_pmu_to_deepsleepmode(HAL_PMU_LDO_LOWPOWER, HAL_WFI_CMD);
+			hal_basetick_resume();
+
+			hal_rtc_alarm_disable();
+			hal_nvic_periph_irq_disable(RTC_IRQn);
+			rtc_interrupt_disable(RTC_INT_ALARM);
+			rtc_flag_clear(RTC_FLAG_ALARM0);
 
 #endif // USE_MCU_DEEPSLEEP_MODE
 
-    }
+#ifndef USE_MCU_DEEPSLEEP_MODE
 
-    // transmit message uart
-    message_length = sprintf(buffer, "Hello there!\r\n");
-    hal_uart_transmit_poll(&uart1_info, buffer, message_length, 1000);
+			hal_basetick_delay_ms((wake - now) * 1000);
 
-    // try to receive uart
-    hal_uart_receive_interrupt(&uart1_info, buffer, 1, uart_recv_byte);
+#endif // USE_MCU_DEEPSLEEP_MODE
+
+#ifdef USE_CRASH_LOG
+			crashlog_feed();
+#endif // USE_CRASH_LOG
+			now = sched_clock();
+		}
+		// a watchdog slice goes back to sleep without the peripherals
+		while ((wake < next) && (next > now + SCHED_MIN_SLEEP_S));
 
+    }
 }
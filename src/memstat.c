@@ -0,0 +1,53 @@
+/**
+ * RAM and flash usage for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_MEM_STATS
+
+#include "gd32e23x_hal.h"
+#include "memstat.h"
+
+// linker script symbols, only their addresses are meaningful
+extern uint32_t __flash_start[];
+extern uint32_t __flash_end[];
+extern uint32_t _sidata[];
+extern uint32_t _sdata[];
+extern uint32_t _edata[];
+extern uint32_t _sbss[];
+extern uint32_t _ebss[];
+extern uint32_t _end[];
+extern uint32_t _heap_end[];
+extern uint32_t _sp[];
+
+void memstat_paint(void) {
+	uint32_t * p = _end;
+	uint32_t * top = (uint32_t *) ((__get_MSP() - MEMSTAT_PAINT_MARGIN) & ~3UL);
+
+	while (p < top) {
+		*p++ = MEMSTAT_PAINT;
+	}
+}
+
+uint16_t memstat_stack_peak(void) {
+	const uint32_t * p = _end;
+
+	// the stack grows down, the lowest overwritten word marks its peak
+	while ((p < _sp) && (*p == MEMSTAT_PAINT)) {
+		p++;
+	}
+	return (uint16_t) ((uint32_t) _sp - (uint32_t) p);
+}
+
+void memstat_get(memstat_t * stat) {
+	stat->data = (uint16_t) ((uint32_t) _edata - (uint32_t) _sdata);
+	stat->bss = (uint16_t) ((uint32_t) _ebss - (uint32_t) _sbss);
+	stat->gap = (uint16_t) ((uint32_t) _heap_end - (uint32_t) _end);
+	stat->stack = (uint16_t) ((uint32_t) _sp - (uint32_t) _heap_end);
+	stat->stack_peak = memstat_stack_peak();
+	stat->flash = (uint32_t) _sidata + stat->data - (uint32_t) __flash_start;
+	stat->flash_size = (uint32_t) __flash_end - (uint32_t) __flash_start;
+}
+
+#endif // USE_MEM_STATS
@@ -0,0 +1,443 @@
+/**
+ * Delta firmware update over LoRa for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_OTA
+
+#include <string.h>
+#include "ota.h"
+#include "crc32.h"
+
+#define OTA_BIT_GET(map, n)		((map)[(n) >> 3] & (1 << ((n) & 7)))
+#define OTA_BIT_SET(map, n)		((map)[(n) >> 3] |= (1 << ((n) & 7)))
+
+ota_t ota;
+
+typedef struct {
+	uint32_t address;				// next W25Q address to read
+	uint32_t end;					// end of delta
+	uint8_t buf[OTA_FRAGMENT_SIZE];
+	uint8_t pos;
+	uint8_t fill;
+} ota_reader_t;
+
+typedef struct {
+	uint32_t address;				// W25Q address of buf[0]
+	uint32_t length;				// image bytes written so far
+	uint8_t buf[EXT_FLASH_PAGE_SIZE];
+	uint16_t fill;
+} ota_writer_t;
+
+/*
+ * Boot record
+ */
+
+static uint32_t ota_record_crc(const ota_boot_record_t * record) {
+	return crc32_update(0, (const uint8_t*) record, sizeof(ota_boot_record_t) - sizeof(uint32_t));
+}
+
+// latest valid record, slot of the next free one
+static uint8_t ota_record_read(ota_boot_record_t * record, uint32_t * next_slot) {
+	ota_boot_record_t candidate;
+	uint8_t found = 0;
+	uint32_t slot;
+
+	*next_slot = OTA_BOOT_RECORDS;
+	for (slot = 0; slot < OTA_BOOT_RECORDS; slot++) {
+		Flash_Read(OTA_W25Q_STATE + slot * sizeof(candidate), (uint8_t*) &candidate, sizeof(candidate));
+		if (candidate.magic == 0xFFFFFFFFUL) {
+			*next_slot = slot;
+			break;
+		}
+		if ((candidate.magic == OTA_BOOT_MAGIC) && (candidate.crc == ota_record_crc(&candidate))) {
+			*record = candidate;
+			found = 1;
+		}
+	}
+	return found;
+}
+
+static void ota_record_write(ota_boot_record_t * record) {
+	ota_boot_record_t last;
+	uint32_t slot;
+
+	Flash_PowerUp();
+	record->sequence = ota_record_read(&last, &slot) ? last.sequence + 1 : 0;
+	record->magic = OTA_BOOT_MAGIC;
+	record->crc = ota_record_crc(record);
+	if (slot == OTA_BOOT_RECORDS) {
+		Flash_SErase4k(OTA_W25Q_STATE);
+		slot = 0;
+	}
+	Flash_Write(OTA_W25Q_STATE + slot * sizeof(ota_boot_record_t), (uint8_t*) record,
+			sizeof(ota_boot_record_t));
+	Flash_PowerDown();
+}
+
+void ota_init(void) {
+	ota_boot_record_t record;
+	uint32_t slot;
+
+	memset(&ota, 0, sizeof(ota));
+
+	Flash_PowerUp();
+	if (ota_record_read(&record, &slot)) {
+		if (record.state == OTA_BOOT_TRIAL) {
+			ota.trial = 1;
+		} else if (record.state == OTA_BOOT_ROLLED_BACK) {
+			ota.state = OTA_STATE_ROLLED_BACK;
+			ota.report = 1;
+		}
+	}
+	Flash_PowerDown();
+}
+
+void ota_confirm(void) {
+	ota_boot_record_t record;
+	uint32_t slot;
+
+	if (!ota.trial) {
+		return;
+	}
+
+	Flash_PowerUp();
+	if (ota_record_read(&record, &slot) && (record.state == OTA_BOOT_TRIAL)) {
+		record.state = OTA_BOOT_CONFIRMED;
+		ota_record_write(&record);
+	}
+	Flash_PowerDown();
+
+	ota.trial = 0;
+	ota.state = OTA_STATE_CONFIRMED;
+	ota.report = 1;
+}
+
+uint8_t ota_report(ota_report_t * report) {
+	if (!ota.report) {
+		return 0;
+	}
+	report->session = ota.start.session;
+	report->received = ota.received;
+	report->state = ota.state;
+	ota.report = 0;
+	return 1;
+}
+
+/*
+ * Reception
+ */
+
+static void ota_set_state(uint8_t state) {
+	ota.state = state;
+	ota.report = 1;
+}
+
+static uint16_t ota_groups(void) {
+	return (ota.start.fragments + OTA_FEC_GROUP - 1) / OTA_FEC_GROUP;
+}
+
+// every group misses nothing, or one fragment with its parity at hand
+static uint8_t ota_recoverable(void) {
+	uint16_t group;
+	uint16_t i;
+	uint8_t missing;
+
+	for (group = 0; group < ota_groups(); group++) {
+		missing = 0;
+		for (i = group * OTA_FEC_GROUP; (i < (group + 1) * OTA_FEC_GROUP) && (i < ota.start.fragments); i++) {
+			if (!OTA_BIT_GET(ota.fragments, i)) {
+				missing++;
+			}
+		}
+		if ((missing > 1) || ((missing == 1) && !OTA_BIT_GET(ota.parity, group))) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void ota_start(const ota_start_t * start) {
+	uint32_t address;
+
+	if ((ota.state != OTA_STATE_IDLE) && (start->session == ota.start.session)) {
+		return;	// repeated start of current session
+	}
+
+	memset(&ota, 0, sizeof(ota));
+	ota.start = *start;
+
+	if ((start->fragments == 0) || (start->fragments > OTA_MAX_FRAGMENTS)
+			|| (start->delta_length > start->fragments * OTA_FRAGMENT_SIZE)
+			|| (start->image_length > OTA_APP_SIZE)) {
+		ota_set_state(OTA_STATE_BAD_DELTA);
+		return;
+	}
+	if (crc32_update(0, (const uint8_t*) OTA_APP_BASE, OTA_APP_SIZE) != start->base_crc) {
+		ota_set_state(OTA_STATE_BAD_BASE);
+		return;
+	}
+
+	// gateway leaves time for this before the first fragment
+	Flash_PowerUp();
+	for (address = 0; address < start->fragments * OTA_FRAGMENT_SIZE; address += OTA_W25Q_SECTOR_SIZE) {
+		Flash_SErase4k(OTA_W25Q_DELTA + address);
+	}
+	for (address = 0; address < ota_groups() * OTA_FRAGMENT_SIZE; address += OTA_W25Q_SECTOR_SIZE) {
+		Flash_SErase4k(OTA_W25Q_PARITY + address);
+	}
+	Flash_PowerDown();
+
+	ota_set_state(OTA_STATE_RECEIVING);
+}
+
+static void ota_fragment(uint8_t type, const ota_fragment_t * fragment) {
+	uint8_t * map;
+	uint32_t address;
+
+	if ((ota.state != OTA_STATE_RECEIVING) || (fragment->session != ota.start.session)) {
+		return;
+	}
+
+	if (type == DOWNLINK_TYPE_OTA_FRAGMENT) {
+		if (fragment->index >= ota.start.fragments) {
+			return;
+		}
+		map = ota.fragments;
+		address = OTA_W25Q_DELTA;
+	} else {
+		if (fragment->index >= ota_groups()) {
+			return;
+		}
+		map = ota.parity;
+		address = OTA_W25Q_PARITY;
+	}
+	if (OTA_BIT_GET(map, fragment->index)) {
+		return;
+	}
+
+	// fragments never cross a W25Q page
+	Flash_PowerUp();
+	Flash_Write(address + fragment->index * OTA_FRAGMENT_SIZE, (uint8_t*) fragment->data, OTA_FRAGMENT_SIZE);
+	Flash_PowerDown();
+
+	OTA_BIT_SET(map, fragment->index);
+	if (type == DOWNLINK_TYPE_OTA_FRAGMENT) {
+		ota.received++;
+	}
+
+	if (ota_recoverable()) {
+		ota_set_state(OTA_STATE_COMPLETE);
+	}
+}
+
+void ota_downlink(uint8_t type, const uint8_t * payload, uint8_t length) {
+	ota_start_t start;
+	ota_fragment_t fragment;
+
+	switch (type) {
+	case DOWNLINK_TYPE_OTA_START:
+		if (length >= sizeof(start)) {
+			memcpy(&start, payload, sizeof(start));
+			ota_start(&start);
+		}
+		break;
+	case DOWNLINK_TYPE_OTA_FRAGMENT:
+	case DOWNLINK_TYPE_OTA_PARITY:
+		if (length >= sizeof(fragment)) {
+			memcpy(&fragment, payload, sizeof(fragment));
+			ota_fragment(type, &fragment);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+ * Image build
+ */
+
+static void ota_restore(void) {
+	uint8_t data[OTA_FRAGMENT_SIZE];
+	uint8_t other[OTA_FRAGMENT_SIZE];
+	uint16_t group;
+	uint16_t missing;
+	uint16_t i;
+	uint8_t k;
+
+	for (group = 0; group < ota_groups(); group++) {
+		missing = UINT16_MAX;
+		for (i = group * OTA_FEC_GROUP; (i < (group + 1) * OTA_FEC_GROUP) && (i < ota.start.fragments); i++) {
+			if (!OTA_BIT_GET(ota.fragments, i)) {
+				missing = i;
+			}
+		}
+		if (missing == UINT16_MAX) {
+			continue;
+		}
+
+		// missing = parity ^ all other fragments of the group
+		Flash_Read(OTA_W25Q_PARITY + group * OTA_FRAGMENT_SIZE, data, OTA_FRAGMENT_SIZE);
+		for (i = group * OTA_FEC_GROUP; (i < (group + 1) * OTA_FEC_GROUP) && (i < ota.start.fragments); i++) {
+			if (i == missing) {
+				continue;
+			}
+			Flash_Read(OTA_W25Q_DELTA + i * OTA_FRAGMENT_SIZE, other, OTA_FRAGMENT_SIZE);
+			for (k = 0; k < OTA_FRAGMENT_SIZE; k++) {
+				data[k] ^= other[k];
+			}
+		}
+		Flash_Write(OTA_W25Q_DELTA + missing * OTA_FRAGMENT_SIZE, data, OTA_FRAGMENT_SIZE);
+		OTA_BIT_SET(ota.fragments, missing);
+		ota.received++;
+	}
+}
+
+static int16_t ota_read_byte(ota_reader_t * reader) {
+	if (reader->pos == reader->fill) {
+		if (reader->address >= reader->end) {
+			return -1;
+		}
+		reader->fill = (reader->end - reader->address < OTA_FRAGMENT_SIZE) ?
+				reader->end - reader->address : OTA_FRAGMENT_SIZE;
+		Flash_Read(reader->address, reader->buf, reader->fill);
+		reader->address += reader->fill;
+		reader->pos = 0;
+	}
+	return reader->buf[reader->pos++];
+}
+
+static int32_t ota_read_u16(ota_reader_t * reader) {
+	int16_t low = ota_read_byte(reader);
+	int16_t high = ota_read_byte(reader);
+
+	if ((low < 0) || (high < 0)) {
+		return -1;
+	}
+	return low | (high << 8);
+}
+
+static uint8_t ota_write_byte(ota_writer_t * writer, uint8_t byte) {
+	if (writer->length >= OTA_APP_SIZE) {
+		return 0;
+	}
+	writer->buf[writer->fill++] = byte;
+	writer->length++;
+	if (writer->fill == sizeof(writer->buf)) {
+		Flash_Write(writer->address, writer->buf, writer->fill);
+		writer->address += writer->fill;
+		writer->fill = 0;
+	}
+	return 1;
+}
+
+static uint8_t ota_apply(void) {
+	ota_reader_t reader;
+	ota_writer_t writer;
+	const uint8_t * base = (const uint8_t*) OTA_APP_BASE;
+	int32_t offset;
+	int32_t length;
+	int16_t op;
+	int16_t byte;
+
+	reader.address = OTA_W25Q_DELTA;
+	reader.end = OTA_W25Q_DELTA + ota.start.delta_length;
+	reader.pos = 0;
+	reader.fill = 0;
+	writer.address = OTA_W25Q_IMAGE;
+	writer.length = 0;
+	writer.fill = 0;
+
+	while (1) {
+		op = ota_read_byte(&reader);
+		switch (op) {
+		case OTA_OP_END:
+			if (writer.fill) {
+				Flash_Write(writer.address, writer.buf, writer.fill);
+			}
+			return writer.length == ota.start.image_length;
+		case OTA_OP_COPY:
+			offset = ota_read_u16(&reader);
+			length = ota_read_u16(&reader);
+			if ((offset < 0) || (length < 0) || ((uint32_t) (offset + length) > OTA_APP_SIZE)) {
+				return 0;
+			}
+			while (length--) {
+				if (!ota_write_byte(&writer, base[offset++])) {
+					return 0;
+				}
+			}
+			break;
+		case OTA_OP_INSERT:
+			length = ota_read_u16(&reader);
+			if (length < 0) {
+				return 0;
+			}
+			while (length--) {
+				byte = ota_read_byte(&reader);
+				if ((byte < 0) || !ota_write_byte(&writer, byte)) {
+					return 0;
+				}
+			}
+			break;
+		default:
+			return 0;
+		}
+	}
+}
+
+static uint32_t ota_image_crc(void) {
+	uint8_t buf[OTA_FRAGMENT_SIZE];
+	uint32_t crc = 0;
+	uint32_t offset;
+	uint32_t length;
+
+	for (offset = 0; offset < OTA_APP_SIZE; offset += length) {
+		length = (OTA_APP_SIZE - offset < sizeof(buf)) ? OTA_APP_SIZE - offset : sizeof(buf);
+		Flash_Read(OTA_W25Q_IMAGE + offset, buf, length);
+		crc = crc32_update(crc, buf, length);
+	}
+	return crc;
+}
+
+uint8_t ota_process(void) {
+	ota_boot_record_t record;
+	uint32_t address;
+
+	if (ota.state != OTA_STATE_COMPLETE) {
+		return 0;
+	}
+
+	Flash_PowerUp();
+
+	ota_restore();
+
+	for (address = 0; address < OTA_APP_SIZE; address += OTA_W25Q_SECTOR_SIZE) {
+		Flash_SErase4k(OTA_W25Q_IMAGE + address);
+	}
+	if (!ota_apply()) {
+		Flash_PowerDown();
+		ota_set_state(OTA_STATE_BAD_DELTA);
+		return 0;
+	}
+	// read back, this also catches W25Q write errors
+	if (ota_image_crc() != ota.start.image_crc) {
+		Flash_PowerDown();
+		ota_set_state(OTA_STATE_BAD_IMAGE);
+		return 0;
+	}
+
+	memset(&record, 0, sizeof(record));
+	record.state = OTA_BOOT_PENDING;
+	record.image_length = ota.start.image_length;
+	record.image_crc = ota.start.image_crc;
+	ota_record_write(&record);
+
+	Flash_PowerDown();
+	ota_set_state(OTA_STATE_INSTALLING);
+	return 1;
+}
+
+#endif // USE_OTA
@@ -0,0 +1,183 @@
+/**
+ * LoRa uplink frame format for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_RA_01_SENDER
+
+#include <stddef.h>
+#include <string.h>
+#include "packet.h"
+
+static int32_t packet_round(float value) {
+	return (int32_t)((value >= 0.0f) ? (value + 0.5f) : (value - 0.5f));
+}
+
+static int16_t packet_clamp_i16(int32_t value) {
+	if (value > INT16_MAX) {
+		return INT16_MAX;
+	}
+	if (value < INT16_MIN) {
+		return INT16_MIN;
+	}
+	return (int16_t)value;
+}
+
+static uint16_t packet_clamp_u16(int32_t value) {
+	if (value > UINT16_MAX) {
+		return UINT16_MAX;
+	}
+	if (value < 0) {
+		return 0;
+	}
+	return (uint16_t)value;
+}
+
+void packet_fill_sample(packet_sample_t * sample, uint8_t seq,
+		float temperature, float humidity, float pressure, uint16_t voltage) {
+	sample->seq = seq;
+	sample->temperature = packet_clamp_i16(packet_round(temperature * 100.0f));
+	sample->humidity = packet_clamp_u16(packet_round(humidity * 100.0f));
+	sample->pressure = packet_clamp_u16(packet_round(pressure * 0.1f));
+	sample->voltage = voltage;
+}
+
+_Static_assert(sizeof(packet_header_t) + PACKET_MAX_STATS * sizeof(packet_stats_t)
+		+ sizeof(packet_status_t) + sizeof(packet_time_t) + PACKET_MAX_STATS * sizeof(uint16_t)
+		<= PACKET_MAX_SIZE, "PACKET_MAX_STATS too big");
+
+static uint8_t packet_build_times(uint8_t * buf, const uint32_t * times, uint8_t count) {
+	packet_time_t time;
+	uint16_t delta;
+	uint32_t previous;
+	uint8_t length;
+	uint8_t i;
+
+	time.time = (count != 0) ? times[0] : 0;
+	memcpy(buf, &time, sizeof(time));
+	length = sizeof(time);
+
+	previous = time.time;
+	for (i = 0; i < count; i++) {
+		// times never run backwards, keep the host safe anyway
+		delta = (times[i] < previous) ? 0 :
+				(times[i] - previous >= PACKET_DELTA_UNKNOWN) ? PACKET_DELTA_UNKNOWN : times[i] - previous;
+		memcpy(buf + length, &delta, sizeof(delta));
+		length += sizeof(delta);
+		previous = times[i];
+	}
+	return length;
+}
+
+static uint8_t packet_build_frame(uint8_t * buf, uint32_t msg_id, uint8_t type,
+		const void * records, uint8_t record_size, uint8_t count,
+		const packet_status_t * status, const uint32_t * times, uint8_t unix_time) {
+	packet_header_t header;
+	uint8_t length;
+
+	header.device_id = DEVICE_ID;
+	header.msg_id = msg_id;
+	header.type = type;
+	header.flags = (status != NULL) ? PACKET_FLAG_STATUS : 0;
+	if (times != NULL) {
+		header.flags |= PACKET_FLAG_TIME | (unix_time ? PACKET_FLAG_TIME_UNIX : 0);
+	}
+	header.count = count;
+
+	memcpy(buf, &header, sizeof(header));
+	length = sizeof(header);
+
+	memcpy(buf + length, records, count * record_size);
+	length += count * record_size;
+
+	if (status != NULL) {
+		memcpy(buf + length, status, sizeof(packet_status_t));
+		length += sizeof(packet_status_t);
+	}
+
+	if (times != NULL) {
+		length += packet_build_times(buf + length, times, count);
+	}
+
+	return length;
+}
+
+uint8_t packet_build(uint8_t * buf, uint32_t msg_id,
+		const packet_sample_t * samples, uint8_t count,
+		const packet_status_t * status, const uint32_t * times, uint8_t unix_time) {
+	if (count > PACKET_MAX_SAMPLES) {
+		count = PACKET_MAX_SAMPLES;
+	}
+	return packet_build_frame(buf, msg_id, PACKET_TYPE_SAMPLES, samples,
+			sizeof(packet_sample_t), count, status, times, unix_time);
+}
+
+uint8_t packet_build_stats(uint8_t * buf, uint32_t msg_id,
+		const packet_stats_t * stats, uint8_t count,
+		const packet_status_t * status, const uint32_t * times, uint8_t unix_time) {
+	if (count > PACKET_MAX_STATS) {
+		count = PACKET_MAX_STATS;
+	}
+	return packet_build_frame(buf, msg_id, PACKET_TYPE_STATS, stats,
+			sizeof(packet_stats_t), count, status, times, unix_time);
+}
+
+uint8_t packet_build_backfill(uint8_t * buf, uint32_t msg_id,
+		const packet_values_t * values, uint8_t count,
+		const uint32_t * times, uint8_t unix_time) {
+	if (count > PACKET_MAX_BACKFILL) {
+		count = PACKET_MAX_BACKFILL;
+	}
+	return packet_build_frame(buf, msg_id, PACKET_TYPE_BACKFILL, values,
+			sizeof(packet_values_t), count, NULL, times, unix_time);
+}
+
+uint8_t packet_build_relay(uint8_t * buf, uint32_t msg_id,
+		const uint8_t * entries, uint8_t size, uint8_t count) {
+	uint8_t length = packet_build_frame(buf, msg_id, PACKET_TYPE_RELAY, entries,
+			size, 1, NULL, NULL, 0);
+
+	// entries differ in size, count is theirs
+	buf[offsetof(packet_header_t, count)] = count;
+	return length;
+}
+
+uint8_t packet_build_relay_report(uint8_t * buf, uint32_t msg_id,
+		const relay_report_t * report) {
+	return packet_build_frame(buf, msg_id, PACKET_TYPE_RELAY_STATS, report,
+			sizeof(relay_report_t), 1, NULL, NULL, 0);
+}
+
+uint8_t packet_build_parity(uint8_t * buf, uint32_t msg_id, const fec_parity_t * parity,
+		const uint32_t * msg_ids, const uint8_t * lengths, const uint8_t * data, uint8_t size) {
+	uint8_t length = packet_build_frame(buf, msg_id, PACKET_TYPE_PARITY, parity,
+			sizeof(fec_parity_t), 1, NULL, NULL, 0);
+
+	memcpy(buf + length, msg_ids, parity->group * sizeof(uint32_t));
+	length += parity->group * sizeof(uint32_t);
+	memcpy(buf + length, lengths, parity->group);
+	length += parity->group;
+	memcpy(buf + length, data, size);
+	return length + size;
+}
+
+uint8_t packet_build_crash(uint8_t * buf, uint32_t msg_id,
+		const crash_report_t * report) {
+	return packet_build_frame(buf, msg_id, PACKET_TYPE_CRASH, report,
+			sizeof(crash_report_t), 1, NULL, NULL, 0);
+}
+
+uint8_t packet_build_ota(uint8_t * buf, uint32_t msg_id,
+		const ota_report_t * report) {
+	return packet_build_frame(buf, msg_id, PACKET_TYPE_OTA, report,
+			sizeof(ota_report_t), 1, NULL, NULL, 0);
+}
+
+uint8_t packet_build_config(uint8_t * buf, uint32_t msg_id,
+		const config_report_t * report) {
+	return packet_build_frame(buf, msg_id, PACKET_TYPE_CONFIG, report,
+			sizeof(config_report_t), 1, NULL, NULL, 0);
+}
+
+#endif // USE_RA_01_SENDER
@@ -0,0 +1,99 @@
+/**
+ * Battery-aware operating policy for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_BATTERY_POLICY
+
+#include "policy.h"
+#include "SX1278.h"
+
+static const policy_profile_t policy_profiles[] = {
+	POLICY_PROFILE_NORMAL,
+	POLICY_PROFILE_SAVER,
+	POLICY_PROFILE_LOW,
+	POLICY_PROFILE_STORE_ONLY,
+};
+
+#define POLICY_PROFILE_COUNT	(sizeof(policy_profiles) / sizeof(policy_profiles[0]))
+
+policy_t policy;
+
+void policy_init(void) {
+	policy.profile = 0;
+	policy.prev_profile = 0;
+	policy.changed = 0;
+	policy.link_margin_db = POLICY_MARGIN_UNKNOWN;
+}
+
+uint8_t policy_update(uint16_t voltage, int32_t trend) {
+	int32_t projected;
+	uint8_t target = 0;
+	uint8_t i;
+
+	if (voltage == 0) {
+		return 0;
+	}
+
+	// only a falling trend moves the projection, recovery has to be measured
+	projected = voltage;
+	if (trend < 0) {
+		projected += (trend * POLICY_TREND_LOOKAHEAD) / 256;
+	}
+
+	for (i = 1; i < POLICY_PROFILE_COUNT; i++) {
+		if (projected < policy_profiles[i].enter_mv) {
+			target = i;
+		}
+	}
+
+	// step back up only with headroom over the threshold of current profile
+	if (target < policy.profile) {
+		if (projected < policy_profiles[policy.profile].enter_mv + POLICY_HYSTERESIS_MV) {
+			return 0;
+		}
+		target = policy.profile - 1;
+	}
+
+	if (target == policy.profile) {
+		return 0;
+	}
+
+	policy.prev_profile = policy.profile;
+	policy.profile = target;
+	policy.changed = 1;
+	return 1;
+}
+
+const policy_profile_t * policy_current(void) {
+	return &policy_profiles[policy.profile];
+}
+
+uint8_t policy_tx_power(uint8_t base) {
+	const policy_profile_t * profile = policy_current();
+
+	if ((policy.link_margin_db != POLICY_MARGIN_UNKNOWN)
+			&& (policy.link_margin_db >= profile->min_margin_db)
+			&& (profile->power > base)) {
+		return profile->power;
+	}
+	return base;
+}
+
+uint8_t policy_tx_sf(uint8_t base) {
+	const policy_profile_t * profile = policy_current();
+
+	if ((policy.link_margin_db != POLICY_MARGIN_UNKNOWN)
+			&& (policy.link_margin_db >= profile->min_margin_db)
+			&& (profile->LoRa_SF < base)) {
+		return profile->LoRa_SF;
+	}
+	return base;
+}
+
+void policy_set_link_margin(int8_t margin_db) {
+	policy.link_margin_db = margin_db;
+}
+
+#endif // USE_BATTERY_POLICY
@@ -0,0 +1,158 @@
+/**
+ * Multi-hop relay for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_RELAY
+
+#include <string.h>
+#include "relay.h"
+
+_Static_assert(sizeof(packet_header_t) + sizeof(relay_entry_t) + PACKET_MAX_SIZE <= RELAY_FRAME_MAX,
+		"RELAY_FRAME_MAX does not fit a full frame");
+_Static_assert(RELAY_FRAME_MAX <= RELAY_QUEUE_SIZE, "RELAY_QUEUE_SIZE too small");
+
+static const uint32_t relay_nodes[] = RELAY_NODES;
+
+#define RELAY_NODE_COUNT	(sizeof(relay_nodes) / sizeof(relay_nodes[0]))
+
+relay_t relay;
+
+static void relay_pop(uint16_t size, uint8_t entries) {
+	memmove(relay.queue, relay.queue + size, relay.queued - size);
+	relay.queued -= size;
+	relay.entries -= entries;
+}
+
+uint8_t relay_frame(const uint8_t * frame, uint8_t length, int8_t snr, int16_t rssi, uint32_t now) {
+	packet_header_t header;
+	relay_entry_t entry;
+	uint8_t node;
+
+	if (length < sizeof(header)) {
+		return 0;
+	}
+	memcpy(&header, frame, sizeof(header));
+	// downlinks to these nodes are never on air here, the gateway does not reach them
+	if ((header.type == 0) || (header.type > PACKET_TYPE_RELAY_STATS)) {
+		return 0;
+	}
+	for (node = 0; node < RELAY_NODE_COUNT; node++) {
+		if (relay_nodes[node] == header.device_id) {
+			break;
+		}
+	}
+	if (node == RELAY_NODE_COUNT) {
+		return 0;
+	}
+
+	if (sizeof(packet_header_t) + sizeof(entry) + length > RELAY_FRAME_MAX) {
+		relay.dropped++;
+		return 1;
+	}
+	// full queue loses the oldest frames
+	while (relay.queued + sizeof(entry) + length > RELAY_QUEUE_SIZE) {
+		relay_pop(sizeof(entry) + relay.queue[0], 1);
+		relay.dropped++;
+		// the batch of a failed TX lost its oldest frame, it goes out as a new one
+		relay.retry_id = 0;
+	}
+	if (relay.entries == 0) {
+		relay.first_s = now;
+	}
+
+	entry.length = length;
+	entry.snr = snr;
+	entry.rssi = rssi;
+	memcpy(relay.queue + relay.queued, &entry, sizeof(entry));
+	memcpy(relay.queue + relay.queued + sizeof(entry), frame, length);
+	relay.queued += sizeof(entry) + length;
+	relay.entries++;
+	relay.received++;
+	return 1;
+}
+
+uint8_t relay_build_ack(uint8_t * buf, const uint8_t * frame, int8_t snr, int16_t rssi) {
+	packet_header_t uplink;
+	downlink_header_t header;
+	downlink_ack_t ack;
+
+	memcpy(&uplink, frame, sizeof(uplink));
+	header.device_id = uplink.device_id;
+	header.type = DOWNLINK_TYPE_ACK;
+
+	ack.msg_id = uplink.msg_id;
+	ack.snr = snr;
+	ack.rssi = rssi;
+	ack.sf = ACK_NO_CHANGE;
+	ack.power = ACK_NO_CHANGE;
+	ack.time_s = 0;
+	ack.time_ms = 0;
+
+	memcpy(buf, &header, sizeof(header));
+	memcpy(buf + sizeof(header), &ack, sizeof(ack));
+	return sizeof(header) + sizeof(ack);
+}
+
+uint8_t relay_ready(uint32_t now) {
+	return (relay.entries != 0)
+			&& ((relay.queued >= RELAY_BATCH_BYTES) || (now - relay.first_s >= RELAY_MAX_DELAY_S));
+}
+
+uint8_t relay_build(uint8_t * buf, uint32_t * msg_id) {
+	uint16_t size = 0;
+	uint16_t entry_size;
+	uint8_t count = 0;
+
+	// TxDone timed out, the frame may be on air already: same frame, same msg_id
+	if (relay.retry_id != 0) {
+		relay.duplicates++;
+		return packet_build_relay(buf, relay.retry_id, relay.queue, relay.batch, relay.batch_entries);
+	}
+
+	while (count < relay.entries) {
+		entry_size = sizeof(relay_entry_t) + relay.queue[size];
+		if (sizeof(packet_header_t) + size + entry_size > RELAY_FRAME_MAX) {
+			break;
+		}
+		size += entry_size;
+		count++;
+	}
+	if (count == 0) {
+		return 0;
+	}
+	relay.batch = size;
+	relay.batch_entries = count;
+	relay.retry_id = (*msg_id)++;
+	return packet_build_relay(buf, relay.retry_id, relay.queue, size, count);
+}
+
+void relay_forwarded(void) {
+	relay.retry_id = 0;
+	relay_pop(relay.batch, relay.batch_entries);
+	relay.forwarded += relay.batch_entries;
+	relay.batch = 0;
+	relay.batch_entries = 0;
+}
+
+void relay_account(uint32_t rx_ms, uint32_t tx_ms) {
+	rx_ms += relay.rx_ms;
+	relay.rx_s += rx_ms / 1000;
+	relay.rx_ms = rx_ms % 1000;
+	relay.tx_ms += tx_ms;
+}
+
+void relay_report(relay_report_t * report) {
+	uint32_t charge = relay.rx_s * RELAY_RX_MA + relay.tx_ms / 1000 * RELAY_TX_MA;
+
+	report->received = relay.received;
+	report->forwarded = relay.forwarded;
+	report->dropped = relay.dropped;
+	report->duplicates = relay.duplicates;
+	report->rx_s = relay.rx_s;
+	report->tx_ms = relay.tx_ms;
+	report->charge_mah = (charge / 3600 > UINT16_MAX) ? UINT16_MAX : charge / 3600;
+}
+
+#endif // USE_RELAY
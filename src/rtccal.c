@@ -0,0 +1,140 @@
+/**
+ * IRC40K RTC calibration for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_RTC_CALIBRATION
+
+#include "gd32e23x_hal.h"
+#include "rtccal.h"
+
+#define RTCCAL_EDGES_PER_CAPTURE	8
+#define RTCCAL_CAPTURE_TIMEOUT		100000UL
+#define RTCCAL_TRIM_ONE				(1L << 20)	// smooth calibration cycle [RTCCLK]
+
+rtccal_t rtccal;
+
+// RTCCLK [mHz] from TIMER13 input capture, 0 on failure
+static uint32_t rtccal_measure(void) {
+	timer_parameter_struct timer;
+	timer_ic_parameter_struct ic;
+	uint32_t ticks = 0;
+	uint32_t timeout;
+	uint16_t capture;
+	uint16_t last = 0;
+	uint16_t i;
+
+	rcu_periph_clock_enable(RCU_TIMER13);
+	timer_deinit(TIMER13);
+	timer_struct_para_init(&timer);
+	timer.prescaler = 0;
+	timer.period = 0xFFFF;
+	timer_init(TIMER13, &timer);
+
+	timer_channel_input_struct_para_init(&ic);
+	ic.icpolarity = TIMER_IC_POLARITY_RISING;
+	ic.icselection = TIMER_IC_SELECTION_DIRECTTI;
+	ic.icprescaler = TIMER_IC_PSC_DIV8;
+	ic.icfilter = 0;
+	timer_input_capture_config(TIMER13, TIMER_CH_0, &ic);
+	timer_channel_remap_config(TIMER13, TIMER13_CI0_RMP_RTCCLK);
+	timer_enable(TIMER13);
+
+	// first capture is the reference, 8 edges fit a 16 bit count easily
+	for (i = 0; i <= RTCCAL_CAPTURES; i++) {
+		timeout = RTCCAL_CAPTURE_TIMEOUT;
+		while (!timer_flag_get(TIMER13, TIMER_FLAG_CH0) && --timeout) {
+		}
+		if ((timeout == 0) || timer_flag_get(TIMER13, TIMER_FLAG_CH0O)) {
+			// no clock, or a capture was lost to an interrupt
+			ticks = 0;
+			break;
+		}
+		capture = timer_channel_capture_value_register_read(TIMER13, TIMER_CH_0);
+		if (i != 0) {
+			ticks += (uint16_t) (capture - last);
+		}
+		last = capture;
+	}
+
+	timer_disable(TIMER13);
+	timer_deinit(TIMER13);
+	rcu_periph_clock_disable(RCU_TIMER13);
+
+	if (ticks == 0) {
+		return 0;
+	}
+	return (uint64_t) RTCCAL_REF_HZ * 1000 * RTCCAL_EDGES_PER_CAPTURE * RTCCAL_CAPTURES / ticks;
+}
+
+// change prescalers on a second boundary, the sub-second count restarts there
+static void rtccal_set_prescalers(uint8_t asyn, uint16_t syn) {
+	rtc_parameter_struct rtc_time;
+	uint8_t second;
+
+	if ((GET_PSC_FACTOR_A(RTC_PSC) == asyn) && (GET_PSC_FACTOR_S(RTC_PSC) == syn)) {
+		return;
+	}
+	rtc_current_time_get(&rtc_time);
+	second = rtc_time.rtc_second;
+	do {
+		rtc_current_time_get(&rtc_time);
+	} while (rtc_time.rtc_second == second);
+
+	rtc_time.rtc_factor_asyn = asyn;
+	rtc_time.rtc_factor_syn = syn;
+	rtc_init(&rtc_time);
+}
+
+uint8_t rtccal_run(void) {
+	uint32_t freq = rtccal_measure();
+	uint32_t asyn;
+	uint32_t syn;
+	int64_t trim = 0;
+
+	rtccal.runs++;
+	if ((freq < RTCCAL_MIN_HZ * 1000UL) || (freq > RTCCAL_MAX_HZ * 1000UL)) {
+		rtccal.failures++;
+		return 0;
+	}
+
+	// largest asynchronous prescaler that leaves a remainder the smooth calibration covers
+	for (asyn = 128; asyn > 1; asyn--) {
+		syn = (freq + asyn * 500UL) / (asyn * 1000UL);
+		trim = ((int64_t) asyn * syn * 1000 - freq) * RTCCAL_TRIM_ONE / freq;
+		if ((syn <= 0x8000UL) && (trim >= -511) && (trim <= 512)) {
+			break;
+		}
+	}
+	trim = (trim > 512) ? 512 : (trim < -511) ? -511 : trim;
+
+	rtccal_set_prescalers(asyn - 1, syn - 1);
+	rtc_calibration_config(RTC_CALIBRATION_WINDOW_32S,
+			(trim > 0) ? RTC_CALIBRATION_PLUS_SET : RTC_CALIBRATION_PLUS_RESET,
+			(trim > 0) ? 512 - trim : -trim);
+
+	rtccal.freq_mhz = freq;
+	rtccal.factor_asyn = asyn - 1;
+	rtccal.factor_syn = syn - 1;
+	rtccal.trim = trim;
+	return 1;
+}
+
+void rtccal_check(uint32_t now, float temperature) {
+	float delta = temperature - rtccal.temperature;
+
+	if (rtccal.temperature_valid && (now - rtccal.last_s < RTCCAL_PERIOD_S)
+			&& (delta < RTCCAL_TEMP_STEP) && (delta > -RTCCAL_TEMP_STEP)) {
+		return;
+	}
+	// power-up run already matches the first reading
+	if (rtccal.temperature_valid) {
+		rtccal_run();
+	}
+	rtccal.temperature = temperature;
+	rtccal.temperature_valid = 1;
+	rtccal.last_s = now;
+}
+
+#endif // USE_RTC_CALIBRATION
@@ -0,0 +1,167 @@
+/**
+ * Multi-rate task scheduler for LoggerSoft
+ */
+
+#include "main.h"
+
+#include "gd32e23x_hal.h"
+#include "sched.h"
+
+sched_t sched;
+
+static uint32_t sched_task_deadline_after(uint32_t deadline, uint32_t period, uint32_t now) {
+	// skip missed runs in one step
+	if (deadline <= now) {
+		deadline += ((now - deadline) / period + 1) * period;
+	}
+	return deadline;
+}
+
+void sched_init(void) {
+	uint32_t now;
+	uint8_t i;
+
+	sched.day = 0;
+	sched.last_sod = 0;
+	sched.stepped = 0;
+	now = sched_clock();
+
+	sched.period[SCHED_BATTERY] = SCHED_BATTERY_PERIOD_S;
+	sched.period[SCHED_SENSOR] = SCHED_SENSOR_PERIOD_S;
+	sched.period[SCHED_LOG_FLUSH] = SCHED_LOG_FLUSH_PERIOD_S;
+	sched.period[SCHED_UPLINK] = SCHED_UPLINK_PERIOD_S;
+	sched.period[SCHED_DIAG] = SCHED_DIAG_PERIOD_S;
+	sched.period[SCHED_BEACON] = SCHED_BEACON_PERIOD_S;
+	sched.exact = 0;
+
+	for (i = 0; i < SCHED_TASKS; i++) {
+		sched.deadline[i] = now + sched.period[i];
+	}
+}
+
+uint32_t sched_clock(void) {
+	rtc_parameter_struct rtc_time;
+	uint32_t sod;
+
+	rtc_current_time_get(&rtc_time);
+	sod = rtc_bcd_2_normal(rtc_time.rtc_hour) * 3600UL
+			+ rtc_bcd_2_normal(rtc_time.rtc_minute) * 60UL
+			+ rtc_bcd_2_normal(rtc_time.rtc_second);
+
+	if (sod < sched.last_sod) {
+		sched.day++;
+	}
+	sched.last_sod = sod;
+
+	return sched.day * SCHED_SECONDS_PER_DAY + sod;
+}
+
+uint32_t sched_clock_fine(uint16_t * ms) {
+	uint32_t syn = RTC_PSC & RTC_PSC_FACTOR_S;
+	uint32_t ss;
+	uint32_t now;
+
+	// reading the sub-second first locks time and date until they are read
+	ss = rtc_subsecond_get();
+	now = sched_clock();
+	if (ss > syn) {
+		ss = syn;	// right after a shift
+	}
+	*ms = (syn - ss) * 1000UL / (syn + 1);
+	return now;
+}
+
+int32_t sched_set_time_of_day(uint32_t sod) {
+	rtc_parameter_struct rtc_time;
+	uint32_t now = sched_clock();
+	int32_t delta;
+	uint8_t i;
+
+	delta = (int32_t) (sod % SCHED_SECONDS_PER_DAY) - (int32_t) sched.last_sod;
+	if (delta > (int32_t) (SCHED_SECONDS_PER_DAY / 2)) {
+		delta -= SCHED_SECONDS_PER_DAY;
+	} else if (delta < -(int32_t) (SCHED_SECONDS_PER_DAY / 2)) {
+		delta += SCHED_SECONDS_PER_DAY;
+	}
+	// sched_clock() never goes below zero
+	if ((int32_t) now + delta < 0) {
+		delta += SCHED_SECONDS_PER_DAY;
+	}
+
+	rtc_current_time_get(&rtc_time);
+	rtc_time.rtc_factor_asyn = GET_PSC_FACTOR_A(RTC_PSC);
+	rtc_time.rtc_factor_syn = GET_PSC_FACTOR_S(RTC_PSC);
+	rtc_time.rtc_hour = rtc_normal_2_bcd(sod / 3600 % 24);
+	rtc_time.rtc_minute = rtc_normal_2_bcd(sod / 60 % 60);
+	rtc_time.rtc_second = rtc_normal_2_bcd(sod % 60);
+	rtc_init(&rtc_time);
+
+	now += delta;
+	sched.stepped += delta;
+	sched.day = now / SCHED_SECONDS_PER_DAY;
+	sched.last_sod = now % SCHED_SECONDS_PER_DAY;
+	for (i = 0; i < SCHED_TASKS; i++) {
+		sched.deadline[i] = ((delta < 0) && (sched.deadline[i] < (uint32_t) -delta)) ?
+				0 : sched.deadline[i] + delta;
+	}
+	return delta;
+}
+
+uint32_t sched_uptime(uint32_t now) {
+	return now - sched.stepped;
+}
+
+void sched_set_deadline(sched_task_t task, uint32_t deadline) {
+	sched.deadline[task] = deadline;
+}
+
+void sched_set_period(sched_task_t task, uint32_t period) {
+	uint32_t old = sched.period[task];
+
+	if (period == old) {
+		return;
+	}
+	if (old != 0) {
+		sched.deadline[task] = sched.deadline[task] - old + period;
+	} else {
+		sched.deadline[task] = sched_clock() + period;
+	}
+	sched.period[task] = period;
+}
+
+uint32_t sched_due(uint32_t now) {
+	uint32_t tasks = 0;
+	uint8_t i;
+
+	for (i = 0; i < SCHED_TASKS; i++) {
+		if ((sched.period[i] != 0) && (sched.deadline[i]
+				<= now + ((sched.exact & SCHED_BIT(i)) ? 0 : SCHED_COALESCE_S))) {
+			tasks |= SCHED_BIT(i);
+		}
+	}
+	return tasks;
+}
+
+void sched_done(uint32_t tasks, uint32_t now) {
+	uint8_t i;
+
+	for (i = 0; i < SCHED_TASKS; i++) {
+		if ((tasks & SCHED_BIT(i)) && (sched.period[i] != 0)) {
+			// a run coalesced ahead of its deadline keeps the task on its grid
+			sched.deadline[i] = sched_task_deadline_after(sched.deadline[i],
+					sched.period[i], (sched.deadline[i] > now) ? sched.deadline[i] : now);
+		}
+	}
+}
+
+uint32_t sched_next(void) {
+	uint32_t next = UINT32_MAX;
+	uint8_t i;
+
+	for (i = 0; i < SCHED_TASKS; i++) {
+		if ((sched.period[i] != 0) && (sched.deadline[i] < next)) {
+			next = sched.deadline[i];
+		}
+	}
+	return next;
+}
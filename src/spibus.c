@@ -0,0 +1,213 @@
+/**
+ * Shared SPI bus manager for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_SPI_BUS
+
+#include <stddef.h>
+#include "gpio_fast.h"
+#include "spi_fast.h"
+#include "spibus.h"
+
+spibus_t spibus0;
+spibus_t spibus1;
+
+// the guarded interrupt may use the bus again
+static void spibus_unguard(spibus_t * bus) {
+	if (bus->guard && (bus->head == NULL) && (bus->selected == NULL)) {
+		NVIC_EnableIRQ(bus->guard_irq);
+	}
+}
+
+static void spibus_select(spibus_t * bus, const spibus_device_t * device) {
+	if (bus->selected == device) {
+		return;
+	}
+	if (bus->selected != NULL) {
+		gpio_fast_high(bus->selected->cs_port, bus->selected->cs_pin);
+	}
+	// prescaler and clock mode may only change while SPI is off
+	if ((SPI_CTL0(bus->periph) & SPIBUS_MODE_MASK) != device->mode) {
+		SPI_CTL0(bus->periph) &= ~SPI_CTL0_SPIEN;
+		SPI_CTL0(bus->periph) = (SPI_CTL0(bus->periph) & ~SPIBUS_MODE_MASK) | device->mode;
+	}
+	gpio_fast_low(device->cs_port, device->cs_pin);
+	bus->selected = device;
+}
+
+static void spibus_dma_channel(dma_channel_enum channel, uint32_t memory, uint8_t increase,
+		uint16_t length) {
+	dma_channel_disable(channel);
+	dma_memory_address_config(channel, memory);
+	if (increase) {
+		dma_memory_increase_enable(channel);
+	} else {
+		dma_memory_increase_disable(channel);
+	}
+	dma_transfer_number_config(channel, length);
+	dma_flag_clear(channel, DMA_FLAG_G);
+	dma_channel_enable(channel);
+}
+
+// head is done, the callback may submit the next transfer
+static void spibus_finish(spibus_t * bus) {
+	spibus_xfer_t * xfer = bus->head;
+
+	if (!(xfer->flags & SPIBUS_HOLD_CS)) {
+		gpio_fast_high(xfer->device->cs_port, xfer->device->cs_pin);
+		bus->selected = NULL;
+	}
+	bus->head = xfer->next;
+	if (bus->head == NULL) {
+		bus->tail = NULL;
+	}
+	spibus_unguard(bus);
+	xfer->done = 1;
+	if (xfer->callback != NULL) {
+		xfer->callback(xfer);
+	}
+}
+
+static void spibus_start(spibus_t * bus) {
+	spibus_xfer_t * xfer;
+
+	while (!bus->busy && ((xfer = bus->head) != NULL)) {
+		spibus_select(bus, xfer->device);
+		if (bus->dma && (xfer->length != 0)) {
+			bus->busy = 1;
+			spi_fast_begin(bus->periph);
+			// RX first, so no received byte is missed
+			spibus_dma_channel(bus->dma_rx, (xfer->rx != NULL) ? (uint32_t) xfer->rx
+					: (uint32_t) &bus->sink, xfer->rx != NULL, xfer->length);
+			spi_dma_enable(bus->periph, SPI_DMA_RECEIVE);
+			spibus_dma_channel(bus->dma_tx, (xfer->tx != NULL) ? (uint32_t) xfer->tx
+					: (uint32_t) &bus->dummy, xfer->tx != NULL, xfer->length);
+			spi_dma_enable(bus->periph, SPI_DMA_TRANSMIT);
+			return;
+		}
+		spi_fast_transfer(bus->periph, xfer->tx, xfer->rx, xfer->length);
+		spibus_finish(bus);
+	}
+}
+
+void spibus_init(spibus_t * bus, uint32_t periph, uint8_t dma) {
+	dma_parameter_struct dma_init_struct;
+
+	bus->periph = periph;
+	bus->dma = dma;
+	bus->head = NULL;
+	bus->tail = NULL;
+	bus->selected = NULL;
+	bus->busy = 0;
+	bus->dummy = SPI_FAST_DUMMY;
+	bus->dma_rx = (periph == SPI0) ? DMA_CH1 : DMA_CH3;
+	bus->dma_tx = (periph == SPI0) ? DMA_CH2 : DMA_CH4;
+	if (!dma) {
+		return;
+	}
+
+	hal_rcu_periph_clk_enable(RCU_DMA);
+
+	dma_struct_para_init(&dma_init_struct);
+	dma_init_struct.periph_addr = (uint32_t) &SPI_DATA(periph);
+	dma_init_struct.periph_width = DMA_PERIPHERAL_WIDTH_8BIT;
+	dma_init_struct.periph_inc = DMA_PERIPH_INCREASE_DISABLE;
+	dma_init_struct.memory_width = DMA_MEMORY_WIDTH_8BIT;
+	dma_init_struct.memory_inc = DMA_MEMORY_INCREASE_ENABLE;
+	dma_init_struct.number = 0;
+	dma_init_struct.priority = DMA_PRIORITY_HIGH;
+	dma_init_struct.direction = DMA_PERIPHERAL_TO_MEMORY;
+	dma_deinit(bus->dma_rx);
+	dma_init(bus->dma_rx, &dma_init_struct);
+	dma_interrupt_enable(bus->dma_rx, DMA_INT_FTF);
+
+	dma_init_struct.priority = DMA_PRIORITY_MEDIUM;
+	dma_init_struct.direction = DMA_MEMORY_TO_PERIPHERAL;
+	dma_deinit(bus->dma_tx);
+	dma_init(bus->dma_tx, &dma_init_struct);
+
+	hal_nvic_periph_irq_enable((periph == SPI0) ? DMA_Channel1_2_IRQn : DMA_Channel3_4_IRQn, 2);
+}
+
+void spibus_guard(spibus_t * bus, IRQn_Type irq) {
+	bus->guard_irq = irq;
+	bus->guard = 1;
+}
+
+void spibus_idle_wait(spibus_t * bus) {
+	while (bus->head != NULL) {
+	}
+}
+
+void spibus_submit(spibus_t * bus, spibus_xfer_t * xfer) {
+	uint8_t idle;
+
+	xfer->done = 0;
+	xfer->next = NULL;
+
+	__disable_irq();
+	// before the queue is non-empty, the handler would wait for it forever
+	if (bus->guard) {
+		NVIC_DisableIRQ(bus->guard_irq);
+	}
+	if (bus->head == NULL) {
+		bus->head = xfer;
+	} else {
+		bus->tail->next = xfer;
+	}
+	bus->tail = xfer;
+	// otherwise the running transfer starts it when done
+	idle = (bus->head == xfer) && !bus->busy;
+	__enable_irq();
+
+	if (idle) {
+		spibus_start(bus);
+	}
+}
+
+void spibus_wait(spibus_xfer_t * xfer) {
+	while (!xfer->done) {
+	}
+}
+
+void spibus_transfer(spibus_t * bus, const spibus_device_t * device,
+		const uint8_t * tx, uint8_t * rx, uint16_t length, uint8_t flags) {
+	spibus_xfer_t xfer;
+
+	xfer.device = device;
+	xfer.tx = tx;
+	xfer.rx = rx;
+	xfer.length = length;
+	xfer.flags = flags;
+	xfer.callback = NULL;
+	spibus_submit(bus, &xfer);
+	spibus_wait(&xfer);
+}
+
+void spibus_release(spibus_t * bus, const spibus_device_t * device) {
+	spibus_idle_wait(bus);
+	if (bus->selected == device) {
+		gpio_fast_high(device->cs_port, device->cs_pin);
+		bus->selected = NULL;
+		spibus_unguard(bus);
+	}
+}
+
+void spibus_dma_irq(spibus_t * bus) {
+	if (dma_interrupt_flag_get(bus->dma_rx, DMA_INT_FLAG_FTF) == RESET) {
+		return;
+	}
+	dma_interrupt_flag_clear(bus->dma_rx, DMA_INT_FLAG_G);
+	dma_channel_disable(bus->dma_rx);
+	dma_channel_disable(bus->dma_tx);
+	spi_dma_disable(bus->periph, SPI_DMA_TRANSMIT);
+	spi_dma_disable(bus->periph, SPI_DMA_RECEIVE);
+
+	bus->busy = 0;
+	spibus_finish(bus);
+	spibus_start(bus);
+}
+
+#endif // USE_SPI_BUS
@@ -0,0 +1,234 @@
+/**
+ * Beacon-synchronized TDMA uplinks for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_TDMA
+
+#include <stddef.h>
+#include <string.h>
+#include "gd32e23x_hal.h"
+#include "tdma.h"
+
+#define TDMA_PERIOD_MS		(TDMA_PERIOD_S * 1000UL)
+
+tdma_t tdma;
+
+// [ms] on the local clock since sync
+static uint32_t tdma_local_ms(void) {
+	uint16_t ms;
+	uint32_t now = sched_clock_fine(&ms);
+
+	return (now - tdma.sync_s) * 1000UL + ms;
+}
+
+// local clock reading for gateway time after sync
+static uint32_t tdma_to_local(uint32_t gateway_ms) {
+	return gateway_ms + (int32_t) ((int64_t) gateway_ms * tdma.drift_ppm / 1000000);
+}
+
+static uint32_t tdma_to_gateway(uint32_t local_ms) {
+	return local_ms - (int32_t) ((int64_t) local_ms * tdma.drift_ppm / (1000000 + tdma.drift_ppm));
+}
+
+// clock uncertainty at gateway time after sync
+static uint32_t tdma_guard(uint32_t gateway_ms) {
+	uint32_t guard = TDMA_GUARD_MIN_MS + (uint64_t) gateway_ms * tdma.jitter_ppm / 1000000;
+
+	return (guard > TDMA_PERIOD_MS / 2) ? TDMA_PERIOD_MS / 2 : guard;
+}
+
+// gateway time after sync of the own TX whose wake-up is not before deadline
+static uint32_t tdma_slot_time(uint32_t deadline) {
+	uint32_t phase = (tdma.sync_s % TDMA_PERIOD_S) * 1000UL;
+	uint32_t offset = tdma.slot * tdma.slot_ms + tdma.guard_ms;
+	uint32_t from = 1000;
+	uint32_t n = 0;
+
+	if (deadline > tdma.sync_s + 1) {
+		from = tdma_to_gateway((deadline - tdma.sync_s) * 1000UL);
+	}
+	// wake-ups are rounded down to the second, an aligned deadline maps to its own slot
+	from += phase - 500;
+	if (from > offset) {
+		n = (from - offset + TDMA_PERIOD_MS - 1) / TDMA_PERIOD_MS;
+	}
+	return n * TDMA_PERIOD_MS + offset - phase;
+}
+
+static void tdma_wait_until(uint32_t local_ms) {
+	while ((int32_t) (local_ms - tdma_local_ms()) > 0) {
+#ifdef USE_CRASH_LOG
+		// the own slot may be most of a period away
+		crashlog_feed();
+#endif // USE_CRASH_LOG
+		hal_basetick_delay_ms(1);
+	}
+}
+
+void tdma_init(void) {
+	memset(&tdma, 0, sizeof(tdma));
+	tdma.jitter_ppm = TDMA_DRIFT_INIT_PPM;
+	tdma.scan_s = sched_clock();
+	sched_set_period(SCHED_BEACON, TDMA_PERIOD_S);
+	tdma_align();
+}
+
+uint32_t tdma_window_open(void) {
+	tdma.received = 0;
+	if (!tdma.synced) {
+		return TDMA_PERIOD_MS + TDMA_BEACON_AIR_MS;
+	}
+	tdma_wait_until(tdma_to_local(tdma.beacon_ms) - tdma_guard(tdma.beacon_ms));
+	return tdma.window_ms;
+}
+
+void tdma_beacon(const uint8_t * payload, uint8_t length) {
+	uint32_t start = hal_basetick_count_get();
+	beacon_t beacon;
+	uint32_t gateway;
+	uint32_t local;
+	uint32_t elapsed;
+	uint32_t wait;
+	int32_t error;
+	int32_t sample;
+	int32_t deviation;
+	uint16_t ms;
+	uint8_t i;
+
+	local = sched_clock_fine(&ms);
+	elapsed = (local - tdma.sync_s) * 1000UL + ms;
+	local = (local % SCHED_SECONDS_PER_DAY) * 1000UL + ms;
+
+	if (length < offsetof(beacon_t, assign)) {
+		return;
+	}
+	memset(&beacon, 0, sizeof(beacon));
+	memcpy(&beacon, payload, (length < sizeof(beacon)) ? length : sizeof(beacon));
+	if ((beacon.period_s != TDMA_PERIOD_S) || (beacon.time_ms >= 1000) || (beacon.slot_count == 0)
+			|| ((beacon.slot_count + 1UL) * beacon.slot_ms > TDMA_PERIOD_MS)
+			|| (beacon.guard_ms >= beacon.slot_ms)) {
+		return;
+	}
+	if (beacon.assign_count > BEACON_MAX_ASSIGN) {
+		beacon.assign_count = BEACON_MAX_ASSIGN;
+	}
+
+	// error of the free-running RTC since last sync gives the drift
+	gateway = (beacon.time_s % SCHED_SECONDS_PER_DAY) * 1000UL + beacon.time_ms;
+	error = (int32_t) (local - gateway);
+	if (error > (int32_t) (SCHED_SECONDS_PER_DAY * 500UL)) {
+		error -= SCHED_SECONDS_PER_DAY * 1000UL;
+	} else if (error < -(int32_t) (SCHED_SECONDS_PER_DAY * 500UL)) {
+		error += SCHED_SECONDS_PER_DAY * 1000UL;
+	}
+	elapsed -= error;
+	if ((tdma.beacons != 0) && (elapsed >= TDMA_PERIOD_MS / 2) && (elapsed <= SCHED_SECONDS_PER_DAY * 1000UL)) {
+		sample = (int64_t) error * 1000000 / elapsed;
+		if (!tdma.drift_known) {
+			tdma.drift_ppm = sample;
+			tdma.drift_known = 1;
+		} else {
+			deviation = sample - tdma.drift_ppm;
+			if (deviation < 0) {
+				deviation = -deviation;
+			}
+			tdma.jitter_ppm += (deviation - tdma.jitter_ppm) / 4;
+			tdma.drift_ppm += (sample - tdma.drift_ppm) / 4;
+		}
+	}
+
+	tdma.slot_ms = beacon.slot_ms;
+	tdma.slot_count = beacon.slot_count;
+	tdma.guard_ms = beacon.guard_ms;
+	for (i = 0; i < beacon.assign_count; i++) {
+		if ((beacon.assign[i].device_id == DEVICE_ID) && (beacon.assign[i].slot >= 1)
+				&& (beacon.assign[i].slot <= beacon.slot_count)) {
+			tdma.slot = beacon.assign[i].slot;
+			tdma.assigned = 1;
+		}
+	}
+	if (!tdma.assigned || (tdma.slot > tdma.slot_count)) {
+		// provisional slot until the gateway assigns one
+		tdma.slot = 1 + DEVICE_ID % tdma.slot_count;
+		tdma.assigned = 0;
+	}
+
+	// RTC restarts its second when set, set it on the next gateway second
+	wait = 1000 - gateway % 1000;
+	elapsed = hal_basetick_count_get() - start;
+	hal_basetick_delay_ms((elapsed < wait) ? wait - elapsed : 0);
+	sched_set_time_of_day((gateway / 1000 + 1) % SCHED_SECONDS_PER_DAY);
+	tdma.sync_s = sched_clock();
+
+	tdma.beacon_ms = (TDMA_PERIOD_S - tdma.sync_s % TDMA_PERIOD_S) * 1000UL;
+	tdma.synced = 1;
+	tdma.received = 1;
+	tdma.missed = 0;
+	tdma.beacons++;
+}
+
+void tdma_window_close(void) {
+	if (tdma.received) {
+		return;
+	}
+	tdma.misses++;
+	if (!tdma.synced) {
+		tdma.scan_s = sched_clock() + TDMA_RESCAN_S;
+		return;
+	}
+	if (++tdma.missed >= TDMA_MAX_MISSED) {
+		tdma.synced = 0;
+		tdma.scan_s = sched_clock();
+		return;
+	}
+	// next beacon, the window widens with the time since sync
+	tdma.beacon_ms += TDMA_PERIOD_MS;
+}
+
+void tdma_align(void) {
+	uint32_t guard;
+
+	if (!tdma.synced) {
+		sched.exact &= ~(SCHED_BIT(SCHED_BEACON) | SCHED_BIT(SCHED_UPLINK));
+		sched_set_deadline(SCHED_BEACON, tdma.scan_s);
+		return;
+	}
+
+	guard = tdma_guard(tdma.beacon_ms);
+	tdma.window_ms = 2 * guard + TDMA_BEACON_AIR_MS;
+	sched_set_deadline(SCHED_BEACON, tdma.sync_s + (tdma_to_local(tdma.beacon_ms) - guard) / 1000);
+	sched_set_deadline(SCHED_UPLINK, tdma.sync_s
+			+ tdma_to_local(tdma_slot_time(sched.deadline[SCHED_UPLINK])) / 1000);
+	sched.exact |= SCHED_BIT(SCHED_BEACON) | SCHED_BIT(SCHED_UPLINK);
+}
+
+uint8_t tdma_slot_wait(void) {
+	uint32_t tx;
+
+	if (!tdma.synced) {
+		tdma.slot_end = 0;
+		return 1;
+	}
+	tx = tdma_to_local(tdma_slot_time(sched.deadline[SCHED_UPLINK]));
+	if ((int32_t) (tdma_local_ms() - tx) > 0) {
+		return 0;
+	}
+	tdma_wait_until(tx);
+	// the basetick keeps counting if a beacon in the window steps the RTC
+	tdma.slot_end = hal_basetick_count_get() + tdma.slot_ms - tdma.guard_ms;
+	return 1;
+}
+
+uint32_t tdma_slot_left(void) {
+	int32_t left;
+
+	if (tdma.slot_end == 0) {
+		return UINT32_MAX;
+	}
+	left = (int32_t) (tdma.slot_end - hal_basetick_count_get());
+	return (left > 0) ? (uint32_t) left : 0;
+}
+
+#endif // USE_TDMA
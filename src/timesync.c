@@ -0,0 +1,80 @@
+/**
+ * Wall time from gateway ACKs for LoggerSoft
+ */
+
+#include "main.h"
+
+#ifdef USE_TIME_SYNC
+
+#include <string.h>
+#include "gd32e23x_hal.h"
+#include "timesync.h"
+
+timesync_t timesync;
+
+void timesync_ack(const uint8_t * payload, uint8_t length) {
+	downlink_ack_t ack;
+	int64_t error_ms;
+	uint16_t ms;
+	uint32_t now = sched_clock_fine(&ms);
+
+	if (length < sizeof(ack)) {
+		return;
+	}
+	memcpy(&ack, payload, sizeof(ack));
+	if ((ack.time_s == 0) || (ack.time_ms >= 1000)) {
+		return;
+	}
+
+	timesync.rx_s = now;
+	timesync.rx_ms = ms;
+	timesync.gateway_s = ack.time_s;
+	timesync.gateway_ms = ack.time_ms;
+	if (timesync.synced) {
+		// seconds may be off by years after a bad step, x1000 overflows int32_t
+		error_ms = (int64_t) (int32_t) (timesync.offset_s + sched_uptime(now) - ack.time_s) * 1000
+				+ ms - ack.time_ms;
+		if (error_ms > INT32_MAX) {
+			error_ms = INT32_MAX;
+		} else if (error_ms < -INT32_MAX) {
+			error_ms = -INT32_MAX;
+		}
+		timesync.error_ms = (int32_t) error_ms;
+	}
+	timesync.pending = 1;
+}
+
+void timesync_apply(void) {
+	uint32_t now;
+	uint32_t gateway_ms;
+	uint32_t second;
+	uint16_t ms;
+
+	if (!timesync.pending) {
+		return;
+	}
+	timesync.pending = 0;
+	if (timesync.synced && (timesync.error_ms <= TIME_SYNC_MAX_ERROR_MS)
+			&& (timesync.error_ms >= -TIME_SYNC_MAX_ERROR_MS)) {
+		return;
+	}
+
+	// gateway time now, the RTC drift over the window is negligible
+	now = sched_clock_fine(&ms);
+	gateway_ms = timesync.gateway_ms + (now - timesync.rx_s) * 1000UL + ms - timesync.rx_ms;
+	second = timesync.gateway_s + gateway_ms / 1000 + 1;
+
+	// RTC restarts its second when set, set it on the next gateway second
+	hal_basetick_delay_ms(1000 - gateway_ms % 1000);
+	sched_set_time_of_day(second % SCHED_SECONDS_PER_DAY);
+	timesync.offset_s = second - sched_uptime(sched_clock());
+	timesync.error_ms = 0;
+	timesync.synced = 1;
+	timesync.steps++;
+}
+
+uint32_t timesync_time(uint32_t uptime) {
+	return timesync.synced ? timesync.offset_s + uptime : uptime;
+}
+
+#endif // USE_TIME_SYNC
@@ -18,13 +18,23 @@
 #ifdef USE_W25Q_EXT_FLASH
 
 #include "gd32e23x_hal_gpio.h"
+#include "gpio_fast.h"
+#include "spi_fast.h"
 #include "z_flash_W25QXXX.h"
 
-#define SPI_IS_BUSY 	(hal_gpio_output_bit_get(FLASH_CS_GPIO_Port, FLASH_CS_Pin)==RESET)
-#define HAL_MAX_DELAY 1000
+#define SPI_IS_BUSY 	(!gpio_fast_driven(FLASH_CS_GPIO_Port, FLASH_CS_Pin))
 
 extern hal_spi_dev_struct FLASH_SPI_PORT;
 
+#ifdef USE_SPI_BUS
+// chip select and the msd_spi1_init() settings of the flash
+static const spibus_device_t flash_spibus_device = {
+	FLASH_CS_GPIO_Port, FLASH_CS_Pin, SPI_PSC_16 | SPI_CK_PL_LOW_PH_1EDGE
+};
+
+#define FLASH_SPIBUS	spibus_of(FLASH_SPI)
+#endif // USE_SPI_BUS
+
 
 
 
@@ -38,8 +48,19 @@ extern hal_spi_dev_struct FLASH_SPI_PORT;
  * 			understand if previous transmission terminated
  ******************************************/
 void Flash_Select(void) {
+#ifdef USE_SPI_BUS
+		// the bus drives CS with the first transfer of the command
+#elif !defined(EXT_FLASH_SPI_POLLING_MODE)
+		// only a DMA transfer may still hold CS, polling ends with Flash_UnSelect()
 		while (SPI_IS_BUSY) {}
-		hal_gpio_bit_write(FLASH_CS_GPIO_Port, FLASH_CS_Pin, RESET);
+#endif  // FLASH_SPI_POLLING_MODE
+#ifndef USE_SPI_BUS
+#if defined(USE_FHSS) && defined(EXT_FLASH_SPI_POLLING_MODE)
+		// the hop interrupt talks to the radio on the same SPI, Flash_UnSelect() lets it in
+		SX1278_hw_irq_hold(&SX1278_hw);
+#endif // USE_FHSS && EXT_FLASH_SPI_POLLING_MODE
+		gpio_fast_low(FLASH_CS_GPIO_Port, FLASH_CS_Pin);
+#endif // USE_SPI_BUS
 }
 
 
@@ -51,8 +72,13 @@ void Flash_Select(void) {
  ******************************************/
 void Flash_UnSelect(void) {
 	// CS pin must be low (selected flash) until previous transmission is completed
-#ifdef	EXT_FLASH_SPI_POLLING_MODE
-	hal_gpio_bit_write(FLASH_CS_GPIO_Port, FLASH_CS_Pin, SET);	//unselect
+#ifdef USE_SPI_BUS
+	spibus_release(FLASH_SPIBUS, &flash_spibus_device);
+#elif defined(EXT_FLASH_SPI_POLLING_MODE)
+	gpio_fast_high(FLASH_CS_GPIO_Port, FLASH_CS_Pin);	//unselect
+#ifdef USE_FHSS
+	SX1278_hw_irq_release(&SX1278_hw);
+#endif // USE_FHSS
 #endif  // FLASH_SPI_POLLING_MODE
 }
 
@@ -60,7 +86,11 @@ void Flash_UnSelect(void) {
 
 
 void Flash_Receive(uint8_t* data, uint16_t dataSize){
-	hal_spi_receive_poll(&FLASH_SPI_PORT , data, dataSize, HAL_MAX_DELAY);
+#ifdef USE_SPI_BUS
+	spibus_transfer(FLASH_SPIBUS, &flash_spibus_device, NULL, data, dataSize, SPIBUS_HOLD_CS);
+#else
+	spi_fast_transfer(FLASH_SPI_PORT.periph, NULL, data, dataSize);
+#endif // USE_SPI_BUS
 }
 
 
@@ -72,7 +102,11 @@ void Flash_Receive(uint8_t* data, uint16_t dataSize){
  * 			dataSize	number of bytes in "data" to be sent
  *********************************************************************/
 void Flash_Polling_Transmit(uint8_t* data, uint16_t dataSize){
-	hal_spi_transmit_poll(&FLASH_SPI_PORT , data, dataSize, HAL_MAX_DELAY);
+#ifdef USE_SPI_BUS
+	spibus_transfer(FLASH_SPIBUS, &flash_spibus_device, data, NULL, dataSize, SPIBUS_HOLD_CS);
+#else
+	spi_fast_transfer(FLASH_SPI_PORT.periph, data, NULL, dataSize);
+#endif // USE_SPI_BUS
 }
 
 
@@ -87,15 +121,20 @@ void Flash_Polling_Transmit(uint8_t* data, uint16_t dataSize){
  * 			dataSize	number of bytes in "data" to be sent
  **************************/
 void Flash_Transmit(uint8_t* data, uint16_t dataSize){
+#ifdef USE_SPI_BUS
+	// on the DMA queue when the bus has it, for any length
+	spibus_transfer(FLASH_SPIBUS, &flash_spibus_device, data, NULL, dataSize, SPIBUS_HOLD_CS);
+#else
 #ifndef	EXT_FLASH_SPI_POLLING_MODE
 	if (dataSize<EXT_FLASH_DMA_CUTOFF) {
 #endif //FLASH_SPI_POLLING_MODE
-		hal_spi_transmit_poll(&FLASH_SPI_PORT , data, dataSize, HAL_MAX_DELAY);
+		spi_fast_transfer(FLASH_SPI_PORT.periph, data, NULL, dataSize);
 #ifndef	EXT_FLASH_SPI_POLLING_MODE
 	} else {
 		HAL_SPI_Transmit_DMA(&EXT_FLASH_SPI_PORT , data, dataSize);
 	}
 #endif  //FLASH_SPI_POLLING_MODE
+#endif // USE_SPI_BUS
 }
 
 
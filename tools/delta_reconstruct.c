@@ -0,0 +1,226 @@
+/**
+ * Gateway-side reconstruction of send-on-delta series
+ *
+ * Reads received LoggerSoft frames from stdin, one frame per line as hex
+ * bytes (spaces allowed), and writes the full sample series as CSV to
+ * stdout. Samples suppressed by the node (gaps in packet_sample_t.seq)
+ * are filled with the last received value and marked held=1.
+ * Samples whose seq is not ahead of the last one are repeats and skipped,
+ * at most twice the heartbeat samples are held over one gap.
+ * Per-device suppression ratio is printed to stderr.
+ *
+ * Frames with PACKET_FLAG_TIME give every sample its time, Unix time if
+ * PACKET_FLAG_TIME_UNIX is set (unix=1), node uptime otherwise. Held
+ * samples and frames without times have an empty time.
+ *
+ * The heartbeat is DELTA_HEARTBEAT of main.h, taken at build time, or
+ * given on the command line for nodes built with another one.
+ *
+ * Build: gcc -O2 -I../inc -DDELTA_HEARTBEAT=$(awk '/^#define DELTA_HEARTBEAT/ { print $3 }' ../inc/main.h) -o delta_reconstruct delta_reconstruct.c
+ * Usage: delta_reconstruct [heartbeat] < frames.txt
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "packet.h"
+
+#define MAX_DEVICES		64
+#define MAX_LINE		1024
+#define SEQ_WINDOW		127		// seq ahead of the last one by up to this is new
+
+#ifndef DELTA_HEARTBEAT
+#error "build with -DDELTA_HEARTBEAT of main.h, see Build"
+#endif
+
+typedef struct {
+	uint32_t device_id;
+	packet_sample_t last;
+	uint32_t received;
+	uint32_t held;
+	uint32_t duplicates;
+} device_t;
+
+static device_t devices[MAX_DEVICES];
+static int devices_count = 0;
+static int max_hold = 2 * DELTA_HEARTBEAT;	// samples held over one gap
+
+static device_t * device_get(uint32_t device_id) {
+	int i;
+
+	for (i = 0; i < devices_count; i++) {
+		if (devices[i].device_id == device_id) {
+			return &devices[i];
+		}
+	}
+	if (devices_count == MAX_DEVICES) {
+		return NULL;
+	}
+	memset(&devices[devices_count], 0, sizeof(device_t));
+	devices[devices_count].device_id = device_id;
+	return &devices[devices_count++];
+}
+
+static int hex_value(int c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	c = tolower(c);
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+static int parse_hex(const char * line, uint8_t * buf, int size) {
+	int length = 0;
+	int high = -1;
+	int v;
+
+	for (; *line; line++) {
+		v = hex_value((unsigned char)*line);
+		if (v < 0) {
+			continue;
+		}
+		if (high < 0) {
+			high = v;
+		} else {
+			if (length == size) {
+				return -1;
+			}
+			buf[length++] = (uint8_t)((high << 4) | v);
+			high = -1;
+		}
+	}
+	return length;
+}
+
+static void print_sample(uint32_t device_id, const packet_sample_t * s, int held,
+		const uint32_t * time, int unix_time) {
+	printf("%08lX,%u,%.2f,%.2f,%.1f,%u,%d,", (unsigned long)device_id,
+			s->seq, s->temperature / 100.0, s->humidity / 100.0,
+			s->pressure / 10.0, s->voltage, held);
+	if (time != NULL) {
+		printf("%lu,%d\n", (unsigned long)*time, unix_time);
+	} else {
+		printf(",\n");
+	}
+}
+
+// sample times from the time block, 0 if the frame has none
+static int parse_times(const uint8_t * buf, int length, const packet_header_t * header,
+		uint32_t * times) {
+	int offset = sizeof(*header) + header->count * sizeof(packet_sample_t);
+	packet_time_t time;
+	uint16_t delta;
+	int known = 1;
+	int i;
+
+	if (!(header->flags & PACKET_FLAG_TIME)) {
+		return 0;
+	}
+	if (header->flags & PACKET_FLAG_STATUS) {
+		offset += sizeof(packet_status_t);
+	}
+	if (length < offset + (int)(sizeof(time) + header->count * sizeof(delta))) {
+		return 0;
+	}
+	memcpy(&time, buf + offset, sizeof(time));
+	offset += sizeof(time);
+	for (i = 0; i < header->count; i++) {
+		memcpy(&delta, buf + offset + i * sizeof(delta), sizeof(delta));
+		known = known && (delta != PACKET_DELTA_UNKNOWN);
+		time.time += delta;
+		times[i] = known ? time.time : 0;
+	}
+	return 1;
+}
+
+static void process_frame(const uint8_t * buf, int length) {
+	packet_header_t header;
+	packet_sample_t sample;
+	uint32_t times[255];
+	int timed;
+	device_t * dev;
+	uint8_t ahead;
+	uint8_t gap;
+	int i;
+
+	if (length < (int)sizeof(header)) {
+		return;
+	}
+	memcpy(&header, buf, sizeof(header));
+	if (header.type != PACKET_TYPE_SAMPLES) {
+		return;
+	}
+	if (length < (int)(sizeof(header) + header.count * sizeof(packet_sample_t))) {
+		return;
+	}
+
+	dev = device_get(header.device_id);
+	if (dev == NULL) {
+		return;
+	}
+	timed = parse_times(buf, length, &header, times);
+
+	for (i = 0; i < header.count; i++) {
+		memcpy(&sample, buf + sizeof(header) + i * sizeof(packet_sample_t), sizeof(sample));
+
+		if (dev->received) {
+			ahead = (uint8_t)(sample.seq - dev->last.seq);
+			// repeated (retransmission, relay, FEC) or older than the last one
+			if ((ahead == 0) || (ahead > SEQ_WINDOW)) {
+				dev->duplicates++;
+				continue;
+			}
+			// hold last value over the samples the node did not send, a longer gap is lost frames
+			gap = ahead - 1;
+			if (gap > max_hold) {
+				gap = max_hold;
+			}
+			while (gap--) {
+				dev->last.seq++;
+				print_sample(dev->device_id, &dev->last, 1, NULL, 0);
+				dev->held++;
+			}
+		}
+
+		print_sample(dev->device_id, &sample, 0, (timed && times[i]) ? &times[i] : NULL,
+				(header.flags & PACKET_FLAG_TIME_UNIX) != 0);
+		dev->last = sample;
+		dev->received++;
+	}
+}
+
+int main(int argc, char ** argv) {
+	char line[MAX_LINE];
+	uint8_t buf[256];
+	int length;
+	int i;
+
+	if (argc > 1) {
+		max_hold = 2 * atoi(argv[1]);
+	}
+
+	printf("device_id,seq,temperature,humidity,pressure_hpa,voltage_mv,held,time,unix\n");
+
+	while (fgets(line, sizeof(line), stdin)) {
+		length = parse_hex(line, buf, sizeof(buf));
+		if (length > 0) {
+			process_frame(buf, length);
+		}
+	}
+
+	for (i = 0; i < devices_count; i++) {
+		uint32_t total = devices[i].received + devices[i].held;
+		fprintf(stderr, "%08lX: %lu received, %lu held, %lu repeated, suppression %.1f %%\n",
+				(unsigned long)devices[i].device_id,
+				(unsigned long)devices[i].received, (unsigned long)devices[i].held,
+				(unsigned long)devices[i].duplicates,
+				total ? 100.0 * devices[i].held / total : 0.0);
+	}
+	return 0;
+}
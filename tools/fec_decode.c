@@ -0,0 +1,316 @@
+/**
+ * Gateway-side erasure decoder for LoggerSoft uplinks
+ *
+ * Reads received LoggerSoft frames from stdin, one frame per line as hex
+ * bytes (spaces allowed), and writes them back to stdout in the same
+ * format, followed by every data frame rebuilt from PACKET_TYPE_PARITY
+ * frames as soon as its group allows it. The output feeds
+ * delta_reconstruct as it is. Parity frames are not written.
+ * Per-device counts of received, rebuilt and lost frames go to stderr.
+ *
+ * Build: gcc -O2 -I../inc -o fec_decode fec_decode.c
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "packet.h"
+
+#define MAX_DEVICES		64
+#define MAX_LINE		1024
+#define HISTORY			64		// frames kept per device
+#define MAX_GROUP		16
+
+typedef struct {
+	uint32_t msg_id;
+	int length;				// 0 if unused
+	uint8_t data[256];
+} frame_t;
+
+typedef struct {
+	uint32_t device_id;
+	frame_t history[HISTORY];
+	int next;
+	// parity of the latest group
+	uint32_t msg_id[MAX_GROUP];
+	uint8_t lengths[MAX_GROUP];
+	int group;
+	uint8_t parity[2][256];
+	int size;
+	int have[2];
+	int done;
+	uint32_t received;
+	uint32_t rebuilt;
+	uint32_t lost;
+} device_t;
+
+static device_t devices[MAX_DEVICES];
+static int devices_count = 0;
+
+static device_t * device_get(uint32_t device_id) {
+	int i;
+
+	for (i = 0; i < devices_count; i++) {
+		if (devices[i].device_id == device_id) {
+			return &devices[i];
+		}
+	}
+	if (devices_count == MAX_DEVICES) {
+		return NULL;
+	}
+	memset(&devices[devices_count], 0, sizeof(device_t));
+	devices[devices_count].device_id = device_id;
+	return &devices[devices_count++];
+}
+
+static int hex_value(int c) {
+	if (c >= '0' && c <= '9') {
+		return c - '0';
+	}
+	c = tolower(c);
+	if (c >= 'a' && c <= 'f') {
+		return c - 'a' + 10;
+	}
+	return -1;
+}
+
+static int parse_hex(const char * line, uint8_t * buf, int size) {
+	int length = 0;
+	int high = -1;
+	int v;
+
+	for (; *line; line++) {
+		v = hex_value((unsigned char)*line);
+		if (v < 0) {
+			continue;
+		}
+		if (high < 0) {
+			high = v;
+		} else {
+			if (length == size) {
+				return -1;
+			}
+			buf[length++] = (uint8_t)((high << 4) | v);
+			high = -1;
+		}
+	}
+	return length;
+}
+
+static void print_hex(const uint8_t * buf, int length) {
+	int i;
+
+	for (i = 0; i < length; i++) {
+		printf("%02X%s", buf[i], (i + 1 < length) ? " " : "\n");
+	}
+}
+
+// GF(2^8), polynomial 0x11D, as in fec.c
+static uint8_t gf_mul(uint8_t a, uint8_t b) {
+	uint8_t product = 0;
+
+	while (b) {
+		if (b & 1) {
+			product ^= a;
+		}
+		a = (a & 0x80) ? (uint8_t)(a << 1) ^ 0x1D : (uint8_t)(a << 1);
+		b >>= 1;
+	}
+	return product;
+}
+
+static uint8_t gf_pow2(int n) {
+	uint8_t x = 1;
+
+	while (n--) {
+		x = gf_mul(x, 2);
+	}
+	return x;
+}
+
+static uint8_t gf_inv(uint8_t a) {
+	int x;
+
+	for (x = 1; x < 256; x++) {
+		if (gf_mul(a, (uint8_t)x) == 1) {
+			return (uint8_t)x;
+		}
+	}
+	return 0;
+}
+
+static frame_t * history_find(device_t * dev, uint32_t msg_id) {
+	int i;
+
+	for (i = 0; i < HISTORY; i++) {
+		if (dev->history[i].length && (dev->history[i].msg_id == msg_id)) {
+			return &dev->history[i];
+		}
+	}
+	return NULL;
+}
+
+static void history_add(device_t * dev, uint32_t msg_id, const uint8_t * buf, int length) {
+	frame_t * frame = &dev->history[dev->next];
+
+	dev->next = (dev->next + 1) % HISTORY;
+	frame->msg_id = msg_id;
+	frame->length = length;
+	memcpy(frame->data, buf, length);
+}
+
+static void rebuilt(device_t * dev, int index, const uint8_t * data) {
+	history_add(dev, dev->msg_id[index], data, dev->lengths[index]);
+	print_hex(data, dev->lengths[index]);
+	dev->rebuilt++;
+}
+
+static void recover(device_t * dev) {
+	uint8_t syndrome[2][256];
+	uint8_t data[2][256];
+	uint8_t ga;
+	uint8_t gb;
+	uint8_t inv;
+	frame_t * frame;
+	int missing[2];
+	int count = 0;
+	int i;
+	int j;
+
+	if (dev->done) {
+		return;
+	}
+	memcpy(syndrome, dev->parity, sizeof(syndrome));
+	for (i = 0; i < dev->group; i++) {
+		frame = history_find(dev, dev->msg_id[i]);
+		if (frame == NULL) {
+			if (count == 2) {
+				return;
+			}
+			missing[count++] = i;
+			continue;
+		}
+		ga = gf_pow2(i);
+		for (j = 0; j < frame->length && j < dev->size; j++) {
+			syndrome[0][j] ^= frame->data[j];
+			syndrome[1][j] ^= gf_mul(ga, frame->data[j]);
+		}
+	}
+	if (count == 0) {
+		dev->done = 1;
+		return;
+	}
+
+	if ((count == 1) && dev->have[0]) {
+		rebuilt(dev, missing[0], syndrome[0]);
+	} else if ((count == 1) && dev->have[1]) {
+		inv = gf_inv(gf_pow2(missing[0]));
+		for (j = 0; j < dev->size; j++) {
+			data[0][j] = gf_mul(inv, syndrome[1][j]);
+		}
+		rebuilt(dev, missing[0], data[0]);
+	} else if ((count == 2) && dev->have[0] && dev->have[1]) {
+		// Da = (Q' + g^b P') / (g^a + g^b), Db = P' + Da
+		ga = gf_pow2(missing[0]);
+		gb = gf_pow2(missing[1]);
+		inv = gf_inv(ga ^ gb);
+		for (j = 0; j < dev->size; j++) {
+			data[0][j] = gf_mul(inv, syndrome[1][j] ^ gf_mul(gb, syndrome[0][j]));
+			data[1][j] = syndrome[0][j] ^ data[0][j];
+		}
+		rebuilt(dev, missing[0], data[0]);
+		rebuilt(dev, missing[1], data[1]);
+	} else {
+		return;
+	}
+	dev->done = 1;
+}
+
+// frames of a group given up on
+static void recover_lost(device_t * dev) {
+	int i;
+
+	for (i = 0; i < dev->group; i++) {
+		dev->lost += history_find(dev, dev->msg_id[i]) == NULL;
+	}
+}
+
+static void process_parity(device_t * dev, const uint8_t * buf, int length) {
+	fec_parity_t parity;
+	int offset = sizeof(packet_header_t);
+
+	if (length < offset + (int)sizeof(parity)) {
+		return;
+	}
+	memcpy(&parity, buf + offset, sizeof(parity));
+	offset += sizeof(parity);
+	if ((parity.index > FEC_INDEX_RS) || (parity.group == 0) || (parity.group > MAX_GROUP)
+			|| (length < offset + parity.group * 5)) {
+		return;
+	}
+
+	// a new group, count what the previous one could not restore
+	if ((parity.group != dev->group) || memcmp(dev->msg_id, buf + offset, parity.group * 4)) {
+		if (dev->group && !dev->done) {
+			recover_lost(dev);
+		}
+		dev->group = parity.group;
+		memcpy(dev->msg_id, buf + offset, parity.group * 4);
+		memcpy(dev->lengths, buf + offset + parity.group * 4, parity.group);
+		memset(dev->parity, 0, sizeof(dev->parity));
+		memset(dev->have, 0, sizeof(dev->have));
+		dev->done = 0;
+	}
+	offset += parity.group * 5;
+	dev->size = length - offset;
+	memcpy(dev->parity[parity.index], buf + offset, dev->size);
+	dev->have[parity.index] = 1;
+	recover(dev);
+}
+
+static void process_frame(const uint8_t * buf, int length) {
+	packet_header_t header;
+	device_t * dev;
+
+	if (length < (int)sizeof(header)) {
+		return;
+	}
+	memcpy(&header, buf, sizeof(header));
+	dev = device_get(header.device_id);
+	if (dev == NULL) {
+		return;
+	}
+	if (header.type == PACKET_TYPE_PARITY) {
+		process_parity(dev, buf, length);
+		return;
+	}
+	history_add(dev, header.msg_id, buf, length);
+	print_hex(buf, length);
+	dev->received++;
+}
+
+int main(void) {
+	char line[MAX_LINE];
+	uint8_t buf[256];
+	int length;
+	int i;
+
+	while (fgets(line, sizeof(line), stdin)) {
+		length = parse_hex(line, buf, sizeof(buf));
+		if (length > 0) {
+			process_frame(buf, length);
+		}
+	}
+
+	for (i = 0; i < devices_count; i++) {
+		if (devices[i].group && !devices[i].done) {
+			recover_lost(&devices[i]);
+		}
+		fprintf(stderr, "%08lX: %lu received, %lu rebuilt, %lu lost in covered groups\n",
+				(unsigned long)devices[i].device_id, (unsigned long)devices[i].received,
+				(unsigned long)devices[i].rebuilt, (unsigned long)devices[i].lost);
+	}
+	return 0;
+}
@@ -0,0 +1,164 @@
+/**
+ * Uplink protection simulator for LoggerSoft
+ *
+ * Compares blind duplication (every frame sent n times back to back)
+ * with the erasure code of fec.c (FEC_GROUP data frames, then FEC_PARITY
+ * parity frames) at growing frame loss. A data frame is delivered if any
+ * copy arrives, or, with FEC, if no more data frames of its group were
+ * lost than parity frames arrived.
+ *
+ * Losses follow a two-state burst model with the given mean burst
+ * length, 1 gives independent losses. Copies of a frame go out back to
+ * back and share its bursts. Airtime is relative to sending
+ * every data frame once, from the LoRa time on air at SF12, 125 kHz,
+ * CR 4/8 of a full timed sample frame and of the matching parity frame.
+ *
+ * Build: gcc -O2 -o fec_sim fec_sim.c -lm
+ * Usage: fec_sim [burst] [groups]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+// packet.h sizes: header 11, 8 samples of 9, time block 4 + 8 * 2
+#define DATA_BYTES			103
+#define PARITY_BYTES(k)		(11 + 2 + 5 * (k) + DATA_BYTES)
+
+typedef struct {
+	const char * name;
+	int copies;				// duplication, 0 for FEC
+	int k;
+	int r;
+} scheme_t;
+
+static const scheme_t schemes[] = {
+	{ "none", 1, 0, 0 },
+	{ "dup x2", 2, 0, 0 },
+	{ "dup x3", 3, 0, 0 },
+	{ "xor 8+1", 0, 8, 1 },
+	{ "xor 4+1", 0, 4, 1 },
+	{ "xor 2+1", 0, 2, 1 },
+	{ "rs 8+2", 0, 8, 2 },
+	{ "rs 4+2", 0, 4, 2 },
+};
+
+#define SCHEMES		(sizeof(schemes) / sizeof(schemes[0]))
+
+static const double losses[] = { 0.01, 0.02, 0.05, 0.10, 0.20, 0.30 };
+
+#define LOSSES		(sizeof(losses) / sizeof(losses[0]))
+
+static double loss_rate;
+static double burst;
+static int bad;
+
+// LoRa time on air [ms], explicit header, CRC on, LDRO off as in SX1278_time_on_air_us()
+static double airtime_ms(int bytes) {
+	const int sf = 12;
+	double symbol_ms = (double)(1 << sf) / 125.0;
+	double payload = ceil((8.0 * bytes - 4 * sf + 28 + 16) / (4.0 * sf)) * 8;
+
+	if (payload < 0) {
+		payload = 0;
+	}
+	return (12.25 + 8 + payload) * symbol_ms;
+}
+
+static double uniform(void) {
+	return (rand() + 0.5) / ((double)RAND_MAX + 1.0);
+}
+
+// Gilbert channel with stationary loss loss_rate and mean burst length burst
+static int lost(void) {
+	double leave_bad = 1.0 / burst;
+	double enter_bad = loss_rate * leave_bad / (1.0 - loss_rate);
+
+	if (burst <= 1.0) {
+		return uniform() < loss_rate;
+	}
+	bad = bad ? (uniform() >= leave_bad) : (uniform() < enter_bad);
+	return bad;
+}
+
+static double simulate(const scheme_t * s, int groups) {
+	long delivered = 0;
+	long total = 0;
+	int lost_data;
+	int parity_ok;
+	int ok;
+	int g;
+	int i;
+	int c;
+
+	bad = 0;
+	if (s->copies) {
+		for (g = 0; g < groups * 8; g++) {
+			ok = 0;
+			for (c = 0; c < s->copies; c++) {
+				ok |= !lost();
+			}
+			delivered += ok;
+			total++;
+		}
+		return (double)delivered / total;
+	}
+
+	for (g = 0; g < groups * 8 / s->k; g++) {
+		lost_data = 0;
+		parity_ok = 0;
+		for (i = 0; i < s->k; i++) {
+			lost_data += lost();
+		}
+		for (i = 0; i < s->r; i++) {
+			parity_ok += !lost();
+		}
+		delivered += (lost_data <= parity_ok) ? s->k : s->k - lost_data;
+		total += s->k;
+	}
+	return (double)delivered / total;
+}
+
+static double relative_airtime(const scheme_t * s) {
+	if (s->copies) {
+		return s->copies;
+	}
+	return (s->k * airtime_ms(DATA_BYTES) + s->r * airtime_ms(PARITY_BYTES(s->k)))
+			/ (s->k * airtime_ms(DATA_BYTES));
+}
+
+int main(int argc, char ** argv) {
+	int groups = (argc > 2) ? atoi(argv[2]) : 100000;
+	unsigned i;
+	unsigned j;
+
+	burst = (argc > 1) ? atof(argv[1]) : 1.0;
+	if ((burst < 1.0) || (groups < 1)) {
+		fprintf(stderr, "usage: fec_sim [burst >= 1] [groups]\n");
+		return 1;
+	}
+	srand(1);
+
+	printf("data frame %d bytes, %.0f ms at SF12, mean burst %.1f frames\n\n",
+			DATA_BYTES, airtime_ms(DATA_BYTES), burst);
+	printf("%-8s", "loss");
+	for (j = 0; j < SCHEMES; j++) {
+		printf("%9s", schemes[j].name);
+	}
+	printf("\n%-8s", "airtime");
+	for (j = 0; j < SCHEMES; j++) {
+		printf("%8.2fx", relative_airtime(&schemes[j]));
+	}
+	printf("\n");
+
+	for (i = 0; i < LOSSES; i++) {
+		loss_rate = losses[i];
+		printf("%5.0f %% ", loss_rate * 100);
+		for (j = 0; j < SCHEMES; j++) {
+			printf("%8.2f%%", 100.0 * simulate(&schemes[j], groups));
+		}
+		printf("\n");
+	}
+	return 0;
+}
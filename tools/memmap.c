@@ -0,0 +1,253 @@
+/**
+ * Static memory report for LoggerSoft
+ *
+ * Reads the GNU ld map file of a firmware build and sums the input
+ * sections per module (object file, or library for archive members):
+ * code, constants, initialised and zeroed variables. The table lists
+ * flash (text + rodata + data) and RAM (data + bss) per module, largest
+ * RAM user first, then the totals against the FLASH and RAM regions of
+ * the memory configuration, with __stack_size taken from RAM.
+ *
+ * Sections the linker dropped with --gc-sections are listed before the
+ * memory map and are not counted, nor is alignment fill, so the totals
+ * may stay a few bytes below the output section sizes.
+ *
+ * Link with -Wl,-Map=LoggerSoft.map (GD ARM MCU Linker, Miscellaneous,
+ * other flags) to get the map file.
+ *
+ * Build: gcc -O2 -o memmap memmap.c
+ * Usage: memmap LoggerSoft.map
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_MODULES			128
+#define NAME_SIZE			48
+#define LINE_SIZE			512
+
+enum { TEXT = 0, RODATA, DATA, BSS, KINDS };
+
+typedef struct {
+	char name[NAME_SIZE];
+	unsigned long size[KINDS];
+} module_t;
+
+static module_t modules[MAX_MODULES];
+static int module_count;
+
+static unsigned long flash_origin, flash_length;
+static unsigned long ram_origin, ram_length;
+static unsigned long stack_size;
+
+// module of an input file: basename, archive members count for the archive
+static module_t * module_find(const char * file) {
+	char name[NAME_SIZE];
+	const char * base;
+	const char * paren;
+	size_t length;
+	int i;
+
+	paren = strchr(file, '(');
+	length = paren ? (size_t) (paren - file) : strlen(file);
+	base = file + length;
+	while ((base > file) && (base[-1] != '/') && (base[-1] != '\\')) {
+		base--;
+	}
+	length -= base - file;
+	if (length >= NAME_SIZE) {
+		length = NAME_SIZE - 1;
+	}
+	memcpy(name, base, length);
+	name[length] = '\0';
+
+	for (i = 0; i < module_count; i++) {
+		if (strcmp(modules[i].name, name) == 0) {
+			return &modules[i];
+		}
+	}
+	if (module_count == MAX_MODULES) {
+		fprintf(stderr, "more than %d modules\n", MAX_MODULES);
+		exit(1);
+	}
+	strcpy(modules[module_count].name, name);
+	return &modules[module_count++];
+}
+
+// kind of an output section, -1 if not loaded (debug info, .stack)
+static int section_kind(const char * section) {
+	if ((strcmp(section, ".vectors") == 0) || (strncmp(section, ".text", 5) == 0)) {
+		return TEXT;
+	}
+	if ((strncmp(section, ".rodata", 7) == 0) || (strncmp(section, ".ARM", 4) == 0)
+			|| (strstr(section, "_array") != NULL) || (strcmp(section, ".logger_id") == 0)
+			|| (strcmp(section, ".magic_signature") == 0)) {
+		return RODATA;
+	}
+	if (strcmp(section, ".data") == 0) {
+		return DATA;
+	}
+	if (strcmp(section, ".bss") == 0) {
+		return BSS;
+	}
+	return -1;
+}
+
+static int is_hex(const char * word) {
+	return (word[0] == '0') && (word[1] == 'x');
+}
+
+static int module_compare(const void * a, const void * b) {
+	const module_t * ma = a;
+	const module_t * mb = b;
+	unsigned long ra = ma->size[DATA] + ma->size[BSS];
+	unsigned long rb = mb->size[DATA] + mb->size[BSS];
+	unsigned long fa = ma->size[TEXT] + ma->size[RODATA] + ma->size[DATA];
+	unsigned long fb = mb->size[TEXT] + mb->size[RODATA] + mb->size[DATA];
+
+	if (ra != rb) {
+		return (ra < rb) ? 1 : -1;
+	}
+	if (fa != fb) {
+		return (fa < fb) ? 1 : -1;
+	}
+	return strcmp(ma->name, mb->name);
+}
+
+int main(int argc, char ** argv) {
+	char line[LINE_SIZE];
+	char pending[LINE_SIZE];	// input section name alone on its line
+	char word[LINE_SIZE];
+	char file[LINE_SIZE];
+	char hex1[LINE_SIZE];
+	char hex2[LINE_SIZE];
+	unsigned long address, size, origin, length;
+	unsigned long total[KINDS] = { 0 };
+	unsigned long flash, ram;
+	int kind = -1;
+	int n;
+	int in_map = 0;
+	int in_memory = 0;
+	int i, k;
+	FILE * f;
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: memmap <map file>\n");
+		return 1;
+	}
+	f = fopen(argv[1], "r");
+	if (f == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	pending[0] = '\0';
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, "Memory Configuration", 20) == 0) {
+			in_memory = 1;
+			continue;
+		}
+		if (strncmp(line, "Linker script and memory map", 28) == 0) {
+			in_memory = 0;
+			in_map = 1;
+			continue;
+		}
+		if (in_memory) {
+			if ((sscanf(line, "%s %lx %lx", word, &origin, &length) == 3)) {
+				if (strcmp(word, "FLASH") == 0) {
+					flash_origin = origin;
+					flash_length = length;
+				} else if (strcmp(word, "RAM") == 0) {
+					ram_origin = origin;
+					ram_length = length;
+				}
+			}
+			continue;
+		}
+		if (!in_map) {
+			continue;
+		}
+
+		// "                0x00000800                __stack_size = ..."
+		if ((sscanf(line, " %lx %s", &address, word) == 2)
+				&& (strcmp(word, "__stack_size") == 0)) {
+			stack_size = address;
+			continue;
+		}
+		// output section at column 0, anything else there ends it
+		if (line[0] != ' ') {
+			kind = (line[0] == '.') && (sscanf(line, "%s", word) == 1) ? section_kind(word) : -1;
+			pending[0] = '\0';
+			continue;
+		}
+		if (kind < 0) {
+			continue;
+		}
+
+		// input section " name 0xaddress 0xsize file", a long name wraps before the address
+		n = sscanf(line, " %s %s %s %[^\n]", word, hex1, hex2, file);
+		if ((n == 1) && ((word[0] == '.') || (strcmp(word, "COMMON") == 0))) {
+			strcpy(pending, word);
+			continue;
+		}
+		if ((n >= 3) && is_hex(word) && is_hex(hex1) && (pending[0] != '\0')) {
+			// continuation: address, size, file
+			address = strtoul(word, NULL, 16);
+			size = strtoul(hex1, NULL, 16);
+			sscanf(line, " %*s %*s %[^\n]", file);
+		} else if ((n == 4) && ((word[0] == '.') || (strcmp(word, "COMMON") == 0))
+				&& is_hex(hex1) && is_hex(hex2)) {
+			address = strtoul(hex1, NULL, 16);
+			size = strtoul(hex2, NULL, 16);
+		} else {
+			// symbols, *fill*, script statements
+			pending[0] = '\0';
+			continue;
+		}
+		pending[0] = '\0';
+		if ((address == 0) || (size == 0)) {
+			continue;
+		}
+		module_find(file)->size[kind] += size;
+		total[kind] += size;
+	}
+	fclose(f);
+
+	if (module_count == 0) {
+		fprintf(stderr, "%s: no memory map found\n", argv[1]);
+		return 1;
+	}
+
+	qsort(modules, module_count, sizeof(module_t), module_compare);
+
+	printf("%-32s %7s %7s %7s %7s %7s %7s\n",
+			"module", "text", "rodata", "data", "bss", "flash", "ram");
+	for (i = 0; i < module_count; i++) {
+		printf("%-32s", modules[i].name);
+		for (k = 0; k < KINDS; k++) {
+			printf(" %7lu", modules[i].size[k]);
+		}
+		printf(" %7lu %7lu\n",
+				modules[i].size[TEXT] + modules[i].size[RODATA] + modules[i].size[DATA],
+				modules[i].size[DATA] + modules[i].size[BSS]);
+	}
+	flash = total[TEXT] + total[RODATA] + total[DATA];
+	ram = total[DATA] + total[BSS];
+	printf("%-32s", "total");
+	for (k = 0; k < KINDS; k++) {
+		printf(" %7lu", total[k]);
+	}
+	printf(" %7lu %7lu\n\n", flash, ram);
+
+	if (flash_length) {
+		printf("flash %lu of %lu bytes at 0x%08lx, %lu free\n", flash, flash_length,
+				flash_origin, (flash <= flash_length) ? flash_length - flash : 0);
+	}
+	if (ram_length) {
+		printf("ram   %lu static + %lu stack of %lu bytes at 0x%08lx, %ld free\n", ram,
+				stack_size, ram_length, ram_origin, (long) ram_length - (long) (ram + stack_size));
+	}
+	return 0;
+}
@@ -0,0 +1,261 @@
+/**
+ * OTA delta generator for LoggerSoft
+ *
+ * Makes a delta from the running image to the new one and prints the
+ * downlink frames for the gateway, one frame per line as hex bytes:
+ * DOWNLINK_TYPE_OTA_START, the data fragments, then one parity fragment
+ * per OTA_FEC_GROUP fragments. Both images are raw binaries of the
+ * application area (linked with gd32e23x_flash_ota.ld), they are padded
+ * with 0xFF to OTA_APP_SIZE like the node does. The delta is decoded
+ * again before printing to make sure it rebuilds the new image.
+ *
+ * The gateway has to pause a few seconds after the start frame, the node
+ * erases the W25Q staging area then.
+ *
+ * Build: gcc -O2 -I../inc -o ota_delta ota_delta.c ../src/crc32.c
+ * Usage: ota_delta old.bin new.bin session [device_id]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "packet.h"
+#include "ota_boot.h"
+#include "crc32.h"
+
+#define MIN_MATCH		6
+#define HASH_BITS		12
+#define MAX_CHAIN		64
+#define MAX_DELTA		(512 * OTA_FRAGMENT_SIZE)	// OTA_MAX_FRAGMENTS on the node
+
+static uint8_t old_image[OTA_APP_SIZE];
+static uint8_t new_image[OTA_APP_SIZE];
+static uint8_t delta[MAX_DELTA + OTA_FRAGMENT_SIZE];
+static uint32_t delta_length = 0;
+
+static int32_t head[1 << HASH_BITS];
+static int32_t chain[OTA_APP_SIZE];
+
+static long load(const char * path, uint8_t * image) {
+	FILE * file = fopen(path, "rb");
+	long length;
+
+	if (file == NULL) {
+		perror(path);
+		exit(1);
+	}
+	memset(image, 0xFF, OTA_APP_SIZE);
+	length = fread(image, 1, OTA_APP_SIZE, file);
+	if (fgetc(file) != EOF) {
+		fprintf(stderr, "%s: bigger than %lu bytes\n", path, (unsigned long) OTA_APP_SIZE);
+		exit(1);
+	}
+	fclose(file);
+	return length;
+}
+
+static void put(uint8_t byte) {
+	if (delta_length >= MAX_DELTA) {
+		fprintf(stderr, "delta bigger than %d bytes, flash the node by wire\n", MAX_DELTA);
+		exit(1);
+	}
+	delta[delta_length++] = byte;
+}
+
+static void put_u16(uint16_t value) {
+	put(value);
+	put(value >> 8);
+}
+
+static uint32_t hash(const uint8_t * p) {
+	return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761U) >> (32 - HASH_BITS);
+}
+
+static void flush_insert(uint32_t from, uint32_t to) {
+	uint32_t length;
+
+	while (from < to) {
+		length = (to - from > 0xFFFF) ? 0xFFFF : to - from;
+		put(OTA_OP_INSERT);
+		put_u16(length);
+		while (length--) {
+			put(new_image[from++]);
+		}
+	}
+}
+
+// greedy match against the old image through a hash chain
+static void make_delta(uint32_t length) {
+	uint32_t i;
+	uint32_t pos = 0;
+	uint32_t literal = 0;
+	uint32_t best_offset;
+	uint32_t best_length;
+	uint32_t n;
+	int32_t candidate;
+	int depth;
+
+	memset(head, -1, sizeof(head));
+	for (i = 0; i + 3 <= OTA_APP_SIZE; i++) {
+		chain[i] = head[hash(&old_image[i])];
+		head[hash(&old_image[i])] = i;
+	}
+
+	while (pos < length) {
+		best_length = 0;
+		best_offset = 0;
+		if (pos + 3 <= length) {
+			candidate = head[hash(&new_image[pos])];
+			for (depth = 0; (candidate >= 0) && (depth < MAX_CHAIN); depth++) {
+				n = 0;
+				while ((pos + n < length) && (candidate + n < OTA_APP_SIZE) && (n < 0xFFFF)
+						&& (old_image[candidate + n] == new_image[pos + n])) {
+					n++;
+				}
+				if (n > best_length) {
+					best_length = n;
+					best_offset = candidate;
+				}
+				candidate = chain[candidate];
+			}
+		}
+		if (best_length >= MIN_MATCH) {
+			flush_insert(literal, pos);
+			put(OTA_OP_COPY);
+			put_u16(best_offset);
+			put_u16(best_length);
+			pos += best_length;
+			literal = pos;
+		} else {
+			pos++;
+		}
+	}
+	flush_insert(literal, pos);
+	put(OTA_OP_END);
+}
+
+// same decoding as ota_apply() on the node
+static int check_delta(uint32_t length) {
+	static uint8_t image[OTA_APP_SIZE];
+	uint32_t in = 0;
+	uint32_t out = 0;
+	uint32_t offset;
+	uint32_t n;
+
+	memset(image, 0xFF, sizeof(image));
+	while (in < delta_length) {
+		switch (delta[in++]) {
+		case OTA_OP_END:
+			return (out == length) && (memcmp(image, new_image, OTA_APP_SIZE) == 0);
+		case OTA_OP_COPY:
+			offset = delta[in] | delta[in + 1] << 8;
+			n = delta[in + 2] | delta[in + 3] << 8;
+			in += 4;
+			if ((offset + n > OTA_APP_SIZE) || (out + n > OTA_APP_SIZE)) {
+				return 0;
+			}
+			memcpy(&image[out], &old_image[offset], n);
+			out += n;
+			break;
+		case OTA_OP_INSERT:
+			n = delta[in] | delta[in + 1] << 8;
+			in += 2;
+			if (out + n > OTA_APP_SIZE) {
+				return 0;
+			}
+			memcpy(&image[out], &delta[in], n);
+			in += n;
+			out += n;
+			break;
+		default:
+			return 0;
+		}
+	}
+	return 0;
+}
+
+static void print_frame(const downlink_header_t * header, const void * payload, size_t length) {
+	const uint8_t * p;
+	size_t i;
+
+	p = (const uint8_t*) header;
+	for (i = 0; i < sizeof(*header); i++) {
+		printf("%02X", p[i]);
+	}
+	p = payload;
+	for (i = 0; i < length; i++) {
+		printf("%02X", p[i]);
+	}
+	printf("\n");
+}
+
+int main(int argc, char ** argv) {
+	downlink_header_t header;
+	ota_start_t start;
+	ota_fragment_t fragment;
+	ota_fragment_t parity;
+	long old_length;
+	long new_length;
+	uint16_t i;
+	uint16_t groups;
+	int k;
+
+	if (argc < 4) {
+		fprintf(stderr, "usage: %s old.bin new.bin session [device_id]\n", argv[0]);
+		return 1;
+	}
+
+	old_length = load(argv[1], old_image);
+	new_length = load(argv[2], new_image);
+
+	make_delta(new_length);
+	if (!check_delta(new_length)) {
+		fprintf(stderr, "delta does not rebuild the new image\n");
+		return 1;
+	}
+
+	// pad last fragment with 0xFF
+	memset(&delta[delta_length], 0xFF, OTA_FRAGMENT_SIZE);
+
+	start.session = strtoul(argv[3], NULL, 0);
+	start.fragments = (delta_length + OTA_FRAGMENT_SIZE - 1) / OTA_FRAGMENT_SIZE;
+	start.delta_length = delta_length;
+	start.image_length = new_length;
+	start.base_crc = crc32_update(0, old_image, OTA_APP_SIZE);
+	start.image_crc = crc32_update(0, new_image, OTA_APP_SIZE);
+	groups = (start.fragments + OTA_FEC_GROUP - 1) / OTA_FEC_GROUP;
+
+	header.device_id = (argc > 4) ? strtoul(argv[4], NULL, 0) : DOWNLINK_BROADCAST;
+
+	header.type = DOWNLINK_TYPE_OTA_START;
+	print_frame(&header, &start, sizeof(start));
+
+	header.type = DOWNLINK_TYPE_OTA_FRAGMENT;
+	fragment.session = start.session;
+	for (i = 0; i < start.fragments; i++) {
+		fragment.index = i;
+		memcpy(fragment.data, &delta[i * OTA_FRAGMENT_SIZE], OTA_FRAGMENT_SIZE);
+		print_frame(&header, &fragment, sizeof(fragment));
+	}
+
+	header.type = DOWNLINK_TYPE_OTA_PARITY;
+	parity.session = start.session;
+	for (parity.index = 0; parity.index < groups; parity.index++) {
+		memset(parity.data, 0, OTA_FRAGMENT_SIZE);
+		for (i = parity.index * OTA_FEC_GROUP;
+				(i < (parity.index + 1) * OTA_FEC_GROUP) && (i < start.fragments); i++) {
+			for (k = 0; k < OTA_FRAGMENT_SIZE; k++) {
+				parity.data[k] ^= delta[i * OTA_FRAGMENT_SIZE + k];
+			}
+		}
+		print_frame(&header, &parity, sizeof(parity));
+	}
+
+	fprintf(stderr, "old %ld bytes, new %ld bytes, delta %u bytes (%.1f %%)\n",
+			old_length, new_length, delta_length, 100.0 * delta_length / new_length);
+	fprintf(stderr, "%u fragments + %u parity, base crc %08X, image crc %08X\n",
+			start.fragments, groups, start.base_crc, start.image_crc);
+	return 0;
+}
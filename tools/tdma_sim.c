@@ -0,0 +1,189 @@
+/**
+ * TDMA channel simulator for LoggerSoft
+ *
+ * Compares unslotted uplinks (pure ALOHA, one frame per period at a random
+ * time) with the beacon TDMA of tdma.c for a growing number of nodes on
+ * one gateway. Utilization is the airtime of frames received without
+ * overlap per period. The TDMA limit is slot_count * airtime / period,
+ * pure ALOHA peaks at 1/(2e) = 18.4 %.
+ *
+ * Node clocks have a fixed rate error within +-drift_ppm plus a random
+ * walk of walk_ppm per period (temperature). Each node learns its drift
+ * from the beacons like tdma_beacon() and sends at the start of its slot
+ * plus guard_ms, off by the drift it did not predict. The first table
+ * shows the beacon window of a node shrinking while it learns.
+ *
+ * Build: gcc -O2 -o tdma_sim tdma_sim.c
+ * Usage: tdma_sim [airtime_ms] [guard_ms] [drift_ppm] [walk_ppm]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// main.h defaults
+#define PERIOD_S			900
+#define BEACON_AIR_MS		2500
+#define GUARD_MIN_MS		20
+#define DRIFT_INIT_PPM		250000
+
+#define MAX_NODES			2048
+#define PERIODS				200
+#define LEARN_PERIODS		40
+
+typedef struct {
+	double drift;			// true rate error [ppm]
+	int32_t drift_ppm;		// estimate, as in tdma_t
+	int32_t jitter_ppm;
+	int known;
+	double tx;				// TX start in period [ms]
+	uint32_t slot;
+} node_t;
+
+static node_t nodes[MAX_NODES];
+static uint64_t rng = 0x9E3779B97F4A7C15ULL;
+
+static double uniform(void) {
+	rng ^= rng << 13;
+	rng ^= rng >> 7;
+	rng ^= rng << 17;
+	return (rng >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// firmware estimator, error [ms] found at a beacon elapsed [ms] after the last one
+static void learn(node_t * node, int32_t error, uint32_t elapsed) {
+	int32_t sample = (int64_t) error * 1000000 / elapsed;
+	int32_t deviation;
+
+	if (!node->known) {
+		node->drift_ppm = sample;
+		node->known = 1;
+		return;
+	}
+	deviation = abs(sample - node->drift_ppm);
+	node->jitter_ppm += (deviation - node->jitter_ppm) / 4;
+	node->drift_ppm += (sample - node->drift_ppm) / 4;
+}
+
+static uint32_t guard(const node_t * node, uint32_t elapsed) {
+	uint32_t g = GUARD_MIN_MS + (uint64_t) elapsed * node->jitter_ppm / 1000000;
+
+	return (g > PERIOD_S * 500) ? PERIOD_S * 500 : g;
+}
+
+static void init_nodes(uint32_t count, double drift_ppm) {
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		nodes[i].drift = (2 * uniform() - 1) * drift_ppm;
+		nodes[i].drift_ppm = 0;
+		nodes[i].jitter_ppm = DRIFT_INIT_PPM;
+		nodes[i].known = 0;
+	}
+}
+
+static void walk(uint32_t count, double walk_ppm) {
+	uint32_t i;
+
+	for (i = 0; i < count; i++) {
+		nodes[i].drift += (2 * uniform() - 1) * walk_ppm;
+	}
+}
+
+static int cmp_tx(const void * a, const void * b) {
+	double d = ((const node_t*) a)->tx - ((const node_t*) b)->tx;
+
+	return (d > 0) - (d < 0);
+}
+
+// frames without overlap in one period, tx set for every node
+static uint32_t received(uint32_t count, double airtime) {
+	uint32_t ok = 0;
+	uint32_t i;
+
+	qsort(nodes, count, sizeof(node_t), cmp_tx);
+	for (i = 0; i < count; i++) {
+		if (((i == 0) || (nodes[i].tx - nodes[i - 1].tx >= airtime))
+				&& ((i + 1 == count) || (nodes[i + 1].tx - nodes[i].tx >= airtime))) {
+			ok++;
+		}
+	}
+	return ok;
+}
+
+static double aloha(uint32_t count, double airtime) {
+	uint64_t ok = 0;
+	uint32_t p;
+	uint32_t i;
+
+	for (p = 0; p < PERIODS; p++) {
+		for (i = 0; i < count; i++) {
+			nodes[i].tx = uniform() * PERIOD_S * 1000.0;
+		}
+		ok += received(count, airtime);
+	}
+	return ok * airtime / (PERIODS * PERIOD_S * 1000.0);
+}
+
+static double tdma(uint32_t count, double airtime, uint32_t slot_ms, uint32_t guard_ms,
+		uint32_t slots, double drift_ppm, double walk_ppm) {
+	uint64_t ok = 0;
+	uint32_t p;
+	uint32_t i;
+	uint32_t offset;
+	double error;
+
+	init_nodes(count, drift_ppm);
+	for (i = 0; i < count; i++) {
+		// gateway assigns slots in order, the rest share
+		nodes[i].slot = 1 + i % slots;
+	}
+	for (p = 0; p < PERIODS + LEARN_PERIODS; p++) {
+		for (i = 0; i < count; i++) {
+			// RTC was set at the beacon, the slot is offset ms later
+			offset = nodes[i].slot * slot_ms + guard_ms;
+			error = offset * (nodes[i].drift - nodes[i].drift_ppm) / 1e6;
+			nodes[i].tx = offset + error;
+			learn(&nodes[i], (int32_t) (PERIOD_S * 1000.0 * nodes[i].drift / 1e6), PERIOD_S * 1000);
+		}
+		if (p >= LEARN_PERIODS) {
+			ok += received(count, airtime);
+		}
+		walk(count, walk_ppm);
+	}
+	return ok * airtime / (PERIODS * PERIOD_S * 1000.0);
+}
+
+int main(int argc, char ** argv) {
+	double airtime = (argc > 1) ? atof(argv[1]) : 1500;
+	uint32_t guard_ms = (argc > 2) ? atoi(argv[2]) : 50;
+	double drift_ppm = (argc > 3) ? atof(argv[3]) : 220000;
+	double walk_ppm = (argc > 4) ? atof(argv[4]) : 50;
+	uint32_t slot_ms = airtime + 2 * guard_ms;
+	uint32_t slots = (PERIOD_S * 1000UL - slot_ms) / slot_ms;
+	double limit = slots * airtime / (PERIOD_S * 1000.0);
+	uint32_t count;
+	uint32_t p;
+
+	if (slots > MAX_NODES) {
+		slots = MAX_NODES;
+	}
+	printf("period %u s, airtime %.0f ms, slot %u ms, %u slots, TDMA limit %.1f %%\n\n",
+			PERIOD_S, airtime, slot_ms, slots, limit * 100);
+
+	printf("beacon  drift est  jitter  window\n");
+	init_nodes(1, drift_ppm);
+	for (p = 1; p <= LEARN_PERIODS; p++) {
+		printf("%6u %10d %7d %7u ms\n", p, nodes[0].drift_ppm, nodes[0].jitter_ppm,
+				2 * guard(&nodes[0], PERIOD_S * 1000) + BEACON_AIR_MS);
+		learn(&nodes[0], (int32_t) (PERIOD_S * 1000.0 * nodes[0].drift / 1e6), PERIOD_S * 1000);
+		walk(1, walk_ppm);
+	}
+
+	printf("\nnodes   ALOHA    TDMA   [utilization %%]\n");
+	for (count = 16; count <= MAX_NODES; count = (count < slots) && (count * 2 > slots) ? slots : count * 2) {
+		printf("%5u %7.1f %7.1f\n", count, aloha(count, airtime) * 100,
+				tdma(count, airtime, slot_ms, guard_ms, slots, drift_ppm, walk_ppm) * 100);
+	}
+	return 0;
+}